@@ -25,13 +25,15 @@ extern "C" {
 // These are required by the C standard. Compilers may implicitly
 // generate calls to these functions.
 //
-// TODO: These implementations are pretty unoptimized, doing
-// comparisons byte-by-byte. This is pretty platform-agnostic, but we
-// can speed this up significantly by going word-by-word since the
-// endiannness is well-defined on x86 (or using SSE!).
-//
-// Hopefully the compiler is smart enough to inline or heavily
-// optimize calls to these functions.
+// The kernel provides optimized implementations, which are selected
+// on boot based on the CPU's features (see nonstd/memops.h). The
+// bootloader uses the simple byte-by-byte versions below.
+#ifdef __cplusplus
+void *memcpy(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
+int memcmp(const void *s1, const void *s2, size_t n);
+#else
 __inline void *memcpy(void *dest, const void *src, size_t n);
 __inline void *memset(void *s, int c, size_t n);
 __inline void *memmove(void *dest, const void *src, size_t n);
@@ -88,6 +90,7 @@ __inline int memcmp(const void *s1, const void *s2, size_t n) {
 
   return 0;
 }
+#endif
 
 #undef __inline
 #ifdef __cplusplus
@@ -0,0 +1,56 @@
+#pragma once
+
+/// \file
+/// \brief CPU feature detection via the CPUID instruction.
+
+#include <cstdint>
+
+namespace arch::cpuid {
+
+/// Output registers of the CPUID instruction.
+struct Registers {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+};
+
+inline Registers cpuid(uint32_t leaf, uint32_t subleaf = 0) {
+  Registers regs;
+  __asm__ volatile("cpuid"
+                   : "=a"(regs.eax), "=b"(regs.ebx), "=c"(regs.ecx),
+                     "=d"(regs.edx)
+                   : "a"(leaf), "c"(subleaf));
+  return regs;
+}
+
+/// SYSENTER/SYSEXIT support (CPUID.01H:EDX.SEP[bit 11]).
+inline bool has_sep() { return cpuid(1).edx & (1 << 11); }
+
+/// Physical address extension (CPUID.01H:EDX.PAE[bit 6]).
+inline bool has_pae() { return cpuid(1).edx & (1 << 6); }
+
+/// FXSAVE/FXRSTOR (CPUID.01H:EDX.FXSR[bit 24]).
+inline bool has_fxsr() { return cpuid(1).edx & (1 << 24); }
+
+/// SSE instructions (CPUID.01H:EDX.SSE[bit 25]).
+inline bool has_sse() { return cpuid(1).edx & (1 << 25); }
+
+/// SSE2 instructions, including MOVNTI (CPUID.01H:EDX.SSE2[bit 26]).
+inline bool has_sse2() { return cpuid(1).edx & (1 << 26); }
+
+/// Enhanced REP MOVSB/STOSB, i.e., byte-granular string instructions
+/// are at least as fast as the dword ones
+/// (CPUID.(EAX=07H,ECX=0H):EBX.ERMS[bit 9]).
+inline bool has_erms() {
+  return cpuid(0).eax >= 7 && cpuid(7).ebx & (1 << 9);
+}
+
+/// Execute-disable bit (CPUID.80000001H:EDX.NX[bit 20]). This is only
+/// usable with PAE paging.
+inline bool has_nx() {
+  return cpuid(0x80000000).eax >= 0x80000001 &&
+         cpuid(0x80000001).edx & (1 << 20);
+}
+
+} // namespace arch::cpuid
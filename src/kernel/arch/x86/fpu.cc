@@ -0,0 +1,92 @@
+#include "fpu.h"
+#include "cpuid.h"
+#include <cstdint>
+
+namespace arch::fpu {
+
+namespace {
+
+constexpr size_t cr0_mp = 1 << 1;
+constexpr size_t cr0_em = 1 << 2;
+constexpr size_t cr0_ts = 1 << 3;
+constexpr size_t cr0_ne = 1 << 5;
+constexpr size_t cr4_osfxsr = 1 << 9;
+constexpr size_t cr4_osxmmexcpt = 1 << 10;
+
+/// Default MXCSR: all SIMD exceptions masked, round to nearest.
+constexpr uint32_t mxcsr_default = 0x1F80;
+
+bool fpu_enabled = false;
+
+/// Mirrors CR0.TS.
+bool ts_set = false;
+
+/// The state loaded by \ref reset(). This also clears the XMM
+/// registers, which FNINIT doesn't, so that threads don't see each
+/// other's data.
+State initial_state;
+
+size_t read_cr0() {
+  size_t cr0;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+  return cr0;
+}
+
+void write_cr0(size_t cr0) {
+  __asm__ volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+}
+
+} // namespace
+
+bool init() {
+  if (!cpuid::has_fxsr() || !cpuid::has_sse()) {
+    return false;
+  }
+
+  // MP makes WAIT/FWAIT respect TS as well. NE reports x87
+  // exceptions through #MF rather than the legacy IRQ13.
+  write_cr0((read_cr0() & ~(cr0_em | cr0_ts)) | cr0_mp | cr0_ne);
+  ts_set = false;
+
+  size_t cr4;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+  cr4 |= cr4_osfxsr | cr4_osxmmexcpt;
+  __asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+
+  fpu_enabled = true;
+  __asm__ volatile("fninit\n\t"
+                   "ldmxcsr %0\n\t"
+                   "xorps %%xmm0, %%xmm0\n\t"
+                   "xorps %%xmm1, %%xmm1\n\t"
+                   "xorps %%xmm2, %%xmm2\n\t"
+                   "xorps %%xmm3, %%xmm3\n\t"
+                   "xorps %%xmm4, %%xmm4\n\t"
+                   "xorps %%xmm5, %%xmm5\n\t"
+                   "xorps %%xmm6, %%xmm6\n\t"
+                   "xorps %%xmm7, %%xmm7"
+                   :
+                   : "m"(mxcsr_default));
+  save(initial_state);
+  set_task_switched(true);
+  return true;
+}
+
+bool enabled() { return fpu_enabled; }
+
+void set_task_switched(bool ts) {
+  if (ts == ts_set) {
+    return;
+  }
+  if (ts) {
+    write_cr0(read_cr0() | cr0_ts);
+  } else {
+    __asm__ volatile("clts" : : : "memory");
+  }
+  ts_set = ts;
+}
+
+bool task_switched() { return ts_set; }
+
+void reset() { restore(initial_state); }
+
+} // namespace arch::fpu
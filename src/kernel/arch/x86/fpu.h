@@ -0,0 +1,55 @@
+#pragma once
+
+/// \file
+/// \brief x87 FPU and SSE state.
+///
+/// The FPU/SSE registers are large (512 bytes for FXSAVE), and most
+/// threads never touch them, so they are switched lazily: the
+/// scheduler sets CR0.TS when switching to a thread that doesn't own
+/// the register contents, and the first FPU/SSE instruction then
+/// raises #NM (device not available). Only then is the owner's state
+/// saved and the current thread's restored (see \ref
+/// sched::Scheduler::handle_fpu_trap()).
+
+#include <cstddef>
+
+namespace arch::fpu {
+
+/// FXSAVE/FXRSTOR area.
+struct alignas(16) State {
+  std::byte data[512];
+};
+
+/// Enable the FPU and SSE (CR0.EM clear, CR4.OSFXSR and
+/// CR4.OSXMMEXCPT set). The registers are left in their initial
+/// state, with CR0.TS set.
+///
+/// \return false if the CPU doesn't support FXSAVE or SSE. The FPU is
+/// then left disabled (CR0.EM set), so that FPU instructions fault.
+bool init();
+
+/// Whether \ref init() succeeded.
+bool enabled();
+
+/// Set or clear CR0.TS. This is a no-op if it's already in the
+/// requested state, since writing CR0 is serializing.
+void set_task_switched(bool ts);
+
+/// Whether CR0.TS is set.
+bool task_switched();
+
+/// Put the registers in their initial state, with all exceptions
+/// masked. CR0.TS must be clear.
+void reset();
+
+/// CR0.TS must be clear.
+inline void save(State &state) {
+  __asm__ volatile("fxsave %0" : "=m"(state));
+}
+
+/// CR0.TS must be clear.
+inline void restore(const State &state) {
+  __asm__ volatile("fxrstor %0" : : "m"(state));
+}
+
+} // namespace arch::fpu
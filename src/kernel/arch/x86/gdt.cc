@@ -108,4 +108,6 @@ void init() {
 
 void set_tss_esp0(void *esp0) { tss.esp0 = (size_t)esp0; }
 
+const void *tss_esp0_addr() { return &tss.esp0; }
+
 } // namespace arch::gdt
@@ -116,4 +116,9 @@ void init();
 ///
 void set_tss_esp0(void *esp0);
 
+/// Address of the TSS's esp0 field. The SYSENTER entry stub loads its
+/// kernel stack pointer from here, so that \ref set_tss_esp0()
+/// updates the kernel stack for both entry paths.
+const void *tss_esp0_addr();
+
 } // namespace arch::gdt
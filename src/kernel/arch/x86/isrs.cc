@@ -2,19 +2,20 @@
 
 #include "drivers/acpi.h"
 #include "drivers/pic.h"
+#include "fpu.h"
 #include "mm/virt.h"
 #include "nonstd/libc.h"
-#include "nonstd/polyfill.h"
 #include "page_table.h"
 #include "proc/process.h"
 #include "proc/syscalls.h"
 #include "util/algorithm.h"
-#include <type_traits>
+#include <bit>
 
 extern void (*__start_text_isrs)();
 extern void (*__stop_text_isrs)();
 
 extern void do_schedule();
+extern void do_fpu_trap();
 extern proc::Process *curr_proc();
 
 void (**isrs)() = &__start_text_isrs;
@@ -74,15 +75,28 @@ void isr_pit(uint32_t ivec, RegisterFrame reg_frame, InterruptFrame frame) {
   do_schedule();
 }
 
+void isr_nm(uint32_t ivec, RegisterFrame reg_frame, InterruptFrame frame) {
+  // If the FPU is disabled (CR0.EM), FPU instructions can't run at
+  // all.
+  if (unlikely(!arch::fpu::enabled())) {
+    isr_dumpregs(ivec, reg_frame, frame);
+  }
+  do_fpu_trap();
+}
+
 void isr_pf(uint32_t ivec, RegisterFrame reg_frame, uint32_t error_code,
             InterruptFrame frame) {
-  // TODO: CoW support. We'll need to enable WP in CR0
-  // TODO: support file-backed pages
-  // TODO: write frame metadata to the PFT
   // TODO: use SIGSEGV to kill process rather than _exit
   size_t faulted_addr;
   __asm__ volatile("mov %%cr2, %0" : "=r"(faulted_addr));
 
+  // Kernel page tables created after this address space was created
+  // are propagated lazily. This may happen outside process context.
+  if (arch::page_table::sync_kernel_pde(
+          (void *)util::algorithm::floor_pow2<PG_SZ>(faulted_addr))) {
+    return;
+  }
+
   // Page faults should only happen in process context.
   auto *proc = curr_proc();
   ASSERT(proc != nullptr);
@@ -103,7 +117,21 @@ void isr_pf(uint32_t ivec, RegisterFrame reg_frame, uint32_t error_code,
   static_assert(sizeof(PFErrorCode) == sizeof error_code);
   auto err = std::bit_cast<PFErrorCode>(error_code);
   if (err.p) {
-    // TODO: handle CoW in this branch.
+    // Writes to a writable VMA may hit a page that was
+    // write-protected by fork or the zero page (copy-on-write). Note
+    // that these may also come from the kernel, since CR0.WP is set.
+    if (const auto *vma = proc->find_vma(faulted_addr);
+        err.w && vma != nullptr && vma->prot.writable) {
+      fs::Result res = fs::Result::Ok;
+      vma->write_fault(faulted_addr, res);
+      if (res != fs::Result::Ok) {
+        nonstd::printf("Failed to copy page @ 0x%x: %s. Process killed.\r\n",
+                       faulted_addr, fs::result_to_str(res));
+        proc->exit(1);
+      }
+      return;
+    }
+
     nonstd::printf("Segfault due to permissions issue. w=%d u=%d r=%d i=%d "
                    "pk=%d ss=%d sgx=%d @ 0x%x. Process killed.\r\n",
                    err.w, err.u, err.r, err.i, err.pk, err.ss, err.sgx,
@@ -119,33 +147,23 @@ void isr_pf(uint32_t ivec, RegisterFrame reg_frame, uint32_t error_code,
   // hit the above branch. However, a page fault can be expensive
   // (e.g., populating a file-backed page from disk), so let's emulate
   // the permissions check here.
-  for (const auto &vma : proc->get_vmas()) {
-    if (faulted_addr >= vma.addr && faulted_addr < vma.addr + vma.len) {
-      if ((!err.w & !vma.prot.readable) || (err.w & !vma.prot.writable) ||
-          (err.i & !vma.prot.executable)) {
-        if (faulted_addr < mem::virt::hhdm_start && !err.u) {
-          // This is the kernel mapping an ELF binary, allow this exception.
-        } else {
-          nonstd::printf("Segfault due to permissions issue when loading new "
-                         "page. w=%d i=%d @ 0x%x. Process killed.\r\n",
-                         err.w, err.i, faulted_addr);
-          proc->exit(1);
-        }
-      }
+  if (const auto *vma = proc->find_vma(faulted_addr); vma != nullptr) {
+    if ((!err.w & !vma->prot.readable) || (err.w & !vma->prot.writable) ||
+        (err.i & !vma->prot.executable)) {
+      nonstd::printf("Segfault due to permissions issue when loading new "
+                     "page. w=%d i=%d @ 0x%x. Process killed.\r\n",
+                     err.w, err.i, faulted_addr);
+      proc->exit(1);
+    }
 
-      if (vma.flags.map_anon) {
-        mem::virt::vmalloc(
-            (void *)util::algorithm::floor_pow2<PG_SZ>(faulted_addr), 1,
-            /*writable=*/vma.prot.writable);
-        return;
-      } else {
-        nonstd::printf("page fault handler invoked for file-backed page @ "
-                       "0x%x.\r\n",
-                       faulted_addr);
-        isr_dumpregs_errcode(ivec, reg_frame, error_code, frame);
-      }
-      __builtin_unreachable();
+    fs::Result res = fs::Result::Ok;
+    vma->fault(faulted_addr, err.w, res);
+    if (res != fs::Result::Ok) {
+      nonstd::printf("Failed to load page @ 0x%x: %s. Process killed.\r\n",
+                     faulted_addr, fs::result_to_str(res));
+      proc->exit(1);
     }
+    return;
   }
 
   nonstd::printf("Segfault @ 0x%x for non-present page. Process killed.\r\n",
@@ -153,25 +171,33 @@ void isr_pf(uint32_t ivec, RegisterFrame reg_frame, uint32_t error_code,
   proc->exit(1);
 }
 
-void isr_syscall(uint32_t ivec, RegisterFrame reg_frame, InterruptFrame frame) {
+/// \brief Stack frame on entry to \ref isr_syscall().
+///
+/// Syscalls always come from userspace, so the interrupt frame also
+/// includes the userspace stack.
+struct SyscallFrame {
+  RegisterFrame regs;
+  InterruptFrame frame;
+  uint32_t esp3;
+  uint32_t ss3;
+} __attribute__((packed));
+
+void isr_syscall(SyscallFrame *frame) {
   // Syscalls should only happen in process context.
   auto proc = curr_proc();
   ASSERT(proc != nullptr);
 
-  // note: narrowing conversion
-  const auto syscall =
-      proc::Syscall{(std::underlying_type_t<proc::Syscall>)reg_frame.eax};
+  proc::SyscallContext ctx{
+      .nr = frame->regs.eax,
+      .args = {frame->regs.ebx, frame->regs.ecx, frame->regs.edx,
+               frame->regs.esi, frame->regs.edi},
+      .eip3 = frame->frame.eip,
+      .esp3 = frame->esp3,
+      .ebp = frame->regs.ebp,
+  };
 
-  // TODO: move syscall handling into its own file, or into Process class
-  switch (syscall) {
-  case proc::Syscall::Exit:
-    nonstd::printf("Processing exit syscall w/ retcode %u\r\n", reg_frame.ebx);
-    proc->exit(reg_frame.ebx);
-    return;
-  default:
-    nonstd::printf("Unknown syscall %u\r\n", nonstd::to_underlying(syscall));
-    ASSERT(false);
-  }
+  // This is restored into eax by `popa`.
+  frame->regs.eax = proc::do_syscall(*proc, ctx);
 }
 }
 
@@ -179,9 +205,14 @@ void isr_syscall(uint32_t ivec, RegisterFrame reg_frame, InterruptFrame frame) {
 //
 // Not using __attribute__((interrupt)) since it's not easy to read
 // register values from there.
+//
+// The direction flag is cleared on entry since the interrupted code
+// may have set it, and the string instructions used by memcpy() and
+// memset() assume it's clear. `iret` restores it.
 #define _ISR(IVEC, C_ENTRY, POP_ERR)                                           \
   __attribute__((naked)) void isr_##IVEC() {                                   \
-    __asm__ volatile("pusha\n\t"                                               \
+    __asm__ volatile("cld\n\t"                                                 \
+                     "pusha\n\t"                                               \
                      "push $" #IVEC "\n\t"                                     \
                      "call " #C_ENTRY "\n\t"                                   \
                      "pop %eax\n\t"                                            \
@@ -197,12 +228,28 @@ void isr_syscall(uint32_t ivec, RegisterFrame reg_frame, InterruptFrame frame) {
 #define ISR(IVEC, C_ENTRY) _ISR(IVEC, C_ENTRY, "")
 #define ISRE(IVEC, C_ENTRY) _ISR(IVEC, C_ENTRY, "add $4, %esp")
 
+/// Use ISRP to pass a pointer to the saved registers (rather than a
+/// copy) to the C entry, so that it can modify the values restored by
+/// `popa` (e.g., to set a syscall's return value). The ivec is not
+/// passed.
+#define ISRP(IVEC, C_ENTRY)                                                    \
+  __attribute__((naked)) void isr_##IVEC() {                                   \
+    __asm__ volatile("cld\n\t"                                                 \
+                     "pusha\n\t"                                               \
+                     "push %esp\n\t"                                           \
+                     "call " #C_ENTRY "\n\t"                                   \
+                     "add $4, %esp\n\t"                                        \
+                     "popa\n\t"                                                \
+                     "iret");                                                  \
+  }                                                                            \
+  __attribute__((section("text_isrs"))) void (*_isr_##IVEC)() = &isr_##IVEC;
+
 /// Order matters here! We are basically writing these directly to an
 /// array (in a special text section). ISRs 0-31 are reserved for
 /// exceptions, and 32-255 are for (maskable) interrupts. The #XX
 /// abbreviations are mnemonics used by Intel.
 ///
-/// #DF, #TS, #NP, #SS, #GP, #PF, #AC, #XM, #CP push error codes onto
+/// #DF, #TS, #NP, #SS, #GP, #PF, #AC, #CP push error codes onto
 /// #the stack, and these need to be popped correctly using ISRE().
 ///
 /// For now the default action for unhandled interrupts to dump
@@ -217,8 +264,8 @@ ISR(0x03, isr_dumpregs);          // #BP Breakpoint
 ISR(0x04, isr_dumpregs);          // #OF Overflow
 ISR(0x05, isr_dumpregs);          // #BR Bound range exceeded
 ISR(0x06, isr_dumpregs);          // #UD Invalid opode
-ISRE(0x07, isr_dumpregs_errcode); // #DF Device not available
-ISR(0x08, isr_dumpregs);          // #DF Double fault
+ISR(0x07, isr_nm);                // #NM Device not available
+ISRE(0x08, isr_dumpregs_errcode); // #DF Double fault
 ISR(0x09, isr_dumpregs);          // #MF Coprocessor segment overrun
 ISRE(0x0A, isr_dumpregs_errcode); // #TS Invalid TSS
 ISRE(0x0B, isr_dumpregs_errcode); // #NP Segment not present
@@ -229,7 +276,7 @@ ISR(0x0F, isr_dumpregs);          // reserved
 ISR(0x10, isr_dumpregs);          // #MF x87 floating-point exception
 ISRE(0x11, isr_dumpregs_errcode); // #AC Alignment check
 ISR(0x12, isr_dumpregs);          // #MC Machine check
-ISRE(0x13, isr_dumpregs_errcode); // #XM SIMD floating-point exception
+ISR(0x13, isr_dumpregs);          // #XM SIMD floating-point exception
 ISR(0x14, isr_dumpregs);          // #VE Virtualization exception
 ISRE(0x15, isr_dumpregs_errcode); // #CP Control protection exception
 ISR(0x16, isr_dumpregs);          // reserved
@@ -342,7 +389,7 @@ ISR(0x7C, isr_dumpregs);
 ISR(0x7D, isr_dumpregs);
 ISR(0x7E, isr_dumpregs);
 ISR(0x7F, isr_dumpregs);
-ISR(0x80, isr_syscall); // x86 syscall (SW interrupt)
+ISRP(0x80, isr_syscall); // x86 syscall (SW interrupt)
 ISR(0x81, isr_dumpregs);
 ISR(0x82, isr_dumpregs);
 ISR(0x83, isr_dumpregs);
@@ -472,3 +519,5 @@ ISR(0xFE, isr_dumpregs);
 ISR(0xFF, isr_dumpregs);
 
 #undef ISR
+#undef ISRE
+#undef ISRP
@@ -0,0 +1,28 @@
+#pragma once
+
+/// \file
+/// \brief Model-specific register (MSR) access.
+
+#include <cstdint>
+
+namespace arch::msr {
+
+/// Architectural MSR indices.
+constexpr uint32_t ia32_sysenter_cs = 0x174;
+constexpr uint32_t ia32_sysenter_esp = 0x175;
+constexpr uint32_t ia32_sysenter_eip = 0x176;
+constexpr uint32_t ia32_efer = 0xC0000080;
+
+inline uint64_t read(uint32_t msr) {
+  uint32_t lo, hi;
+  __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+  return (uint64_t)hi << 32 | lo;
+}
+
+inline void write(uint32_t msr, uint64_t val) {
+  __asm__ volatile("wrmsr"
+                   :
+                   : "c"(msr), "a"((uint32_t)val), "d"((uint32_t)(val >> 32)));
+}
+
+} // namespace arch::msr
@@ -1,9 +1,16 @@
 #include "page_table.h"
+#include "cpuid.h"
 #include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/page_frame_table.h"
 #include "mm/virt.h"
+#include "mm/zero_pool.h"
 #include "nonstd/libc.h"
+#include "nonstd/vector.h"
+#include "page_table_pae.h"
 #include "perf.h"
 #include "util/algorithm.h"
+#include <bit>
 #include <cstddef>
 
 namespace arch::page_table {
@@ -23,15 +30,13 @@ struct PageDirectoryEntry {
 } __attribute__((packed));
 static_assert(sizeof(PageDirectoryEntry) == 4, "wrong PageDirectoryEntry size");
 
-/// 4MB page directory table hugepage entry.
+/// 4MB page directory table hugepage entry. This requires CR4.PSE,
+/// which is set by the bootloader.
 ///
-/// \note The only hugepage usage in HmmOS is set up by the bootloader
-/// for the HHDM. For simplicity (for now), HmmOS doesn't attempt to
-/// map/unmap any hugepages, and only dealing with 4KB pages. Any
-/// attempt to modify the existing HHDM mapping/allocate new hugepages
-/// is UB. This struct only exists to properly enumerate the
-/// bootloader's HHDM. If we ever want to allow user-space hugepages,
-/// we should look into libhugetblfs.
+/// Hugepages are used for the bootloader's HHDM, and may be created
+/// by \ref map_huge(). Any 4KB-granular operation on a hugepage
+/// (other than \ref get_phys()) first splits it into a page table of
+/// 4KB pages mapping the same frames; see \ref split_huge().
 ///
 struct PageDirectoryHugepageEntry {
   bool p : 1;
@@ -91,30 +96,114 @@ PageDirectoryEntry *get_page_directory() {
   return mem::virt::direct_to_hhdm<PageDirectoryEntry>(table_phys);
 }
 
-/// Helper function which performs the page table walk.
-///
-/// \return nullptr if the PDE is not present. The PTE entry will be
-/// returned as long as the PDE is present, even if the PTE is itself
-/// not present.
-///
-PageTableEntry *fetch_pte(void *virt) {
-  assert(PG_ALIGNED((size_t)virt));
+namespace {
 
-  // Index in PD (high 10 bits).
-  auto *pd = get_page_directory();
-  unsigned pd_idx = ((size_t)virt >> PG_SZ_BITS) >> directory_entry_bits;
-  auto &pde = pd[pd_idx];
-  if (!pde.p) {
-    return nullptr;
+/// \see init()
+PageDirectoryEntry *kernel_pd = nullptr;
+
+/// \see enable_pae()
+bool pae_active = false;
+
+/// Page directories created by \ref clone_kernel_page_directory().
+/// New kernel PDEs are copied into these lazily (see \ref
+/// sync_kernel_pde()), but changes to present kernel PDEs (see \ref
+/// split_huge()) must be copied into each of them eagerly.
+constinit nonstd::vector<PageDirectoryEntry *> page_directories;
+
+constexpr unsigned kernel_pd_start = mem::virt::hhdm_start / HUGE_PG_SZ;
+static_assert(
+    util::algorithm::aligned_pow2<HUGE_PG_SZ>(mem::virt::hhdm_start));
+
+unsigned pd_index(void *virt) {
+  return ((size_t)virt >> PG_SZ_BITS) >> directory_entry_bits;
+}
+
+/// Replace the hugepage \a pde (which maps \a virt) with a page table
+/// mapping the same frames with the same attributes. Kernel hugepages
+/// are split in every address space.
+void split_huge(PageDirectoryEntry &pde, void *virt) {
+  DEBUG_ASSERT(pde.p && pde.ps);
+  const auto huge = std::bit_cast<PageDirectoryHugepageEntry>(pde);
+
+  auto *pt = reinterpret_cast<PageTableEntry *>(::operator new(PG_SZ));
+  ASSERT(pt != nullptr);
+  for (unsigned i = 0; i < page_table_entries; ++i) {
+    auto &pte = pt[i];
+    nonstd::memset(&pte, 0, sizeof pte);
+    pte.p = 1;
+    pte.r_w = huge.r_w;
+    pte.u_s = huge.u_s;
+    pte.pwt = huge.pwt;
+    pte.pcd = huge.pcd;
+    pte.a = huge.a;
+    pte.d = huge.d;
+    pte.g = huge.g;
+    pte.addr = (huge.addr << page_table_bits) + i;
   }
 
-  // 4MB hugepages not supported by HmmOS.
-  assert(!pde.ps);
+  // As in \ref map(), permissions are controlled at the page table
+  // level.
+  nonstd::memset(&pde, 0, sizeof pde);
+  pde.p = 1;
+  pde.r_w = 1;
+  pde.u_s = 1;
+  pde.addr = mem::virt::hhdm_to_direct(pt) >> PG_SZ_BITS;
+  if (const unsigned pd_idx = pd_index(virt);
+      kernel_pd != nullptr && pd_idx >= kernel_pd_start) {
+    // Other address spaces may have a (lazily-synced) copy of the
+    // hugepage, or nothing yet.
+    kernel_pd[pd_idx] = pde;
+    for (auto *pd : page_directories) {
+      if (pd[pd_idx].p) {
+        pd[pd_idx] = pde;
+      }
+    }
+  }
+
+  // Invalidating any address in the hugepage invalidates its TLB
+  // entry. This also flushes it for other address spaces, since
+  // kernel hugepages are global.
+  __asm__ volatile("invlpg %0" : : "m"(*(unsigned *)virt));
+}
+
+} // namespace
 
-  // Index in PT (second 10 bits).
-  auto *pt = mem::virt::direct_to_hhdm<PageTableEntry>(pde.addr << PG_SZ_BITS);
-  unsigned pt_idx = ((size_t)virt >> PG_SZ_BITS) & 0x03FF;
-  return &pt[pt_idx];
+void init() {
+  ASSERT(kernel_pd == nullptr);
+  kernel_pd = get_page_directory();
+}
+
+bool enable_pae() {
+  ASSERT(kernel_pd != nullptr && !pae_active);
+  if (!cpuid::has_pae()) {
+    return false;
+  }
+  pae::init(get_page_directory());
+  pae_active = true;
+  return true;
+}
+
+bool pae_enabled() { return pae_active; }
+
+uint64_t max_phys() {
+  // PAE supports up to 52-bit physical addresses, though the CPU may
+  // support fewer. Either way, this is beyond any memory map we'll
+  // see.
+  return pae_active ? uint64_t(1) << 52 : uint64_t(1) << 32;
+}
+
+bool sync_kernel_pde(void *virt) {
+  const unsigned pd_idx = pd_index(virt);
+  if (pae_active || kernel_pd == nullptr || pd_idx < kernel_pd_start) {
+    return false;
+  }
+
+  auto &pde = get_page_directory()[pd_idx];
+  if (pde.p || !kernel_pd[pd_idx].p) {
+    return false;
+  }
+  pde = kernel_pd[pd_idx];
+  return true;
 }
 
 void enumerate_page_table(const PageTableEntry *table,
@@ -130,6 +219,9 @@ void enumerate_page_table(const PageTableEntry *table,
 }
 
 void enumerate_page_tables() {
+  if (pae_active) {
+    return pae::enumerate_page_tables();
+  }
   const auto *table = get_page_directory();
 
   nonstd::printf("virt -> phys\r\n");
@@ -152,28 +244,34 @@ void enumerate_page_tables() {
   }
 }
 
-bool map(uint64_t phys, void *virt, bool u_s, bool r_w, bool uncacheable) {
-  assert(PG_ALIGNED(phys));
-  assert(PG_ALIGNED((size_t)virt));
-
-  // We have to recreate the logic in \ref fetch_pte() since the PDE
-  // may not exist.
-
-  // Index in PD (high 10 bits).
-  auto *pd = get_page_directory();
-  unsigned pd_idx = ((size_t)virt >> PG_SZ_BITS) >> directory_entry_bits;
-  auto &pde = pd[pd_idx];
-  if (pde.p) {
-    // If page directory entry exists, check that it isn't a hugepage
-    // (not supported by HmmOS for userspace mappings).
-    assert(!pde.ps);
+namespace {
+
+/// Returns the page table for \a virt. If the PDE is not present, a
+/// page table is created if \a create, otherwise nullptr is returned
+/// (as it is on OOM). If the PDE is a hugepage, it is split if \a
+/// split, otherwise nullptr is returned; read-only walks shouldn't
+/// split.
+PageTableEntry *fetch_page_table(void *virt, bool create, bool split) {
+  const unsigned pd_idx = pd_index(virt);
+  auto &pde = get_page_directory()[pd_idx];
+  if (pde.p || sync_kernel_pde(virt)) {
+    // Modifying a 4KB page inside a hugepage requires a page table.
+    if (pde.ps) {
+      if (!split) {
+        return nullptr;
+      }
+      split_huge(pde, virt);
+    }
   } else {
-    // Allocate and clear a new page table.
-    auto *page_table = ::operator new(PG_SZ);
+    if (!create) {
+      return nullptr;
+    }
+
+    // Allocate a new (empty) page table.
+    auto *page_table = mem::alloc_zeroed_page();
     if (unlikely(page_table == nullptr)) {
-      return false;
+      return nullptr;
     }
-    nonstd::memset(page_table, 0, PG_SZ);
 
     // Initialize page directory entry.
     nonstd::memset(&pde, 0, sizeof pde);
@@ -190,52 +288,218 @@ bool map(uint64_t phys, void *virt, bool u_s, bool r_w, bool uncacheable) {
     pde.a = 0;
     pde.ps = 0;
     pde.addr = mem::virt::hhdm_to_direct(page_table) >> PG_SZ_BITS;
+
+    // New kernel page tables are shared by all address spaces.
+    if (kernel_pd != nullptr && pd_idx >= kernel_pd_start) {
+      kernel_pd[pd_idx] = pde;
+    }
+  }
+  return mem::virt::direct_to_hhdm<PageTableEntry>(pde.addr << PG_SZ_BITS);
+}
+
+/// Calls \a fcn(pt, first, n, addr) for each page table spanned by
+/// the \a num_pg pages starting at \a virt, where [first, first + n)
+/// are the indices of the pages in the page table, and \a addr is the
+/// virtual address of page \a first. \a pt is nullptr if nothing is
+/// mapped in the page table's 4MB region.
+///
+/// Hugepages in userspace that are entirely covered by the range are
+/// passed to \a huge_fcn(pde, addr) instead; those that are partly
+/// covered are split.
+template <typename Fcn, typename HugeFcn>
+void for_each_page_table(void *virt, size_t num_pg, Fcn &&fcn,
+                         HugeFcn &&huge_fcn) {
+  size_t addr = (size_t)virt;
+  for (size_t i = 0; i < num_pg;) {
+    const unsigned first = (addr >> PG_SZ_BITS) % page_table_entries;
+    const unsigned n =
+        std::min<size_t>(num_pg - i, page_table_entries - first);
+    auto &pde = get_page_directory()[pd_index((void *)addr)];
+    if (pde.p && pde.ps && n == page_table_entries &&
+        pd_index((void *)addr) < kernel_pd_start) {
+      huge_fcn(pde, addr);
+    } else {
+      fcn(fetch_page_table((void *)addr, /*create=*/false, /*split=*/true),
+          first, n, addr);
+    }
+    i += n;
+    addr += n << PG_SZ_BITS;
+  }
+}
+
+} // namespace
+
+/// Helper function which performs the page table walk.
+///
+/// \return nullptr if the PDE is not present or is a hugepage. The
+/// PTE entry will be returned as long as the PDE is a present page
+/// table, even if the PTE is itself not present.
+///
+PageTableEntry *fetch_pte(void *virt, bool split = false) {
+  assert(PG_ALIGNED((size_t)virt));
+  auto *pt = fetch_page_table(virt, /*create=*/false, split);
+  if (pt == nullptr) {
+    return nullptr;
+  }
+  return &pt[((size_t)virt >> PG_SZ_BITS) % page_table_entries];
+}
+
+void FlushBatch::flush() {
+  if (num_pages > pages.size()) {
+    set_page_directory(get_page_directory());
+  } else {
+    for (size_t i = 0; i < num_pages; ++i) {
+      __asm__ volatile("invlpg %0" : : "m"(*(unsigned *)pages[i]));
+    }
   }
+  num_pages = 0;
+}
 
-  // Index in PT (second 10 bits).
-  auto *pt = mem::virt::direct_to_hhdm<PageTableEntry>(pde.addr << PG_SZ_BITS);
-  unsigned pt_idx = ((size_t)virt >> PG_SZ_BITS) & 0x03FF;
-  auto &pte = pt[pt_idx];
+bool map(uint64_t phys, void *virt, bool u_s, bool r_w, bool uncacheable,
+         bool executable) {
+  return map_range(phys, virt, 1, u_s, r_w, uncacheable, executable);
+}
 
-  // We don't support overwriting a page table entry at the
-  // moment. This can be added in the future with an appropriate
-  // change to the interface. For now we assume as a precondition that
-  // if the page is possibly mapped, the caller unmaps the page first.
-  assert(!pte.p);
+bool unmap(void *virt) {
+  FlushBatch batch;
+  return unmap_range(virt, 1, batch) != 0;
+}
+
+bool map_range(uint64_t phys, void *virt, size_t num_pg, bool u_s, bool r_w,
+               bool uncacheable, bool executable) {
+  if (pae_active) {
+    return pae::map_range(phys, virt, num_pg, u_s, r_w, uncacheable,
+                          executable);
+  }
+  assert(PG_ALIGNED(phys));
+  assert(PG_ALIGNED((size_t)virt));
+  // Addresses are 20-bit page numbers.
+  assert(phys + (uint64_t(num_pg) << PG_SZ_BITS) <= max_phys());
 
+  PageTableEntry pte;
   nonstd::memset(&pte, 0, sizeof pte);
   pte.p = 1;
   pte.r_w = r_w;
   pte.u_s = u_s;
-  pte.pwt = 0;
   pte.pcd = uncacheable;
-  pte.a = 0;
-  pte.d = 0;
-  pte.pat = 0;
-  // Assume this is kernel memory and should be mapped globally.
-  pte.g = 1;
+  // Kernel memory is mapped globally. (Userspace mappings change on
+  // context switch, so they can't be global.)
+  pte.g = !u_s;
   pte.addr = phys >> PG_SZ_BITS;
 
-  // I don't think we need to invlpg here since we do it when
-  // unmapping pages.
+  size_t addr = (size_t)virt;
+  for (size_t i = 0; i < num_pg;) {
+    auto *pt =
+        fetch_page_table((void *)addr, /*create=*/true, /*split=*/true);
+    if (unlikely(pt == nullptr)) {
+      return false;
+    }
+    const unsigned first = (addr >> PG_SZ_BITS) % page_table_entries;
+    const unsigned n =
+        std::min<size_t>(num_pg - i, page_table_entries - first);
+    for (unsigned j = first; j < first + n; ++j) {
+      // We don't support overwriting a page table entry at the
+      // moment. For now we assume as a precondition that if the page
+      // is possibly mapped, the caller unmaps the page first.
+      assert(!pt[j].p);
+      pt[j] = pte;
+      ++pte.addr;
+    }
+    i += n;
+    addr += n << PG_SZ_BITS;
+  }
+  // No invlpg is needed, since non-present entries aren't cached.
   return true;
 }
 
-bool unmap(void *virt) {
-  auto *pte = fetch_pte(virt);
-  if (pte == nullptr || !pte->p) {
-    return false;
+size_t unmap_range(void *virt, size_t num_pg, FlushBatch &batch,
+                   const std::function<void(uint64_t)> &on_unmap) {
+  if (pae_active) {
+    return pae::unmap_range(virt, num_pg, batch, on_unmap);
   }
-  pte->p = 0;
-  // TODO: we may not always need the invalpg here, e.g., if we are
-  // switching out the entire virtual mapping by writing CR3 when
-  // context switching. For now always invalpg for simplicity.
-  __asm__ volatile("invlpg %0" : : "m"(*(unsigned *)virt));
-  return true;
+  assert(PG_ALIGNED((size_t)virt));
+
+  size_t unmapped = 0;
+  for_each_page_table(
+      virt, num_pg,
+      [&](PageTableEntry *pt, unsigned first, unsigned n, size_t addr) {
+        if (pt == nullptr) {
+          return;
+        }
+        for (unsigned j = first; j < first + n; ++j) {
+          if (!pt[j].p) {
+            continue;
+          }
+          pt[j].p = 0;
+          batch.add((void *)(addr + ((j - first) << PG_SZ_BITS)));
+          if (on_unmap) {
+            on_unmap((uint64_t)pt[j].addr << PG_SZ_BITS);
+          }
+          ++unmapped;
+        }
+      },
+      [&](PageDirectoryEntry &pde, size_t addr) {
+        const auto huge = std::bit_cast<PageDirectoryHugepageEntry>(pde);
+        nonstd::memset(&pde, 0, sizeof pde);
+        // Invalidating any address in the hugepage invalidates its TLB
+        // entry.
+        batch.add((void *)addr);
+        if (on_unmap) {
+          for (unsigned j = 0; j < page_table_entries; ++j) {
+            on_unmap((uint64_t)huge.addr * HUGE_PG_SZ + (j << PG_SZ_BITS));
+          }
+        }
+        unmapped += page_table_entries;
+      });
+  return unmapped;
+}
+
+size_t protect_range(void *virt, size_t num_pg, bool r_w,
+                     FlushBatch &batch) {
+  if (pae_active) {
+    return pae::protect_range(virt, num_pg, r_w, batch);
+  }
+  assert(PG_ALIGNED((size_t)virt));
+
+  size_t present = 0;
+  for_each_page_table(
+      virt, num_pg,
+      [&](PageTableEntry *pt, unsigned first, unsigned n, size_t addr) {
+        if (pt == nullptr) {
+          return;
+        }
+        for (unsigned j = first; j < first + n; ++j) {
+          if (!pt[j].p) {
+            continue;
+          }
+          ++present;
+          if (pt[j].r_w != r_w) {
+            pt[j].r_w = r_w;
+            batch.add((void *)(addr + ((j - first) << PG_SZ_BITS)));
+          }
+        }
+      },
+      [&](PageDirectoryEntry &pde, size_t addr) {
+        if (pde.r_w != r_w) {
+          pde.r_w = r_w;
+          batch.add((void *)addr);
+        }
+        present += page_table_entries;
+      });
+  return present;
 }
 
 bool mark_uncacheable(void *virt) {
-  auto *pte = fetch_pte(virt);
+  if (pae_active) {
+    return pae::mark_uncacheable(virt);
+  }
+  // Hugepages that are already uncacheable (e.g., from \ref
+  // mem::virt::ioremap()) don't need to be split.
+  if (const auto &pde = get_page_directory()[pd_index(virt)];
+      pde.p && pde.ps && pde.pcd) {
+    return true;
+  }
+  auto *pte = fetch_pte(virt, /*split=*/true);
   if (pte == nullptr || !pte->p) {
     return false;
   }
@@ -244,36 +508,184 @@ bool mark_uncacheable(void *virt) {
   return true;
 }
 
-PageDirectoryEntry *clone_kernel_page_directory(PageDirectoryEntry *orig) {
-  const PageDirectoryEntry *pd = get_page_directory();
+bool map_huge(uint64_t phys, void *virt, bool u_s, bool r_w,
+              bool uncacheable, bool executable) {
+  if (pae_active) {
+    return pae::map_huge(phys, virt, u_s, r_w, uncacheable, executable);
+  }
+  assert(HUGEPG_ALIGNED(phys));
+  assert(HUGEPG_ALIGNED((size_t)virt));
+  const unsigned pd_idx = pd_index(virt);
+  auto &pde = get_page_directory()[pd_idx];
+  if (pde.p || sync_kernel_pde(virt)) {
+    return false;
+  }
+
+  // Hugepage addresses are 10 bits; memory above 4GB (PSE-36) is not
+  // supported.
+  if (phys >> 32) {
+    return false;
+  }
+
+  PageDirectoryHugepageEntry huge;
+  nonstd::memset(&huge, 0, sizeof huge);
+  huge.p = 1;
+  huge.r_w = r_w;
+  huge.u_s = u_s;
+  huge.pcd = uncacheable;
+  huge.ps = 1;
+  huge.g = !u_s;
+  huge.addr = phys / HUGE_PG_SZ;
+  pde = std::bit_cast<PageDirectoryEntry>(huge);
+
+  if (kernel_pd != nullptr && pd_idx >= kernel_pd_start) {
+    kernel_pd[pd_idx] = pde;
+  }
+  return true;
+}
+
+bool pde_empty(void *virt) {
+  if (pae_active) {
+    return pae::pde_empty(virt);
+  }
+  return !get_page_directory()[pd_index(virt)].p &&
+         (kernel_pd == nullptr || pd_index(virt) < kernel_pd_start ||
+          !kernel_pd[pd_index(virt)].p);
+}
+
+std::optional<uint64_t> get_phys(void *virt) {
+  if (pae_active) {
+    return pae::get_phys(virt);
+  }
+  const auto &pde = get_page_directory()[pd_index(virt)];
+  if (pde.p && pde.ps) {
+    const auto huge = std::bit_cast<PageDirectoryHugepageEntry>(pde);
+    return (uint64_t)huge.addr * HUGE_PG_SZ + ((size_t)virt % HUGE_PG_SZ);
+  }
+
+  auto *pte = fetch_pte(virt);
+  if (pte == nullptr || !pte->p) {
+    return std::nullopt;
+  }
+  return (uint64_t)pte->addr << PG_SZ_BITS;
+}
+
+bool set_writable(void *virt) {
+  FlushBatch batch;
+  return protect_range(virt, 1, /*r_w=*/true, batch) != 0;
+}
+
+void enable_write_protect() {
+  size_t cr0;
+  __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 |= 1 << 16;
+  __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+}
+
+PageDirectoryEntry *clone_kernel_page_directory() {
+  if (pae_active) {
+    return pae::clone_kernel_page_directory();
+  }
+  ASSERT(kernel_pd != nullptr);
   PageDirectoryEntry *new_pd =
-      reinterpret_cast<PageDirectoryEntry *>(::operator new(PG_SZ));
-  nonstd::memset(new_pd, 0, PG_SZ);
+      reinterpret_cast<PageDirectoryEntry *>(mem::alloc_zeroed_page());
+  ASSERT(new_pd != nullptr);
+
+  // The kernel page tables (and hugepages) are shared, so only the
+  // PDEs need to be copied.
+  nonstd::memcpy(new_pd + kernel_pd_start, kernel_pd + kernel_pd_start,
+                 (directory_table_entries - kernel_pd_start) *
+                     sizeof(PageDirectoryEntry));
+  page_directories.push_back(new_pd);
+  return new_pd;
+}
 
-  static_assert(
-      util::algorithm::aligned_pow2<HUGE_PG_SZ>(mem::virt::hhdm_start));
-  for (unsigned i = mem::virt::hhdm_start / HUGE_PG_SZ;
-       i < directory_table_entries; ++i) {
+PageDirectoryEntry *fork_page_directory() {
+  if (pae_active) {
+    return pae::fork_page_directory();
+  }
+  PageDirectoryEntry *pd = get_page_directory();
+  PageDirectoryEntry *new_pd = clone_kernel_page_directory();
+  auto &pft = mem::phys::get_pft();
+
+  for (unsigned i = 0; i < kernel_pd_start; ++i) {
     if (!pd[i].p) {
       continue;
     }
 
+    // Hugepages are split, so that each 4KB page can be copied on
+    // write separately.
     if (pd[i].ps) {
-      new_pd[i] = pd[i];
-    } else {
-      PageTableEntry *page_table =
-          reinterpret_cast<PageTableEntry *>(::operator new(PG_SZ));
-      nonstd::memcpy(page_table,
-                     mem::virt::direct_to_hhdm(pd[i].addr << PG_SZ_BITS),
-                     PG_SZ);
-      new_pd[i] = pd[i];
-      new_pd[i].addr = mem::virt::hhdm_to_direct(page_table) >> PG_SZ_BITS;
+      split_huge(pd[i], (void *)(i * HUGE_PG_SZ));
+    }
+
+    auto *pt = mem::virt::direct_to_hhdm<PageTableEntry>(pd[i].addr
+                                                         << PG_SZ_BITS);
+    auto *new_pt = reinterpret_cast<PageTableEntry *>(::operator new(PG_SZ));
+    ASSERT(new_pt != nullptr);
+    for (unsigned j = 0; j < page_table_entries; ++j) {
+      if (pt[j].p) {
+        pt[j].r_w = 0;
+        pft.get_pfd((uint64_t)pt[j].addr << PG_SZ_BITS).inc_refcount();
+      }
     }
+    nonstd::memcpy(new_pt, pt, PG_SZ);
+    new_pd[i] = pd[i];
+    new_pd[i].addr = mem::virt::hhdm_to_direct(new_pt) >> PG_SZ_BITS;
   }
 
+  // Flush the TLB, since we write-protected the current mappings.
+  // Userspace mappings aren't global, so reloading CR3 is sufficient.
+  set_page_directory(pd);
   return new_pd;
 }
 
+void destroy_page_directory(PageDirectoryEntry *pd,
+                            const std::function<void(uint64_t)> &on_unmap) {
+  if (pae_active) {
+    return pae::destroy_page_directory(pd, on_unmap);
+  }
+  ASSERT(kernel_pd != nullptr && pd != kernel_pd);
+  if (pd == get_page_directory()) {
+    set_page_directory(kernel_pd);
+  }
+
+  // The kernel page tables are shared, so only the userspace half is
+  // freed.
+  for (unsigned i = 0; i < kernel_pd_start; ++i) {
+    if (!pd[i].p) {
+      continue;
+    }
+
+    if (pd[i].ps) {
+      const auto huge = std::bit_cast<PageDirectoryHugepageEntry>(pd[i]);
+      const uint64_t base = (uint64_t)huge.addr * HUGE_PG_SZ;
+      for (unsigned j = 0; on_unmap && j < page_table_entries; ++j) {
+        on_unmap(base + j * PG_SZ);
+      }
+      continue;
+    }
+
+    const uint64_t pt_frame = (uint64_t)pd[i].addr << PG_SZ_BITS;
+    auto *pt = mem::virt::direct_to_hhdm<PageTableEntry>(pt_frame);
+    for (unsigned j = 0; on_unmap && j < page_table_entries; ++j) {
+      if (pt[j].p) {
+        on_unmap((uint64_t)pt[j].addr << PG_SZ_BITS);
+      }
+    }
+    mem::free_frames(pt_frame, 1);
+  }
+
+  for (auto &it : page_directories) {
+    if (it == pd) {
+      it = page_directories.back();
+      page_directories.pop_back();
+      break;
+    }
+  }
+  mem::free_frames(mem::virt::hhdm_to_direct(pd), 1);
+}
+
 void set_page_directory(PageDirectoryEntry *pde) {
   size_t table_phys = mem::virt::hhdm_to_direct(pde);
   __asm__("movl %0, %%cr3" ::"r"(table_phys));
@@ -3,24 +3,191 @@
 /// \file arch/x86/page_table.h
 /// \brief x86 page table implementation
 ///
+/// There are two backends: 32-bit paging (two levels of 4-byte
+/// entries, 4MB hugepages), which the bootloader sets up, and PAE
+/// paging (three levels of 8-byte entries, 2MB large pages, the NX
+/// bit and physical addresses above 4GB). The kernel switches to PAE
+/// paging on boot if it is useful; see \ref enable_pae(). The
+/// interface is the same for both: in particular, hugepages are
+/// always 4MB (a pair of 2MB pages with PAE), and the page table
+/// hierarchy is an opaque \ref PageDirectoryEntry pointer (which is
+/// the PDPT with PAE).
+///
 /// \see mm/virt.h for full documentation
 
+#include "util/objutil.h"
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <optional>
 
 namespace arch::page_table {
 
 struct PageDirectoryEntry;
 
+/// \brief A batch of deferred TLB invalidations.
+///
+/// Range operations that remove or change existing mappings record
+/// the affected pages here instead of invalidating each one as they
+/// go. \ref flush() (or the destructor) then invalidates them with
+/// one `invlpg` each, or, if there are more than \ref max_invlpg of
+/// them, flushes the whole TLB by reloading CR3. (That includes
+/// kernel mappings: the G bit is ignored, since CR4.PGE isn't set.)
+///
+class FlushBatch {
+public:
+  /// Past this many pages, reloading CR3 (and refilling the TLB) is
+  /// assumed to be cheaper than invalidating each page.
+  static constexpr size_t max_invlpg = 32;
+
+  FlushBatch() = default;
+  ~FlushBatch() { flush(); }
+  NON_COPYABLE(FlushBatch);
+
+  void add(void *virt) {
+    if (num_pages < pages.size()) {
+      pages[num_pages] = virt;
+    }
+    ++num_pages;
+  }
+
+  /// Perform the pending invalidations.
+  void flush();
+
+private:
+  std::array<void *, max_invlpg> pages;
+  size_t num_pages = 0;
+};
+
+/// Record the current page directory as the reference kernel page
+/// directory. Must be called once on boot before any processes are
+/// created.
+///
+/// The kernel half of the address space is shared between all page
+/// directories: they point to the same kernel page tables, so changes
+/// to existing kernel page tables are visible everywhere. Kernel page
+/// tables created later (e.g., by \ref map() in the IO map) are added
+/// to the reference page directory, and are copied into other page
+/// directories lazily by \ref sync_kernel_pde().
+void init();
+
+/// Switch from 32-bit paging to PAE paging. The current mappings are
+/// preserved. This also enables the NX bit if it is supported.
+///
+/// Must be called after \ref init(), once page tables can be
+/// allocated, and before any processes are created.
+///
+/// \return false if the CPU doesn't support PAE.
+bool enable_pae();
+
+/// Returns true if PAE paging is in use.
+bool pae_enabled();
+
+/// Returns the end of the physical address range that can be mapped
+/// by the current backend.
+uint64_t max_phys();
+
+/// Copy the reference kernel PDE for \a virt into the current page
+/// directory, if it is missing there. Called from the page fault
+/// handler.
+///
+/// \return true if the PDE was copied, i.e., if the fault should be
+/// retried.
+///
+/// With PAE, all address spaces share the kernel page directory, so
+/// this is a no-op.
+bool sync_kernel_pde(void *virt);
+
 void enumerate_page_tables();
-bool map(uint64_t phys, void *virt, bool u_s, bool r_w, bool uncacheable);
+
+/// \a executable is only meaningful if the NX bit is enabled (see
+/// \ref enable_pae()); otherwise all mappings are executable.
+bool map(uint64_t phys, void *virt, bool u_s, bool r_w, bool uncacheable,
+         bool executable = true);
 bool unmap(void *virt);
+
+/// \name Range operations
+///
+/// These walk the page directory once per page table (4MB, or 2MB with
+/// PAE) and update the PTEs in between in a tight loop. Hugepages that
+/// are only partly covered by the range are split; userspace hugepages
+/// that are entirely covered are updated in place.
+///
+/// @{
+
+/// Map the \a num_pg pages starting at \a virt to the contiguous
+/// frames starting at \a phys. None of the pages may be mapped
+/// already. Creating mappings requires no TLB invalidation.
+///
+/// \return false on OOM (when allocating page tables). Some of the
+/// pages may have been mapped.
+bool map_range(uint64_t phys, void *virt, size_t num_pg, bool u_s, bool r_w,
+               bool uncacheable, bool executable = true);
+
+/// Unmap any mapped pages among the \a num_pg pages starting at \a
+/// virt. \a on_unmap (if set) is called with the frame of each
+/// unmapped page. Note that the old mappings may remain in the TLB
+/// until \a batch is flushed.
+///
+/// \return the number of pages unmapped.
+size_t unmap_range(void *virt, size_t num_pg, FlushBatch &batch,
+                   const std::function<void(uint64_t)> &on_unmap = {});
+
+/// Set the writable bit of any mapped pages among the \a num_pg pages
+/// starting at \a virt.
+///
+/// \return the number of mapped pages.
+size_t protect_range(void *virt, size_t num_pg, bool r_w, FlushBatch &batch);
+
+/// @}
+
+/// Map the 4MB page \a virt to the 4MB-aligned physical frame \a
+/// phys. Fails if anything is already mapped in the 4MB region (i.e.,
+/// the PDE is present).
+bool map_huge(uint64_t phys, void *virt, bool u_s, bool r_w,
+              bool uncacheable, bool executable = true);
+
+/// Returns true if nothing is mapped in the 4MB region containing \a
+/// virt, i.e., if \ref map_huge() may be used.
+bool pde_empty(void *virt);
 bool mark_uncacheable(void *virt);
 
+/// Returns the physical address of the page mapped at \a virt, or
+/// nullopt if it is not mapped.
+std::optional<uint64_t> get_phys(void *virt);
+
+/// Make an existing mapping writable.
+bool set_writable(void *virt);
+
+/// Enable CR0.WP, so that supervisor-mode writes respect read-only
+/// pages. This is required for copy-on-write, since the kernel also
+/// writes to userspace pages (e.g., in read()).
+void enable_write_protect();
+
 /// Returns the page table hierarchy.
 PageDirectoryEntry *get_page_directory();
 
-/// Copies the page table hierarchy.
-PageDirectoryEntry *clone_kernel_page_directory(PageDirectoryEntry *orig);
+/// Creates a page directory with only the (shared) kernel mappings.
+PageDirectoryEntry *clone_kernel_page_directory();
+
+/// Copies the current page table hierarchy for fork(). The kernel
+/// mappings are shared as in \ref clone_kernel_page_directory(). The
+/// userspace page tables are copied, and every userspace page is
+/// shared between the two copies: it is marked read-only in both
+/// (including the current hierarchy) and its PFD refcount is
+/// incremented. Write faults then copy or re-enable writes as
+/// appropriate for the mapping.
+PageDirectoryEntry *fork_page_directory();
+
+/// Frees the page table hierarchy \a pd, created by \ref
+/// clone_kernel_page_directory() or \ref fork_page_directory(), along
+/// with its userspace page tables. \a on_unmap is called with the
+/// frame of each userspace page that is still mapped. If \a pd is the
+/// current hierarchy, this first switches to the reference kernel page
+/// directory, which also flushes the userspace mappings from the TLB.
+void destroy_page_directory(PageDirectoryEntry *pd,
+                            const std::function<void(uint64_t)> &on_unmap);
 
 /// Switch to a new virtual address space.
 void set_page_directory(PageDirectoryEntry *pde);
@@ -0,0 +1,567 @@
+#include "page_table_pae.h"
+#include "cpuid.h"
+#include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/page_frame_table.h"
+#include "mm/virt.h"
+#include "mm/zero_pool.h"
+#include "msr.h"
+#include "nonstd/libc.h"
+#include "perf.h"
+#include "util/algorithm.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+
+namespace arch::page_table::pae {
+
+namespace {
+
+/// PAE paging structure entry. The same layout is used at all three
+/// levels, with a few differences:
+///
+/// - In a PDPTE, only \a p, \a pwt, \a pcd and \a addr may be set;
+///   the other bits are reserved.
+/// - In a PDE, \a ps selects a 2MB page. The PAT bit of a 2MB page is
+///   bit 12, i.e., the low bit of \a addr; we never set it.
+/// - In a PTE, \a ps is the PAT bit.
+///
+/// \a xd is reserved unless EFER.NXE is set (see \ref nx_enabled()).
+///
+struct Entry {
+  bool p : 1;
+  bool r_w : 1;
+  bool u_s : 1;
+  bool pwt : 1;
+  bool pcd : 1;
+  bool a : 1;
+  bool d : 1;
+  bool ps : 1;
+  bool g : 1;
+  uint8_t ign0 : 3;
+  uint64_t addr : 40;
+  uint16_t ign1 : 11;
+  bool xd : 1;
+} __attribute__((packed));
+static_assert(sizeof(Entry) == 8, "wrong Entry size");
+
+// The virtual address mapping comes from:
+// - 2 bits PDPT index, 9 bits PDE index, 9 bits PTE index, 12 bits
+//   page offset for regular pages
+// - 2 bits PDPT index, 9 bits PDE index, 21 bits page offset for 2MB
+//   pages
+constexpr unsigned pdpt_entries = 4;
+constexpr unsigned table_entries = PG_SZ / sizeof(Entry); // == 512
+constexpr unsigned table_bits = 9;
+constexpr size_t large_pg_sz = PG_SZ << table_bits; // == 2MB
+static_assert(1 << table_bits == table_entries);
+static_assert(HUGE_PG_SZ == 2 * large_pg_sz);
+
+/// The whole kernel half of the address space is covered by the last
+/// PDPTE, so all address spaces share its page directory.
+constexpr unsigned kernel_pdpt_idx = mem::virt::hhdm_start >> 30;
+static_assert(kernel_pdpt_idx == pdpt_entries - 1);
+
+/// The shared kernel page directory.
+Entry *kernel_pd = nullptr;
+
+/// The PDPT created by \ref init(). This is the PAE counterpart of
+/// the reference kernel page directory.
+Entry *kernel_pdpt = nullptr;
+
+/// \see nx_enabled()
+bool nx = false;
+
+unsigned pdpt_index(void *virt) { return (size_t)virt >> 30; }
+unsigned pd_index(void *virt) {
+  return ((size_t)virt >> (PG_SZ_BITS + table_bits)) % table_entries;
+}
+unsigned pt_index(void *virt) {
+  return ((size_t)virt >> PG_SZ_BITS) % table_entries;
+}
+
+/// Returns the table that \a entry points to.
+Entry *table(const Entry &entry) {
+  return mem::virt::direct_to_hhdm<Entry>((uint64_t)entry.addr
+                                          << PG_SZ_BITS);
+}
+
+/// Allocate a zeroed page table (or PD or PDPT).
+Entry *new_table() {
+  return reinterpret_cast<Entry *>(mem::alloc_zeroed_page());
+}
+
+/// Returns an entry pointing to the table \a table. As in the 32-bit
+/// backend, permissions are controlled at the lowest level.
+Entry table_entry(Entry *table, bool pdpte = false) {
+  Entry entry;
+  nonstd::memset(&entry, 0, sizeof entry);
+  entry.p = 1;
+  entry.r_w = !pdpte;
+  entry.u_s = !pdpte;
+  entry.addr = mem::virt::hhdm_to_direct(table) >> PG_SZ_BITS;
+  return entry;
+}
+
+/// Returns a leaf entry mapping \a phys.
+Entry page_entry(uint64_t phys, bool u_s, bool r_w, bool uncacheable,
+                 bool executable) {
+  Entry entry;
+  nonstd::memset(&entry, 0, sizeof entry);
+  entry.p = 1;
+  entry.r_w = r_w;
+  entry.u_s = u_s;
+  entry.pcd = uncacheable;
+  // Kernel memory is mapped globally. (Userspace mappings change on
+  // context switch, so they can't be global.)
+  entry.g = !u_s;
+  entry.addr = phys >> PG_SZ_BITS;
+  entry.xd = nx && !executable;
+  return entry;
+}
+
+Entry *get_pdpt() { return reinterpret_cast<Entry *>(get_page_directory()); }
+
+/// Returns the PDE for \a virt. Every PDPTE is always present, so
+/// this always exists.
+Entry &fetch_pde(void *virt) {
+  return table(get_pdpt()[pdpt_index(virt)])[pd_index(virt)];
+}
+
+/// Replace the 2MB page \a pde (which maps \a virt) with a page table
+/// mapping the same frames with the same attributes. The kernel page
+/// directory is shared, so kernel large pages are split in every
+/// address space.
+void split_large(Entry &pde, void *virt) {
+  DEBUG_ASSERT(pde.p && pde.ps);
+  auto *pt = reinterpret_cast<Entry *>(::operator new(PG_SZ));
+  ASSERT(pt != nullptr);
+  for (unsigned i = 0; i < table_entries; ++i) {
+    pt[i] = pde;
+    pt[i].ps = 0;
+    pt[i].addr = pde.addr + i;
+  }
+  pde = table_entry(pt);
+
+  // Invalidating any address in the large page invalidates its TLB
+  // entry.
+  __asm__ volatile("invlpg %0" : : "m"(*(unsigned *)virt));
+}
+
+/// Returns the page table for \a virt. If the PDE is not present, a
+/// page table is created if \a create, otherwise nullptr is returned
+/// (as it is on OOM). If the PDE is a large page, it is split if \a
+/// split, otherwise nullptr is returned; read-only walks shouldn't
+/// split.
+Entry *fetch_page_table(void *virt, bool create, bool split) {
+  auto &pde = fetch_pde(virt);
+  if (pde.p) {
+    // Modifying a 4KB page inside a large page requires a page table.
+    if (pde.ps) {
+      if (!split) {
+        return nullptr;
+      }
+      split_large(pde, virt);
+    }
+  } else {
+    if (!create) {
+      return nullptr;
+    }
+    auto *pt = new_table();
+    if (unlikely(pt == nullptr)) {
+      return nullptr;
+    }
+    pde = table_entry(pt);
+  }
+  return table(pde);
+}
+
+/// Helper function which performs the page table walk.
+///
+/// \return nullptr if the PDE is not present or is a large page. The
+/// PTE entry will be returned as long as the PDE is a present page
+/// table, even if the PTE is itself not present.
+///
+Entry *fetch_pte(void *virt, bool split = false) {
+  assert(PG_ALIGNED((size_t)virt));
+  auto *pt = fetch_page_table(virt, /*create=*/false, split);
+  return pt == nullptr ? nullptr : &pt[pt_index(virt)];
+}
+
+/// Like the 32-bit backend's for_each_page_table(), except that page
+/// tables span 2MB.
+template <typename Fcn, typename LargeFcn>
+void for_each_page_table(void *virt, size_t num_pg, Fcn &&fcn,
+                         LargeFcn &&large_fcn) {
+  size_t addr = (size_t)virt;
+  for (size_t i = 0; i < num_pg;) {
+    const unsigned first = pt_index((void *)addr);
+    const unsigned n = std::min<size_t>(num_pg - i, table_entries - first);
+    auto &pde = fetch_pde((void *)addr);
+    if (pde.p && pde.ps && n == table_entries &&
+        pdpt_index((void *)addr) < kernel_pdpt_idx) {
+      large_fcn(pde, addr);
+    } else {
+      fcn(fetch_page_table((void *)addr, /*create=*/false, /*split=*/true),
+          first, n, addr);
+    }
+    i += n;
+    addr += n << PG_SZ_BITS;
+  }
+}
+
+} // namespace
+
+void init(const PageDirectoryEntry *pd) {
+  // Convert the 32-bit page table hierarchy, entry by entry. The low 9
+  // flag bits (P through G, including PS and the PTE PAT bit) have
+  // the same layout in both formats.
+  constexpr uint32_t flags_mask = 0x1FF;
+  constexpr uint32_t addr_mask = ~(PG_SZ - 1);
+  constexpr uint32_t huge_addr_mask = ~(HUGE_PG_SZ - 1);
+  constexpr uint32_t present = 1 << 0;
+  constexpr uint32_t huge = 1 << 7;
+  const auto *old_pd = reinterpret_cast<const uint32_t *>(pd);
+  const auto convert = [&](uint32_t old, uint64_t phys) {
+    return std::bit_cast<Entry>(phys | (old & flags_mask));
+  };
+
+  auto *root = new_table();
+  ASSERT(root != nullptr);
+  for (unsigned i = 0; i < pdpt_entries; ++i) {
+    auto *new_pd = new_table();
+    ASSERT(new_pd != nullptr);
+    root[i] = table_entry(new_pd, /*pdpte=*/true);
+  }
+
+  constexpr unsigned old_entries = PG_SZ / sizeof(uint32_t);
+  for (unsigned i = 0; i < old_entries; ++i) {
+    const uint32_t old_pde = old_pd[i];
+    if (!(old_pde & present)) {
+      continue;
+    }
+
+    // Each 4MB region corresponds to two 2MB PDEs.
+    const unsigned pds_per_pdpte = old_entries / pdpt_entries;
+    Entry *new_pdes = &table(root[i / pds_per_pdpte])[i % pds_per_pdpte * 2];
+    for (unsigned k = 0; k < 2; ++k) {
+      if (old_pde & huge) {
+        new_pdes[k] =
+            convert(old_pde, (old_pde & huge_addr_mask) + k * large_pg_sz);
+        continue;
+      }
+
+      const auto *old_pt =
+          mem::virt::direct_to_hhdm<const uint32_t>(old_pde & addr_mask) +
+          k * table_entries;
+      auto *pt = new_table();
+      ASSERT(pt != nullptr);
+      for (unsigned j = 0; j < table_entries; ++j) {
+        if (old_pt[j] & present) {
+          pt[j] = convert(old_pt[j], old_pt[j] & addr_mask);
+        }
+      }
+      new_pdes[k] = table_entry(pt);
+    }
+  }
+  kernel_pd = table(root[kernel_pdpt_idx]);
+  kernel_pdpt = root;
+
+  // Paging can't be disabled here, since the kernel doesn't run
+  // identity-mapped. Instead, \a root is first loaded as a 32-bit page
+  // directory, and then CR4.PAE is set, which loads the PDPTEs from
+  // CR3. Until then, its first 32 bytes (the PDPTEs) map garbage at
+  // 0-32MB, which isn't touched here, and the rest mirror the current
+  // page directory.
+  constexpr unsigned pdpt_words = pdpt_entries * sizeof(Entry) / 4;
+  nonstd::memcpy(reinterpret_cast<uint32_t *>(root) + pdpt_words,
+                 old_pd + pdpt_words,
+                 (old_entries - pdpt_words) * sizeof(uint32_t));
+
+  if (cpuid::has_nx()) {
+    msr::write(msr::ia32_efer, msr::read(msr::ia32_efer) | 1 << 11);
+    nx = true;
+  }
+
+  set_page_directory(reinterpret_cast<PageDirectoryEntry *>(root));
+  size_t cr4;
+  __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+  cr4 |= 1 << 5;
+  __asm__ volatile("mov %0, %%cr4" : : "r"(cr4) : "memory");
+}
+
+bool nx_enabled() { return nx; }
+
+void enumerate_page_tables() {
+  const auto *pdpt = get_pdpt();
+
+  nonstd::printf("virt -> phys (PAE)\r\n");
+  for (unsigned i = 0; i < pdpt_entries; ++i) {
+    const auto *pd = table(pdpt[i]);
+    for (unsigned j = 0; j < table_entries; ++j) {
+      if (!pd[j].p) {
+        continue;
+      }
+
+      const uint32_t pd_virt = (i << 30) + j * large_pg_sz;
+      if (pd[j].ps) {
+        nonstd::printf("0x%x -> 0x%llx (large)\r\n", pd_virt,
+                       (uint64_t)pd[j].addr << PG_SZ_BITS);
+        continue;
+      }
+      const auto *pt = table(pd[j]);
+      for (unsigned k = 0; k < table_entries; ++k) {
+        if (pt[k].p) {
+          nonstd::printf("0x%x -> 0x%llx%s\r\n", pd_virt + (k << PG_SZ_BITS),
+                         (uint64_t)pt[k].addr << PG_SZ_BITS,
+                         pt[k].xd ? " (nx)" : "");
+        }
+      }
+    }
+  }
+}
+
+bool map_range(uint64_t phys, void *virt, size_t num_pg, bool u_s, bool r_w,
+               bool uncacheable, bool executable) {
+  assert(PG_ALIGNED(phys));
+  assert(PG_ALIGNED((size_t)virt));
+
+  Entry pte = page_entry(phys, u_s, r_w, uncacheable, executable);
+  size_t addr = (size_t)virt;
+  for (size_t i = 0; i < num_pg;) {
+    auto *pt =
+        fetch_page_table((void *)addr, /*create=*/true, /*split=*/true);
+    if (unlikely(pt == nullptr)) {
+      return false;
+    }
+    const unsigned first = pt_index((void *)addr);
+    const unsigned n = std::min<size_t>(num_pg - i, table_entries - first);
+    for (unsigned j = first; j < first + n; ++j) {
+      // As in the 32-bit backend, overwriting a present PTE is not
+      // supported.
+      assert(!pt[j].p);
+      pt[j] = pte;
+      ++pte.addr;
+    }
+    i += n;
+    addr += n << PG_SZ_BITS;
+  }
+  return true;
+}
+
+size_t unmap_range(void *virt, size_t num_pg, FlushBatch &batch,
+                   const std::function<void(uint64_t)> &on_unmap) {
+  assert(PG_ALIGNED((size_t)virt));
+
+  size_t unmapped = 0;
+  for_each_page_table(
+      virt, num_pg,
+      [&](Entry *pt, unsigned first, unsigned n, size_t addr) {
+        if (pt == nullptr) {
+          return;
+        }
+        for (unsigned j = first; j < first + n; ++j) {
+          if (!pt[j].p) {
+            continue;
+          }
+          pt[j].p = 0;
+          batch.add((void *)(addr + ((j - first) << PG_SZ_BITS)));
+          if (on_unmap) {
+            on_unmap((uint64_t)pt[j].addr << PG_SZ_BITS);
+          }
+          ++unmapped;
+        }
+      },
+      [&](Entry &pde, size_t addr) {
+        const uint64_t phys = (uint64_t)pde.addr << PG_SZ_BITS;
+        nonstd::memset(&pde, 0, sizeof pde);
+        batch.add((void *)addr);
+        if (on_unmap) {
+          for (unsigned j = 0; j < table_entries; ++j) {
+            on_unmap(phys + (j << PG_SZ_BITS));
+          }
+        }
+        unmapped += table_entries;
+      });
+  return unmapped;
+}
+
+size_t protect_range(void *virt, size_t num_pg, bool r_w,
+                     FlushBatch &batch) {
+  assert(PG_ALIGNED((size_t)virt));
+
+  size_t present = 0;
+  for_each_page_table(
+      virt, num_pg,
+      [&](Entry *pt, unsigned first, unsigned n, size_t addr) {
+        if (pt == nullptr) {
+          return;
+        }
+        for (unsigned j = first; j < first + n; ++j) {
+          if (!pt[j].p) {
+            continue;
+          }
+          ++present;
+          if (pt[j].r_w != r_w) {
+            pt[j].r_w = r_w;
+            batch.add((void *)(addr + ((j - first) << PG_SZ_BITS)));
+          }
+        }
+      },
+      [&](Entry &pde, size_t addr) {
+        if (pde.r_w != r_w) {
+          pde.r_w = r_w;
+          batch.add((void *)addr);
+        }
+        present += table_entries;
+      });
+  return present;
+}
+
+bool map_huge(uint64_t phys, void *virt, bool u_s, bool r_w,
+              bool uncacheable, bool executable) {
+  assert(HUGEPG_ALIGNED(phys));
+  assert(HUGEPG_ALIGNED((size_t)virt));
+  if (!pde_empty(virt)) {
+    return false;
+  }
+
+  // A 4MB hugepage is a pair of 2MB pages. They are always in the same
+  // page directory.
+  Entry *pdes = &fetch_pde(virt);
+  for (unsigned k = 0; k < 2; ++k) {
+    pdes[k] =
+        page_entry(phys + k * large_pg_sz, u_s, r_w, uncacheable, executable);
+    pdes[k].ps = 1;
+  }
+  return true;
+}
+
+bool pde_empty(void *virt) {
+  const Entry *pdes = &fetch_pde(
+      (void *)util::algorithm::floor_pow2<HUGE_PG_SZ>((size_t)virt));
+  return !pdes[0].p && !pdes[1].p;
+}
+
+bool mark_uncacheable(void *virt) {
+  // Large pages that are already uncacheable (e.g., from \ref
+  // mem::virt::ioremap()) don't need to be split.
+  if (const auto &pde = fetch_pde(virt); pde.p && pde.ps && pde.pcd) {
+    return true;
+  }
+  auto *pte = fetch_pte(virt, /*split=*/true);
+  if (pte == nullptr || !pte->p) {
+    return false;
+  }
+  pte->pcd = 1;
+  __asm__ volatile("invlpg %0" : : "m"(*(unsigned *)virt));
+  return true;
+}
+
+std::optional<uint64_t> get_phys(void *virt) {
+  const auto &pde = fetch_pde(virt);
+  if (pde.p && pde.ps) {
+    return ((uint64_t)pde.addr << PG_SZ_BITS) + ((size_t)virt % large_pg_sz);
+  }
+
+  auto *pte = fetch_pte(virt);
+  if (pte == nullptr || !pte->p) {
+    return std::nullopt;
+  }
+  return (uint64_t)pte->addr << PG_SZ_BITS;
+}
+
+PageDirectoryEntry *clone_kernel_page_directory() {
+  ASSERT(kernel_pd != nullptr);
+
+  // The PDPTEs are loaded into the CPU when CR3 is written, rather
+  // than walked on each TLB miss, so the userspace page directories
+  // are allocated up front. Otherwise adding one to the current PDPT
+  // would require reloading CR3.
+  auto *pdpt = new_table();
+  ASSERT(pdpt != nullptr);
+  for (unsigned i = 0; i < kernel_pdpt_idx; ++i) {
+    auto *pd = new_table();
+    ASSERT(pd != nullptr);
+    pdpt[i] = table_entry(pd, /*pdpte=*/true);
+  }
+  pdpt[kernel_pdpt_idx] = table_entry(kernel_pd, /*pdpte=*/true);
+  return reinterpret_cast<PageDirectoryEntry *>(pdpt);
+}
+
+PageDirectoryEntry *fork_page_directory() {
+  Entry *pdpt = get_pdpt();
+  auto *new_pdpt_opaque = clone_kernel_page_directory();
+  Entry *new_pdpt = reinterpret_cast<Entry *>(new_pdpt_opaque);
+  auto &pft = mem::phys::get_pft();
+
+  for (unsigned i = 0; i < kernel_pdpt_idx; ++i) {
+    Entry *pd = table(pdpt[i]);
+    Entry *new_pd = table(new_pdpt[i]);
+    for (unsigned j = 0; j < table_entries; ++j) {
+      if (!pd[j].p) {
+        continue;
+      }
+
+      // Large pages are split, so that each 4KB page can be copied on
+      // write separately.
+      if (pd[j].ps) {
+        split_large(pd[j], (void *)((i << 30) + j * large_pg_sz));
+      }
+
+      Entry *pt = table(pd[j]);
+      auto *new_pt = reinterpret_cast<Entry *>(::operator new(PG_SZ));
+      ASSERT(new_pt != nullptr);
+      for (unsigned k = 0; k < table_entries; ++k) {
+        if (pt[k].p) {
+          pt[k].r_w = 0;
+          pft.get_pfd((uint64_t)pt[k].addr << PG_SZ_BITS).inc_refcount();
+        }
+      }
+      nonstd::memcpy(new_pt, pt, PG_SZ);
+      new_pd[j] = table_entry(new_pt);
+    }
+  }
+
+  // Flush the TLB, since we write-protected the current mappings.
+  set_page_directory(get_page_directory());
+  return new_pdpt_opaque;
+}
+
+void destroy_page_directory(PageDirectoryEntry *pd_opaque,
+                            const std::function<void(uint64_t)> &on_unmap) {
+  Entry *pdpt = reinterpret_cast<Entry *>(pd_opaque);
+  ASSERT(pdpt != kernel_pdpt && table(pdpt[kernel_pdpt_idx]) == kernel_pd);
+  if (pdpt == get_pdpt()) {
+    set_page_directory(reinterpret_cast<PageDirectoryEntry *>(kernel_pdpt));
+  }
+
+  for (unsigned i = 0; i < kernel_pdpt_idx; ++i) {
+    Entry *pd = table(pdpt[i]);
+    for (unsigned j = 0; j < table_entries; ++j) {
+      if (!pd[j].p) {
+        continue;
+      }
+
+      const uint64_t frame = (uint64_t)pd[j].addr << PG_SZ_BITS;
+      if (pd[j].ps) {
+        for (unsigned k = 0; on_unmap && k < table_entries; ++k) {
+          on_unmap(frame + k * PG_SZ);
+        }
+        continue;
+      }
+
+      Entry *pt = table(pd[j]);
+      for (unsigned k = 0; on_unmap && k < table_entries; ++k) {
+        if (pt[k].p) {
+          on_unmap((uint64_t)pt[k].addr << PG_SZ_BITS);
+        }
+      }
+      mem::free_frames(frame, 1);
+    }
+    mem::free_frames(mem::virt::hhdm_to_direct(pd), 1);
+  }
+  mem::free_frames(mem::virt::hhdm_to_direct(pdpt), 1);
+}
+
+} // namespace arch::page_table::pae
@@ -0,0 +1,42 @@
+#pragma once
+
+/// \file arch/x86/page_table_pae.h
+/// \brief PAE paging backend
+///
+/// This is private to the page table implementation: the functions
+/// in \ref arch/x86/page_table.h dispatch here once \ref
+/// arch::page_table::enable_pae() has been called. They have the same
+/// semantics as their 32-bit paging counterparts.
+
+#include "page_table.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+namespace arch::page_table::pae {
+
+/// Convert the current 32-bit page table hierarchy \a pd to PAE, and
+/// switch to PAE paging.
+void init(const PageDirectoryEntry *pd);
+
+/// Returns true if the NX bit was enabled by \ref init().
+bool nx_enabled();
+
+void enumerate_page_tables();
+bool map_range(uint64_t phys, void *virt, size_t num_pg, bool u_s, bool r_w,
+               bool uncacheable, bool executable);
+size_t unmap_range(void *virt, size_t num_pg, FlushBatch &batch,
+                   const std::function<void(uint64_t)> &on_unmap);
+size_t protect_range(void *virt, size_t num_pg, bool r_w, FlushBatch &batch);
+bool map_huge(uint64_t phys, void *virt, bool u_s, bool r_w,
+              bool uncacheable, bool executable);
+bool pde_empty(void *virt);
+bool mark_uncacheable(void *virt);
+std::optional<uint64_t> get_phys(void *virt);
+PageDirectoryEntry *clone_kernel_page_directory();
+PageDirectoryEntry *fork_page_directory();
+void destroy_page_directory(PageDirectoryEntry *pd,
+                            const std::function<void(uint64_t)> &on_unmap);
+
+} // namespace arch::page_table::pae
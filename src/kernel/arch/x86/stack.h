@@ -3,11 +3,27 @@
 /// \file
 /// \brief Some asm functions to help perform thread switching.
 
+#include <cstdint>
+
 namespace sched {
 struct KernelThread;
 }
 
 namespace arch::sched {
+
+/// Userspace register state to enter userspace with.
+struct UserRegisters {
+  uint32_t eax;
+  uint32_t ebx;
+  uint32_t ecx;
+  uint32_t edx;
+  uint32_t esi;
+  uint32_t edi;
+  uint32_t ebp;
+  uint32_t esp;
+  uint32_t eip;
+};
+
 extern "C" {
 
 /// Switch stacks. This saves the old tasks's state (callee-save
@@ -26,8 +42,8 @@ void switch_stack(void **old_stk, void *new_stk);
 void *setup_stack(void *stk, ::sched::KernelThread *kthread,
                   void (*fcn)(void *), void *data);
 
-/// Bootstrap into userspace mode with the given userspace instruction
-/// pointer and stack pointer.
-__attribute__((noreturn)) void enter_userspace(void *esp3, void *eip3);
+/// Bootstrap into userspace mode with the given userspace register
+/// state. \a regs may live on the kernel stack.
+__attribute__((noreturn)) void enter_userspace(const UserRegisters *regs);
 }
 } // namespace arch::sched
@@ -0,0 +1,95 @@
+#include "sysenter.h"
+#include "cpuid.h"
+#include "gdt.h"
+#include "mm/virt.h"
+#include "msr.h"
+#include "nonstd/libc.h"
+#include "proc/process.h"
+#include "proc/syscalls.h"
+#include "util/assert.h"
+
+extern proc::Process *curr_proc();
+
+extern "C" {
+
+int32_t sysenter_dispatch(proc::SyscallContext *ctx) {
+  // Syscalls should only happen in process context.
+  auto *proc = curr_proc();
+  ASSERT(proc != nullptr);
+
+  // The entry stub doesn't load the return address if ebp isn't a
+  // userspace address, so there's nowhere to return to.
+  if (ctx->esp3 - 4 > mem::virt::hhdm_start - 4) {
+    nonstd::printf("SYSENTER with bad stack pointer 0x%x. Process killed.\r\n",
+                   ctx->esp3 - 4);
+    proc->exit(1);
+  }
+  return proc::do_syscall(*proc, *ctx);
+}
+
+/// SYSENTER entry point. See proc/syscalls.h for the userspace calling
+/// convention.
+///
+/// On entry, cs/ss are the kernel segments, interrupts are disabled,
+/// and esp is IA32_SYSENTER_ESP, which points to the TSS's esp0 field
+/// (i.e., the current thread's kernel stack pointer).
+///
+/// This builds a \ref proc::SyscallContext on the kernel stack. It
+/// only saves the registers the syscall ABI needs; ebx, esi, edi and
+/// ebp are callee-saved by the C handler. SYSEXIT doesn't modify
+/// eflags, so interrupts are still enabled on return. The direction
+/// flag is cleared for the string instructions used by memcpy() and
+/// memset(), and stays clear on return.
+///
+/// The return address is only loaded from the user stack if ebp is a
+/// userspace address; otherwise \ref sysenter_dispatch() kills the
+/// process. An unmapped userspace address page faults like any other
+/// access to user memory.
+__attribute__((naked)) void sysenter_entry() {
+  __asm__ volatile("cld\n\t"
+                   "mov (%esp), %esp\n\t"
+                   "push %ebp\n\t"     // ctx.ebp
+                   "push %ebp\n\t"     // ctx.esp3
+                   "addl $4, (%esp)\n\t" // (pop the return address)
+                   "cmp $0xbffffffc, %ebp\n\t" // (HM_START - 4)
+                   "ja 1f\n\t"
+                   "pushl (%ebp)\n\t"  // ctx.eip3
+                   "jmp 2f\n"
+                   "1:\n\t"
+                   "push $0\n"        // ctx.eip3 (invalid)
+                   "2:\n\t"
+                   "push %edi\n\t"     // ctx.args[4]
+                   "push %esi\n\t"     // ctx.args[3]
+                   "push %edx\n\t"     // ctx.args[2]
+                   "push %ecx\n\t"     // ctx.args[1]
+                   "push %ebx\n\t"     // ctx.args[0]
+                   "push %eax\n\t"     // ctx.nr
+                   "sti\n\t"
+                   "push %esp\n\t"
+                   "call sysenter_dispatch\n\t"
+                   "add $4, %esp\n\t"
+                   "mov 0x18(%esp), %edx\n\t" // ctx.eip3
+                   "mov 0x1c(%esp), %ecx\n\t" // ctx.esp3
+                   "sysexit");
+}
+}
+
+static_assert(HM_START - 4 == 0xbffffffc, "update sysenter_entry()");
+
+namespace arch::sysenter {
+
+bool init() {
+  if (!cpuid::has_sep()) {
+    return false;
+  }
+
+  // SYSENTER loads cs from this MSR and ss from the next GDT entry;
+  // SYSEXIT loads cs/ss from the two entries after that (with RPL
+  // 3). This matches our GDT layout.
+  msr::write(msr::ia32_sysenter_cs, 0x08);
+  msr::write(msr::ia32_sysenter_esp, (size_t)gdt::tss_esp0_addr());
+  msr::write(msr::ia32_sysenter_eip, (size_t)&sysenter_entry);
+  return true;
+}
+
+} // namespace arch::sysenter
@@ -0,0 +1,21 @@
+#pragma once
+
+/// \file
+/// \brief SYSENTER/SYSEXIT fast syscall path.
+///
+/// This is an alternative to `int 0x80` that avoids the IDT lookup,
+/// privilege checks, and stack frame of a software interrupt. Both
+/// paths dispatch through \ref proc::do_syscall(); `int 0x80` remains
+/// available as a fallback (e.g., on CPUs without SYSENTER).
+///
+/// \see proc/syscalls.h for the userspace calling convention.
+
+namespace arch::sysenter {
+
+/// Program the SYSENTER MSRs. Must be called after \ref
+/// arch::gdt::init().
+///
+/// \return false if the CPU doesn't support SYSENTER.
+bool init();
+
+} // namespace arch::sysenter
@@ -6,17 +6,28 @@
 #include "drivers/pci.h"
 #include "drivers/serial.h"
 #include "fs/drivers/fat32.h"
+#include "fpu.h"
 #include "fs/vfs.h"
 #include "gdt.h"
 #include "idt.h"
+#include "mm/bench.h"
 #include "mm/kmalloc.h"
 #include "mm/page_frame_allocator.h"
+#include "mm/page_frame_table.h"
 #include "mm/virt.h"
+#include "mm/zero_pool.h"
+#include "nonstd/bench.h"
 #include "nonstd/libc.h"
+#include "nonstd/memops.h"
+#include "page_table.h"
 #include "proc/process.h"
 #include "sched/kthread.h"
+#include "sysenter.h"
+#include "timer.h"
+#include <array>
 #include <climits>
 #include <concepts>
+#include <optional>
 
 static volatile const BP_REQ(MEMORY_MAP, _mem_map_req);
 
@@ -26,6 +37,14 @@ void do_schedule() {
     scheduler->schedule();
   }
 }
+void do_fpu_trap() {
+  if (likely(scheduler)) {
+    scheduler->handle_fpu_trap();
+  } else {
+    // Nothing to save or restore before there are threads.
+    arch::fpu::set_task_switched(false);
+  }
+}
 proc::Process *curr_proc() {
   if (likely(scheduler)) {
     return scheduler->curr_proc();
@@ -35,11 +54,44 @@ proc::Process *curr_proc() {
 
 namespace {
 
+#ifdef EAGER_PFT_INIT
+constexpr bool deferred_pft_init = false;
+#else
+/// Only initialize enough of the PFT to boot, and initialize the rest
+/// in a background thread (see \ref pft_init_thread()).
+constexpr bool deferred_pft_init = true;
+#endif
+
+/// The allocators whose initialization is finished by \ref
+/// pft_init_thread().
+std::array<mem::phys::SimplePFA *, 2> deferred_pfas{};
+
+/// Initializes the rest of the PFT a chunk at a time, yielding in
+/// between so that the first processes can run in the meantime.
+void pft_init_thread(void *) {
+  const uint64_t start = arch::time::rdtsc();
+  for (auto *pfa : deferred_pfas) {
+    while (pfa != nullptr && pfa->init_chunk()) {
+      scheduler->schedule();
+    }
+  }
+  nonstd::printf("Deferred PFT init finished in %llu cycles\r\n",
+                 arch::time::rdtsc() - start);
+  scheduler->exit_thread();
+}
+
 __attribute__((noreturn)) void entry() {
+  const uint64_t boot_start = arch::time::rdtsc();
   console_use_hhdm();
 
   nonstd::printf("We're in the kernel now!\r\n");
 
+  nonstd::memops::select();
+  nonstd::printf("memcpy/memset: %s, %s above %uKB\r\n",
+                 nonstd::memops::selected().name,
+                 nonstd::memops::selected_large().name,
+                 nonstd::memops::nt_threshold / 1024);
+
   // C++-ify the memory map.
   struct e820_mm_entry *ent;
   nonstd::printf("Memory map:\r\n");
@@ -61,19 +113,54 @@ __attribute__((noreturn)) void entry() {
   mem::virt::enumerate_page_tables();
 #endif
 
+  arch::page_table::init();
+
   nonstd::printf("Initializing kernel GDT...\r\n");
   arch::gdt::init();
+  if (!arch::sysenter::init()) {
+    nonstd::printf(
+        "\tSYSENTER unsupported, only int 0x80 syscalls available\r\n");
+  }
+  if (!arch::fpu::init()) {
+    nonstd::printf("\tFXSAVE/SSE unsupported, FPU disabled\r\n");
+  }
 
   nonstd::printf("Initializing PFT...\r\n");
   mem::phys::PageFrameTable pft(mem_map);
   nonstd::printf("\tTotal mem=%llx Usable mem=%llx\r\n", pft.total_mem_bytes,
                  pft.usable_mem_bytes);
+  mem::phys::set_pft(&pft);
+
+  // Required for copy-on-write.
+  arch::page_table::enable_write_protect();
 
   nonstd::printf("Initializing PFA...\r\n");
-  mem::phys::SimplePFA simple_allocator{pft, 0, pft.mem_limit()};
+  // The kernel heap must be reachable through the HHDM. The rest of
+  // memory is only used for userspace frames (see mem::alloc_frames()).
+  mem::phys::SimplePFA simple_allocator{
+      pft, 0, std::min<uint64_t>(pft.mem_limit(), mem::virt::hhdm_len),
+      deferred_pft_init};
+  deferred_pfas[0] = &simple_allocator;
 
   mem::set_pfa(&simple_allocator); // for simple kmalloc
 
+  // PAE paging is only needed to address memory above 4GB.
+  if (pft.mem_limit() > arch::page_table::max_phys() &&
+      arch::page_table::enable_pae()) {
+    nonstd::printf("\tEnabled PAE paging\r\n");
+  }
+  std::optional<mem::phys::SimplePFA> highmem_allocator;
+  if (const uint64_t highmem_end =
+          std::min(pft.mem_limit(), arch::page_table::max_phys());
+      highmem_end > mem::virt::hhdm_len) {
+    highmem_allocator.emplace(pft, mem::virt::hhdm_len, highmem_end,
+                              deferred_pft_init);
+    deferred_pfas[1] = &*highmem_allocator;
+    mem::set_highmem_pfa(&*highmem_allocator);
+    nonstd::printf("\tHighmem=%llx\r\n",
+                   highmem_end - mem::virt::hhdm_len);
+  }
+
   nonstd::printf("Enabling interrupts...\r\n");
   arch::idt::init();
 
@@ -104,10 +191,32 @@ __attribute__((noreturn)) void entry() {
   fs::Result res{};
   new proc::Process(scheduler, "/BIN/INIT", res);
   ASSERT(res == fs::Result::Ok);
+  nonstd::printf("\tBoot-to-init: %llu cycles (%s PFT init)\r\n",
+                 arch::time::rdtsc() - boot_start,
+                 deferred_pft_init ? "deferred" : "eager");
+
+  if (deferred_pft_init) {
+    scheduler.new_thread(nullptr, pft_init_thread, nullptr);
+  }
+
+#ifdef BENCH
+  mem::bench::map_range();
+  mem::bench::mem_ops();
+  nonstd::bench::hash_maps();
+
+  nonstd::printf("Spawning benchmark processes...\r\n");
+  for (const auto *bench : {"/BIN/SYSBENCH", "/BIN/FAULTBEN"}) {
+    new proc::Process(scheduler, bench, res);
+    ASSERT(res == fs::Result::Ok);
+  }
+#endif
 
-  // This becomes the idle task.
+  // This becomes the idle task. Rather than halting right away, it
+  // zeroes frames ahead of time for page faults.
   for (;;) {
-    hlt;
+    if (!mem::refill_zero_pool()) {
+      hlt;
+    }
   }
 }
 
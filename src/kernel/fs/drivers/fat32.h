@@ -10,9 +10,9 @@
 #include "libc_minimal.h"
 #include "memdefs.h"
 #include "nonstd/allocator.h"
+#include "nonstd/flat_hash_map.h"
 #include "nonstd/libc.h"
 #include "nonstd/memory.h"
-#include "nonstd/node_hash_map.h"
 #include "nonstd/string_view.h"
 #include <functional>
 #include <optional>
@@ -191,7 +191,7 @@ private:
   ///
   /// N.B. at any given point of time, start cluster uniquely
   /// identifies a file/directory in the superblock.
-  nonstd::node_hash_map<uint32_t, Inode *> start_cluster_to_inode;
+  nonstd::flat_hash_map<uint32_t, Inode *> start_cluster_to_inode;
 };
 
 } // namespace fs::fat32
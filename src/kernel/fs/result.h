@@ -17,6 +17,7 @@ enum class Result : uint16_t {
   // Generic reasons
   Unsupported,
   InvalidArgs,
+  OutOfMemory,
 
   // VFS
   IsDirectory,
@@ -29,6 +30,9 @@ enum class Result : uint16_t {
 
   // mmap
   MappingExists,
+
+  // syscalls
+  BadAddress,
 };
 
 inline const char *result_to_str(Result res) {
@@ -39,12 +43,14 @@ inline const char *result_to_str(Result res) {
     X(Ok);
     X(Unsupported);
     X(InvalidArgs);
+    X(OutOfMemory);
     X(IsDirectory);
     X(IsFile);
     X(FileNotFound);
     X(BadFD);
     X(NonExecutable);
     X(MappingExists);
+    X(BadAddress);
 #undef X
   }
   return "<unknown>";
@@ -1,8 +1,13 @@
 #include "fs/vfs.h"
 #include "fs/drivers/fat32.h"
+#include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/page_frame_table.h"
+#include "mm/shrinker.h"
+#include "mm/virt.h"
 #include "nonstd/allocator.h"
+#include "nonstd/hash_bytes.h"
 #include "nonstd/libc.h"
-#include "nonstd/node_hash_map.h"
 #include "nonstd/string_view.h"
 #include "util/assert.h"
 #include "util/pathutil.h"
@@ -14,84 +19,264 @@ namespace {
 
 fs::Dentry *root = nullptr;
 
-/// Used for transparent lookups without creating a nonstd::string.
-/// Hash specialization defined at the end of this file.
-struct DcacheTransparentKey {
-  Dentry *parent;
-  nonstd::string_view component;
-
-  auto operator<=>(const DcacheTransparentKey &) const = default;
-};
-
-/// The key storage type. Can be looked up transparently via a
-/// DcacheTransparentKey.
-struct DcacheKey {
-  Dentry *parent;
-  nonstd::string component;
-
-  auto operator<=>(const DcacheKey &) const = default;
-  operator DcacheTransparentKey() const { return {parent, component}; }
-};
-
 /// Hashtable containing all dcache entries that exist in the
 /// filesystem. Dentries can exist and not be in \ref dcache_lookup
 /// for two reasons:
 ///
-/// 1. It can be a negative dentry (not implemented yet).
+/// 1. It can be a negative dentry (see \ref negative_dcache).
 /// 2. It can be removed from the filesystem but a \ref File still
 ///    has a reference to it.
 ///
-/// This will be initialized in \ref fs::init().
-std::optional<nonstd::node_hash_map<DcacheKey, Dentry *>> dcache_lookup;
+/// The table is intrusive (see \ref DcacheHashNode), so inserting or
+/// removing a dentry doesn't allocate a node or a copy of its
+/// component, and a lookup only touches dentries.
+util::IntrusiveHashTable<Dentry> dcache_lookup;
+
+/// The dcache hash of the child of \a parent whose component hashes
+/// to \a component_hash.
+size_t dcache_hash(const Dentry *parent, size_t component_hash) {
+  return nonstd::hash_combine(parent, component_hash);
+}
+
+Dentry *dcache_find(const Dentry *parent, nonstd::string_view component,
+                    size_t component_hash) {
+  return dcache_lookup.find(dcache_hash(parent, component_hash),
+                            [&](const Dentry &dentry) {
+                              return dentry.parent == parent &&
+                                     dentry.component_hash == component_hash &&
+                                     nonstd::string_view{dentry.component} ==
+                                         component;
+                            });
+}
+
+/// A negative dentry, i.e. a cached failed lookup of \a component in
+/// \a parent. These are separate from \ref Dentry since they have no
+/// inode and are never handed out of the VFS.
+struct NegativeDentry;
+using NegativeDentryLRU = util::IntrusiveListHead<NegativeDentry>;
+struct NegativeDentry : public NegativeDentryLRU,
+                        public util::IntrusiveHashTableNode<NegativeDentry> {
+  NegativeDentry(Dentry &_parent, nonstd::string_view _component,
+                 size_t _component_hash)
+      : parent{_parent}, component{_component},
+        component_hash{_component_hash} {
+    parent.inc_rc();
+  }
+  ~NegativeDentry() {
+    NegativeDentryLRU::erase();
+    parent.dec_rc();
+  }
+
+  NON_MOVABLE(NegativeDentry);
+
+  /// Pinned, so that a new dentry at the same address can't inherit
+  /// this entry.
+  Dentry &parent;
+  nonstd::string component;
+  size_t component_hash;
+};
+
+/// Upper bound on the number of negative dentries. Each one pins its
+/// parent, so this also bounds the memory they keep alive.
+constexpr size_t max_negative_dentries = 128;
+
+/// Negative dentries, keyed like \ref dcache_lookup.
+util::IntrusiveHashTable<NegativeDentry> negative_dcache;
+
+/// All negative dentries, most recently used first.
+NegativeDentryLRU negative_lru;
+
+/// Dentries with a refcount of zero, most recently used first. See
+/// \ref Dentry::dec_rc().
+DentryLRU unused_lru;
+
+/// All dentries, in use or not.
+size_t dentry_count = 0;
+
+DcacheStats stats;
+
+class DcacheShrinker final : public mem::Shrinker {
+  size_t shrink(size_t count) final { return shrink_dcache(count); }
+} dcache_shrinker;
+
+NegativeDentry *negative_find(const Dentry *parent,
+                              nonstd::string_view component,
+                              size_t component_hash) {
+  return negative_dcache.find(
+      dcache_hash(parent, component_hash), [&](const NegativeDentry &neg) {
+        return &neg.parent == parent &&
+               neg.component_hash == component_hash &&
+               nonstd::string_view{neg.component} == component;
+      });
+}
+
+void negative_erase(NegativeDentry &neg) {
+  negative_dcache.erase(neg);
+  delete &neg;
+}
+
+/// Cache the failed lookup of \a component in \a parent, evicting the
+/// least recently used negative dentry if there are too many.
+void negative_insert(Dentry &parent, nonstd::string_view component,
+                     size_t component_hash) {
+  // Insert before evicting, which may drop the last reference to
+  // \a parent otherwise.
+  auto *const neg = new NegativeDentry{parent, component, component_hash};
+  negative_dcache.insert(*neg, dcache_hash(&parent, component_hash));
+  negative_lru.push_front(*neg);
+  if (negative_dcache.size() > max_negative_dentries) {
+    negative_erase(negative_lru.prev());
+    ++stats.negative_evictions;
+  }
+}
+
+/// Drop the negative dentries in \a parent, after a name may have
+/// been created in it. This drops all of them rather than only the
+/// new name's, since different names can refer to the same file
+/// (e.g., FAT matches 8.3 names case-insensitively).
+void invalidate_negative(const Dentry &parent) {
+  for (auto it = negative_lru.begin(); it != negative_lru.end();) {
+    NegativeDentry &neg = *it++;
+    if (&neg.parent == &parent) {
+      negative_erase(neg);
+    }
+  }
+}
 
 } // namespace
 
+std::byte *Inode::get_page(size_t pgoff, Result &res) {
+  if (is_directory) {
+    res = Result::IsDirectory;
+    return nullptr;
+  }
+
+  if (auto it = page_cache.find(pgoff); it != page_cache.end()) {
+    return it->second;
+  }
+
+  // Note: the kernel heap implementation ensures that this is
+  // page-aligned.
+  auto *page = reinterpret_cast<std::byte *>(::operator new(PG_SZ));
+  if (page == nullptr) {
+    res = Result::OutOfMemory;
+    return nullptr;
+  }
+  const ssize_t n = read(page, pgoff * PG_SZ, PG_SZ, res);
+  if (n < 0) {
+    // kfree() doesn't free anything.
+    mem::free_frames(mem::virt::hhdm_to_direct(page), 1);
+    return nullptr;
+  }
+  nonstd::memset(page + n, 0, PG_SZ - n);
+
+  // The page cache's reference on the frame.
+  mem::phys::get_pft().get_pfd(mem::virt::hhdm_to_direct(page)).set_refcount(1);
+
+  page_cache.emplace(pgoff, page);
+  return page;
+}
+
+Inode::~Inode() {
+  // TODO: if this file is unlinked when deleted, actually clear its
+  // contents.
+
+  // Drop the page cache's references. Pages that are still mapped
+  // are freed when they're unmapped.
+  for (const auto &[_, page] : page_cache) {
+    const uint64_t phys = mem::virt::hhdm_to_direct(page);
+    if (mem::phys::get_pft().get_pfd(phys).dec_refcount() == 0) {
+      mem::free_frames(phys, 1);
+    }
+  }
+}
+
+std::byte *Inode::find_page(size_t pgoff) const {
+  const auto it = page_cache.find(pgoff);
+  return it == page_cache.end() ? nullptr : it->second;
+}
+
 /// See note about dynamic allocation for Inodes. The same applies
 /// here.
 Dentry::Dentry(Dentry *_parent, Inode &_inode, nonstd::string_view _component)
-    : inode{_inode}, parent{_parent}, component{_component} {
+    : Dentry{_parent, _inode, _component,
+             nonstd::hash<nonstd::string_view>{}(_component)} {}
+
+Dentry::Dentry(Dentry *_parent, Inode &_inode, nonstd::string_view _component,
+               size_t _component_hash)
+    : inode{_inode}, parent{_parent}, component{_component},
+      component_hash{_component_hash} {
+  DEBUG_ASSERT(component_hash ==
+               nonstd::hash<nonstd::string_view>{}(component));
   if (likely(parent)) {
     parent->inc_rc();
     parent->children.push_back(*this);
 
-    const auto [_, inserted] =
-        dcache_lookup->try_emplace(DcacheKey{parent, component}, this);
-    ASSERT(inserted);
-    in_hashtable = true;
+    DEBUG_ASSERT(dcache_find(parent, component, component_hash) == nullptr);
+    dcache_lookup.insert(*this, dcache_hash(parent, component_hash));
+
+    // Unused until someone takes a reference.
+    unused_lru.push_front(*this);
+    ++stats.dentries_unused;
   }
   inode.inc_rc();
+  ++dentry_count;
 }
 
 Dentry::~Dentry() {
-  ASSERT(children.empty());
+  ASSERT(children.empty() && rc == 0);
+
+  if (!DentryLRU::empty()) {
+    DentryLRU::erase();
+    --stats.dentries_unused;
+  }
+  if (DcacheHashNode::linked()) {
+    dcache_lookup.erase(*this);
+  }
+  --dentry_count;
 
   inode.dec_rc();
   if (likely(parent)) {
     DentrySiblingList::erase();
     parent->dec_rc();
+  }
+}
 
-    if (in_hashtable) {
-      const auto it =
-          dcache_lookup->find(DcacheTransparentKey{parent, component});
-      ASSERT(it != dcache_lookup->end() && it->second == this);
-      dcache_lookup->erase(it);
-      in_hashtable = false;
-    }
+void Dentry::inc_rc() {
+  if (rc++ == 0 && !DentryLRU::empty()) {
+    DentryLRU::erase();
+    --stats.dentries_unused;
+  }
+}
+
+void Dentry::dec_rc() {
+  ASSERT(rc != 0);
+  if (--rc != 0) {
+    return;
+  }
+  if (DcacheHashNode::linked()) {
+    unused_lru.push_front(*this);
+    ++stats.dentries_unused;
+  } else {
+    delete this;
   }
 }
 
 void init(Filesystem &root_fs) {
   root = root_fs.get_root_dentry();
-  dcache_lookup.emplace();
   ASSERT(root != nullptr);
-  ASSERT(dcache_lookup.has_value());
+  mem::register_shrinker(dcache_shrinker);
 }
 
 Dentry *pathname_lookup(nonstd::string_view path, Result &res) {
   Dentry *it = root;
   while (!path.empty()) {
+    // The component is hashed once here, and the hash is reused for
+    // the dcache lookup and the new Dentry on a miss.
     nonstd::string_view component;
-    std::tie(component, path) = util::path::left_partition_path(path);
+    size_t component_hash;
+    std::tie(component, path) =
+        util::path::left_partition_path(path, component_hash);
 
     if (component.empty() || component == ".") {
       continue;
@@ -103,36 +288,84 @@ Dentry *pathname_lookup(nonstd::string_view path, Result &res) {
       continue;
     }
 
-    auto lookup_it = dcache_lookup->find(DcacheTransparentKey{it, component});
-    if (lookup_it != dcache_lookup->end()) {
+    if (Dentry *dentry = dcache_find(it, component, component_hash)) {
       // Dentry exists in the dcache (via hashtable lookup).
-      it = lookup_it->second;
+      it = dentry;
+    } else if (NegativeDentry *neg =
+                   negative_find(it, component, component_hash)) {
+      // We already know that the dentry doesn't exist.
+      negative_lru.push_front(*neg);
+      ++stats.negative_hits;
+      res = Result::FileNotFound;
+      return nullptr;
     } else {
       // Dentry doesn't exist in the dcache, we have to delegate to
-      // the filesystem's \a lookup().
+      // the filesystem's \a lookup(). \a it may be unused, so pin it:
+      // allocating may shrink the dcache.
+      it->inc_rc();
       auto *inode = it->inode.lookup(component, res);
       ASSERT((inode == nullptr) ^ (res == Result::Ok));
-      if (inode == nullptr) {
+      Dentry *child = nullptr;
+      if (inode != nullptr) {
+        // The inode may already be referenced only by an unused dentry
+        // (e.g., a case-insensitive alias on FAT32), so pin it too.
+        inode->inc_rc();
+        child = new Dentry{it, *inode, component, component_hash};
+        inode->dec_rc();
+      } else if (res == Result::FileNotFound) {
+        negative_insert(*it, component, component_hash);
+      }
+      it->dec_rc();
+      if (child == nullptr) {
         return nullptr;
       }
-      it = new Dentry{it, *inode, component};
+      it = child;
     }
   }
 
   return it;
 }
 
-} // namespace fs
+Result creat(Dentry &parent, nonstd::string_view name) {
+  parent.inc_rc();
+  const Result res = parent.inode.creat(name);
+  invalidate_negative(parent);
+  parent.dec_rc();
+  return res;
+}
 
-namespace nonstd {
-template <> struct hash<fs::DcacheTransparentKey> {
-  size_t operator()(const fs::DcacheTransparentKey &key) {
-    return hash_combine(key.parent, key.component);
-  }
-};
-template <> struct hash<fs::DcacheKey> {
-  size_t operator()(const fs::DcacheKey &key) {
-    return hash<fs::DcacheTransparentKey>{}(key);
+Result mkdir(Dentry &parent, nonstd::string_view name) {
+  parent.inc_rc();
+  const Result res = parent.inode.mkdir(name);
+  invalidate_negative(parent);
+  parent.dec_rc();
+  return res;
+}
+
+Result link(Dentry &target, Dentry &new_parent, nonstd::string_view name) {
+  target.inc_rc();
+  new_parent.inc_rc();
+  const Result res = target.inode.link(new_parent.inode, name);
+  invalidate_negative(new_parent);
+  new_parent.dec_rc();
+  target.dec_rc();
+  return res;
+}
+
+const DcacheStats &dcache_stats() {
+  stats.dentries_in_use = dentry_count - stats.dentries_unused;
+  stats.negative_dentries = negative_dcache.size();
+  return stats;
+}
+
+size_t shrink_dcache(size_t count) {
+  size_t freed = 0;
+  for (; freed < count && !unused_lru.empty(); ++freed) {
+    // This may put the parent on the LRU.
+    delete &unused_lru.prev();
   }
-};
-} // namespace nonstd
+  stats.dentries_reclaimed += freed;
+  return freed;
+}
+
+} // namespace fs
@@ -47,8 +47,10 @@
 #include "nonstd/string.h"
 #include "nonstd/string_view.h"
 #include "nonstd/vector.h"
+#include "util/intrusive_hash_table.h"
 #include "util/intrusive_list.h"
 #include "util/objutil.h"
+#include <cstddef>
 #include <optional>
 
 namespace fs {
@@ -65,10 +67,8 @@ public:
   /// TODO: replace dynamic allocation with slab allocator
   Inode(unsigned _id, bool _is_directory)
       : id{_id}, is_directory{_is_directory} {}
-  virtual ~Inode() {
-    // TODO: if this file is unlinked when deleted, actually clear its
-    // contents.
-  }
+  /// Releases the page cache.
+  virtual ~Inode();
 
   NON_MOVABLE(Inode);
 
@@ -118,13 +118,46 @@ public:
   // child's refcount. Do not actually modify the filesystem on
   // disk. Returns nullptr if the child doesn't exist.
   virtual Inode *lookup(nonstd::string_view name, Result &res) const = 0;
+
+  /// File-only operation: returns the (HHDM address of the) page
+  /// cache page containing the file bytes [pgoff*PG_SZ,
+  /// (pgoff+1)*PG_SZ), reading it in via \ref read() on a miss. Bytes
+  /// past the end of the file are zero. On failure (including OOM),
+  /// sets \a res and returns nullptr.
+  ///
+  /// Used to serve file-backed page faults. The page remains cached
+  /// (and may be mapped into processes) for the lifetime of the
+  /// inode. Inodes of unused dentries are kept until the dcache is
+  /// shrunk (see \ref shrink_dcache()).
+  ///
+  /// TODO: per-page eviction, and keeping the page cache coherent
+  /// with \ref write().
+  std::byte *get_page(size_t pgoff, Result &res);
+
+  /// Like \ref get_page(), but returns nullptr rather than reading
+  /// the page in if it isn't cached.
+  std::byte *find_page(size_t pgoff) const;
+
+private:
+  /// Page cache, keyed by page offset in the file.
+  nonstd::node_hash_map<size_t, std::byte *> page_cache;
 };
 
 class Dentry;
 using DentrySiblingList = util::IntrusiveListHead<Dentry>;
-class Dentry : public DentrySiblingList {
+/// Hook for the dcache hashtable, keyed by (parent, component).
+using DcacheHashNode = util::IntrusiveHashTableNode<Dentry>;
+/// Hook for the LRU list of unused dentries.
+using DentryLRU = util::IntrusiveListHead<Dentry, struct DentryLRUTag>;
+class Dentry : public DentrySiblingList,
+               public DcacheHashNode,
+               public DentryLRU {
 public:
   Dentry(Dentry *_parent, Inode &_inode, nonstd::string_view _component);
+  /// \a _component_hash must be the hash of \a _component, e.g. from
+  /// \ref util::path::left_partition_path().
+  Dentry(Dentry *_parent, Inode &_inode, nonstd::string_view _component,
+         size_t _component_hash);
   ~Dentry();
 
   NON_MOVABLE(Dentry);
@@ -132,28 +165,18 @@ public:
   /// Inodes should only be referenced via File, Dentry, and
   /// PathHastable.
   /// TODO: add MultiAccessKey<File, Dentry, PathHastable>
-  void inc_rc() { ++rc; }
+  void inc_rc();
 
-  /// Returns whether the refcount was decremented to zero, i.e. the
-  /// dentry is able to be freed. In practice, the return value
-  /// shouldn't be used by the caller since it doesn't care about this
-  /// object anymore.
-  bool dec_rc() {
-    ASSERT(rc != 0);
-    if (--rc == 0) {
-      // This assumes that the Dentry is dynamically allocated.  The
-      // root node may not be dynamically allocated, but it should
-      // also never have a refcount of zero (it cannot be removed from
-      // the hashtable, which should always maintain a reference to
-      // it).
-      //
-      // TODO: only delete is memory is low, otherwise wait for
-      // garbage collector.
-      delete this;
-      return true;
-    }
-    return false;
-  }
+  /// Dentries that drop to a refcount of zero are kept on an LRU list
+  /// along with their inodes, so that they can be found again without
+  /// going to the filesystem. They're freed by \ref shrink_dcache(),
+  /// e.g. when memory is low. Dentries that can't be looked up
+  /// anymore are freed immediately.
+  ///
+  /// This assumes that the Dentry is dynamically allocated. The root
+  /// node may not be dynamically allocated, but it should also never
+  /// have a refcount of zero.
+  void dec_rc();
 
   Inode &inode;
   Dentry *parent;
@@ -163,8 +186,10 @@ public:
   DentrySiblingList children;
 
   nonstd::string component;
+  /// Cached hash of \a component for dcache lookups. Components are
+  /// immutable, so this never needs to be recomputed.
+  size_t component_hash;
 
-  bool in_hashtable = false;
   bool to_unlink = false;
   unsigned rc = 0;
 };
@@ -221,6 +246,47 @@ void init(Filesystem &root_fs);
 /// 4. If not found, return nullptr and set res to
 ///    Result::FileNotFound. Otherwise continue to the next component
 ///    (if any).
+///
+/// Failed lookups are cached as negative dentries, so that repeating
+/// them (e.g., searching a list of directories for a binary) doesn't
+/// go to the filesystem.
+///
+/// The returned dentry may be unused (see \ref Dentry::dec_rc()), in
+/// which case an allocation may free it. The caller should take a
+/// reference before allocating.
 Dentry *pathname_lookup(nonstd::string_view path, Result &res);
 
+/// Wrappers around the \ref Inode operations that add names to a
+/// directory. These keep the dcache coherent, so they should be used
+/// instead of calling the inode directly. The dentries are pinned for
+/// the duration of the call.
+Result creat(Dentry &parent, nonstd::string_view name);
+Result mkdir(Dentry &parent, nonstd::string_view name);
+/// Link \a target into \a new_parent as \a name.
+Result link(Dentry &target, Dentry &new_parent, nonstd::string_view name);
+
+struct DcacheStats {
+  /// Dentries with a nonzero refcount, e.g. from a \ref File or a
+  /// child.
+  size_t dentries_in_use = 0;
+  /// Dentries on the LRU list.
+  size_t dentries_unused = 0;
+  /// Unused dentries freed by \ref shrink_dcache().
+  uint64_t dentries_reclaimed = 0;
+
+  /// Lookups answered by a negative dentry.
+  uint64_t negative_hits = 0;
+  /// Negative dentries evicted to stay within the limit.
+  uint64_t negative_evictions = 0;
+  size_t negative_dentries = 0;
+};
+const DcacheStats &dcache_stats();
+
+/// Free up to \a count unused dentries (and their inodes, if
+/// unreferenced), least recently used first. This is also registered
+/// as a \ref mem::Shrinker by \ref init().
+///
+/// \return the number of dentries freed.
+size_t shrink_dcache(size_t count);
+
 } // namespace fs
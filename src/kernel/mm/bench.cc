@@ -0,0 +1,139 @@
+#include "mm/bench.h"
+#include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/virt.h"
+#include "nonstd/libc.h"
+#include "nonstd/memops.h"
+#include "timer.h"
+#include "util/assert.h"
+
+namespace mem::bench {
+
+namespace {
+
+/// Unused userspace virtual memory in the boot address space.
+constexpr size_t bench_virt = 0x40000000;
+
+/// Cycles per page since \a start.
+uint32_t per_page(uint64_t start, size_t num_pg) {
+  return uint32_t(arch::time::rdtsc() - start) / num_pg;
+}
+
+void bench_map_range(size_t len) {
+  const size_t num_pg = len / PG_SZ;
+  void *const virt = (void *)bench_virt;
+  const auto page = [&](size_t i) {
+    return (void *)(bench_virt + i * PG_SZ);
+  };
+  // The frames are never accessed, so any will do.
+  constexpr uint64_t phys = 0;
+  virt::FlushBatch batch;
+
+  // Warm up. This also allocates the page tables, which aren't freed
+  // on unmap, so that neither variant pays for them.
+  const bool mapped = virt::map_range(phys, virt, num_pg,
+                                     /*userspace=*/false, /*writable=*/true);
+  ASSERT(mapped);
+  virt::unmap_range(virt, num_pg, batch);
+  batch.flush();
+
+  uint64_t start = arch::time::rdtsc();
+  for (size_t i = 0; i < num_pg; ++i) {
+    virt::map(phys + i * PG_SZ, page(i), /*userspace=*/false,
+              /*writable=*/true);
+  }
+  const uint32_t map_cycles = per_page(start, num_pg);
+
+  start = arch::time::rdtsc();
+  for (size_t i = 0; i < num_pg; ++i) {
+    virt::unmap(page(i));
+  }
+  const uint32_t unmap_cycles = per_page(start, num_pg);
+
+  start = arch::time::rdtsc();
+  virt::map_range(phys, virt, num_pg, /*userspace=*/false,
+                  /*writable=*/true);
+  const uint32_t map_range_cycles = per_page(start, num_pg);
+
+  start = arch::time::rdtsc();
+  virt::protect_range(virt, num_pg, /*writable=*/false, batch);
+  batch.flush();
+  const uint32_t protect_range_cycles = per_page(start, num_pg);
+
+  start = arch::time::rdtsc();
+  virt::unmap_range(virt, num_pg, batch);
+  batch.flush();
+  const uint32_t unmap_range_cycles = per_page(start, num_pg);
+
+  nonstd::printf("\t%uMB: map=%u map_range=%u unmap=%u unmap_range=%u "
+                 "protect_range=%u\r\n",
+                 len / MB, map_cycles, map_range_cycles, unmap_cycles,
+                 unmap_range_cycles, protect_range_cycles);
+}
+
+/// The largest buffer size in \ref mem_ops().
+constexpr size_t mem_ops_max_len = 1 * MB;
+
+/// Each measurement processes about this many bytes in total.
+constexpr size_t mem_ops_total = 16 * MB;
+
+/// Prints the throughput of \a op on buffers of each size.
+template <typename Op> void bench_mem_op(const char *name, Op op) {
+  for (size_t len = 64; len <= mem_ops_max_len; len *= 16) {
+    const size_t iters = mem_ops_total / len;
+    op(len); // warm up
+    const uint64_t start = arch::time::rdtsc();
+    for (size_t i = 0; i < iters; ++i) {
+      op(len);
+    }
+    const uint32_t cycles = uint32_t(arch::time::rdtsc() - start);
+    // Two decimal places of bytes/cycle.
+    const uint32_t rate = uint32_t(mem_ops_total) / (cycles / 100 + 1);
+    nonstd::printf("\t%u.%u%u", rate / 100, rate / 10 % 10, rate % 10);
+  }
+  nonstd::printf("\t%s\r\n", name);
+}
+
+} // namespace
+
+void map_range() {
+  ASSERT(!arch::page_table::get_phys((void *)bench_virt).has_value());
+  nonstd::printf("map_range: cycles/page\r\n");
+  for (const size_t len : {1 * MB, 16 * MB, 256 * MB}) {
+    bench_map_range(len);
+  }
+}
+
+void mem_ops() {
+  auto *const src = reinterpret_cast<std::byte *>(kmalloc(mem_ops_max_len));
+  auto *const dst = reinterpret_cast<std::byte *>(kmalloc(mem_ops_max_len));
+  ASSERT(src != nullptr && dst != nullptr);
+  nonstd::memset(src, 0x5a, mem_ops_max_len);
+
+  nonstd::printf("mem_ops: bytes/cycle (selected: %s, %s above %uKB)\r\n",
+                 nonstd::memops::selected().name,
+                 nonstd::memops::selected_large().name,
+                 nonstd::memops::nt_threshold / 1024);
+  nonstd::printf("\t64B\t4KB\t64KB\t1MB\r\n");
+  char name[32];
+  for (const auto &impl : nonstd::memops::impls()) {
+    if (!impl.supported()) {
+      continue;
+    }
+    nonstd::snprintf(name, sizeof name, "memcpy %s", impl.name);
+    bench_mem_op(name, [&](size_t len) { impl.memcpy(dst, src, len); });
+    nonstd::snprintf(name, sizeof name, "memset %s", impl.name);
+    bench_mem_op(name, [&](size_t len) { impl.memset(dst, 0, len); });
+  }
+  nonstd::memcpy(dst, src, mem_ops_max_len);
+  bench_mem_op("memcmp", [&](size_t len) {
+    const volatile int res = nonstd::memcmp(dst, src, len);
+    (void)res;
+  });
+
+  for (auto *buf : {src, dst}) {
+    free_frames(virt::hhdm_to_direct(buf), mem_ops_max_len / PG_SZ);
+  }
+}
+
+} // namespace mem::bench
@@ -0,0 +1,22 @@
+#pragma once
+
+/// \file
+/// \brief In-kernel memory management microbenchmarks.
+///
+/// These measure kernel-internal interfaces that userspace can't
+/// exercise directly. They are run on boot in BENCH builds.
+
+namespace mem::bench {
+
+/// Compare mapping and unmapping 1MB, 16MB and 256MB page by page
+/// (\ref virt::map() and \ref virt::unmap()) against the range
+/// operations (\ref virt::map_range() and \ref virt::unmap_range()),
+/// and time \ref virt::protect_range(). Prints cycles per page.
+void map_range();
+
+/// Compare the memcpy() and memset() implementations (see \ref
+/// nonstd::memops) for 64B, 4KB, 64KB and 1MB buffers, and time
+/// memcmp(). Prints bytes per cycle.
+void mem_ops();
+
+} // namespace mem::bench
@@ -1,6 +1,7 @@
 #include "mm/kmalloc.h"
 #include "memdefs.h"
 #include "mm/page_frame_allocator.h"
+#include "mm/shrinker.h"
 #include "mm/virt.h"
 #include "perf.h"
 #include "util/algorithm.h"
@@ -8,11 +9,13 @@
 namespace {
 void *arena = nullptr;
 mem::phys::SimplePFA *pfa = nullptr;
+mem::phys::SimplePFA *highmem_pfa = nullptr;
 }; // namespace
 
 namespace mem {
 
 void set_pfa(phys::SimplePFA *_pfa) { pfa = _pfa; }
+void set_highmem_pfa(phys::SimplePFA *_pfa) { highmem_pfa = _pfa; }
 
 void *kmalloc(size_t sz) noexcept {
   if (unlikely(pfa == nullptr)) {
@@ -21,11 +24,13 @@ void *kmalloc(size_t sz) noexcept {
 
   // Alloc new page(s) as needed.
   if (!arena || ((size_t)arena & (PG_SZ - 1)) + sz > PG_SZ) {
-    // TODO: this should only attempt to allocate pages in the first
-    // 1GB of memory (that are reachable via the HHDM). Otherwise the
-    // allocated memory is not accessible to the kernel and
-    // direct_to_hhdm() will throw.
-    auto page_frame = pfa->alloc(util::algorithm::ceil_pow2<PG_SZ>(sz) / PG_SZ);
+    // Note: the PFA only covers memory reachable via the HHDM.
+    const unsigned num_pg = util::algorithm::ceil_pow2<PG_SZ>(sz) / PG_SZ;
+    shrink_if_low(*pfa);
+    auto page_frame = pfa->alloc(num_pg);
+    if (!page_frame && shrink_all() > 0) {
+      page_frame = pfa->alloc(num_pg);
+    }
     arena = page_frame ? virt::direct_to_hhdm(*page_frame) : nullptr;
   }
 
@@ -49,6 +54,51 @@ void kfree(void *data) noexcept {
   // nop
 }
 
+std::optional<uint64_t> alloc_frames(unsigned num_pg,
+                                     unsigned align_pg) noexcept {
+  ASSERT(util::algorithm::pow2(align_pg));
+  for (auto *allocator : {highmem_pfa, pfa}) {
+    if (allocator == nullptr) {
+      continue;
+    }
+
+    // Over-allocate, then free the unaligned head and tail.
+    const unsigned alloc_pg = num_pg + align_pg - 1;
+    const auto base = allocator->alloc(alloc_pg);
+    if (!base) {
+      continue;
+    }
+    const uint64_t align = uint64_t(align_pg) << PG_SZ_BITS;
+    const uint64_t aligned = (*base + align - 1) & ~(align - 1);
+    const unsigned head_pg = (aligned - *base) >> PG_SZ_BITS;
+    const unsigned tail_pg = alloc_pg - head_pg - num_pg;
+    if (head_pg > 0) {
+      allocator->free(*base, head_pg);
+    }
+    if (tail_pg > 0) {
+      allocator->free(aligned + (uint64_t(num_pg) << PG_SZ_BITS), tail_pg);
+    }
+    return aligned;
+  }
+  return std::nullopt;
+}
+
+void free_frames(uint64_t phys, unsigned num_pg) noexcept {
+  ASSERT(PG_ALIGNED(phys));
+  if (highmem_pfa != nullptr && phys < highmem_pfa->start &&
+      phys + (uint64_t(num_pg) << PG_SZ_BITS) > highmem_pfa->start) {
+    // The frames straddle the two PFAs, which are adjacent.
+    const unsigned lowmem_pg = (highmem_pfa->start - phys) >> PG_SZ_BITS;
+    pfa->free(phys, lowmem_pg);
+    highmem_pfa->free(highmem_pfa->start, num_pg - lowmem_pg);
+    return;
+  }
+  auto *allocator =
+      highmem_pfa != nullptr && phys >= highmem_pfa->start ? highmem_pfa : pfa;
+  ASSERT(allocator != nullptr);
+  allocator->free(phys, num_pg);
+}
+
 } // namespace mem
 
 void *operator new(size_t sz) { return ::operator new (sz, std::nothrow_t{}); }
@@ -12,18 +12,46 @@
 #include <cstddef>
 #include <cstdint>
 #include <new>
+#include <optional>
 
 namespace mem {
 
 namespace phys {
 class SimplePFA;
 }
+/// Set the allocator for the kernel heap. It must only cover memory
+/// reachable via the HHDM.
 void set_pfa(phys::SimplePFA *pfa);
 
 // These functions will return HHDM virtual addresses.
 void *kmalloc(size_t sz) noexcept;
 void kfree(void *data) noexcept;
 
+/// Set the allocator for memory outside the HHDM ("highmem"). This
+/// is optional; it's only used by \ref alloc_frames().
+void set_highmem_pfa(phys::SimplePFA *pfa);
+
+/// Allocates \a num_pg physically contiguous frames, whose physical
+/// address is aligned to \a align_pg pages (a power of two), for
+/// userspace mappings. For example, this is used to allocate hugepage
+/// frames. Free with \ref free_frames().
+///
+/// Frames come from highmem if possible, so that userspace doesn't
+/// compete with the kernel heap (and the page cache) for the HHDM.
+/// Thus they may not be accessible through the HHDM; use \ref
+/// virt::KmapGuard to access them.
+///
+/// \return the physical address of the frames, or nullopt on OOM.
+std::optional<uint64_t> alloc_frames(unsigned num_pg,
+                                     unsigned align_pg = 1) noexcept;
+
+/// Frees \a num_pg frames starting at \a phys back to the PFA they
+/// came from. These may come from \ref alloc_frames() or from a
+/// page-multiple kmalloc(), which always returns whole pages (or a
+/// physically contiguous mix of both). Unlike kfree(), this actually
+/// frees memory.
+void free_frames(uint64_t phys, unsigned num_pg) noexcept;
+
 } // namespace mem
 
 // We don't have exceptions so this is actually equivalent to the
@@ -1,6 +1,8 @@
 #include "page_frame_allocator.h"
 
+#include "memdefs.h"
 #include "perf.h"
+#include "sched/lock.h"
 #include "util/algorithm.h"
 
 namespace mem::phys {
@@ -29,30 +31,67 @@ PageFrameAllocator::~PageFrameAllocator() {
   pft.unregister_allocator(*this);
 }
 
-SimplePFA::SimplePFA(PageFrameTable &pft, uint64_t _start, uint64_t _end)
+SimplePFA::SimplePFA(PageFrameTable &pft, uint64_t _start, uint64_t _end,
+                     bool deferred)
     : PageFrameAllocator(pft, _start, _end) {
-  // Mark unusable pages.
-  uint64_t unusable_pg_it = start;
+  if (deferred) {
+    init_chunk();
+  } else {
+    while (init_chunk()) {
+    }
+  }
+}
+
+bool SimplePFA::init_chunk() {
+  // This may race with an allocation that ran out of initialized
+  // memory, so do the whole chunk at once.
+  sched::IrqGuard guard;
+  if (init_end == end) {
+    return false;
+  }
+  const uint64_t chunk_start = init_end;
+  const uint64_t chunk_end = std::min(end, chunk_start + init_chunk_bytes);
+  init_frames(chunk_start, chunk_end);
+
+  // Mark unusable pages (those not in any usable region).
+  uint64_t unusable_pg_it = chunk_start;
   for (auto &region : get_usable_regions()) {
-    if (region.base < start) {
-      // Skip regions until we've reached the start of our
-      // responsible region.
+    if (region.base + region.len <= unusable_pg_it) {
+      // Skip regions until we've reached the start of the chunk.
       continue;
     }
-    while (unusable_pg_it < region.base && unusable_pg_it < end) {
-      pft.get_pfd(unusable_pg_it).unusable = true;
-      unusable_pg_it += PG_SZ;
-    }
-    if (unusable_pg_it >= end) {
-      // Stop once we've reached the end of our responsible region.
+    if (region.base >= chunk_end) {
       break;
     }
-    unusable_pg_it += region.len;
+    for (; unusable_pg_it < region.base; unusable_pg_it += PG_SZ) {
+      pft.get_pfd(unusable_pg_it).unusable = true;
+    }
+    unusable_pg_it = region.base + region.len;
+  }
+  for (; unusable_pg_it < chunk_end; unusable_pg_it += PG_SZ) {
+    pft.get_pfd(unusable_pg_it).unusable = true;
   }
+
+  init_end = chunk_end;
+  init_endp = &pft.get_pfd(init_end);
+  return true;
 }
 
 std::optional<uint64_t> SimplePFA::alloc(unsigned num_pg) {
-  uint64_t len = (end - start) / PG_SZ;
+  for (;;) {
+    if (const auto base = alloc_initialized(num_pg)) {
+      return base;
+    }
+    // Rather than waiting for the rest of the range to be initialized
+    // in the background, initialize another chunk now.
+    if (!init_chunk()) {
+      return {};
+    }
+  }
+}
+
+std::optional<uint64_t> SimplePFA::alloc_initialized(unsigned num_pg) {
+  uint64_t len = (init_end - start) / PG_SZ;
 
   if (num_pg > len) {
     return {};
@@ -62,9 +101,9 @@ std::optional<uint64_t> SimplePFA::alloc(unsigned num_pg) {
   unsigned steps = 0;
 
   auto try_alloc = [&] {
-    if (needle + num_pg > endp) {
+    if (needle + num_pg > init_endp) {
       // Need to wrap, so not contiguous.
-      steps += endp - needle;
+      steps += init_endp - needle;
       needle = startp;
       return false;
     }
@@ -82,7 +121,7 @@ std::optional<uint64_t> SimplePFA::alloc(unsigned num_pg) {
     // Find next location to try.
     while (!needle->usable() && likely(++steps < len)) {
       ++needle;
-      if (unlikely(needle >= endp)) {
+      if (unlikely(needle >= init_endp)) {
         needle = startp;
       }
     }
@@ -47,6 +47,11 @@ protected:
     return pft.get_usable_regions();
   }
 
+  /// \see PageFrameTable::init_frames()
+  void init_frames(uint64_t start, uint64_t end) {
+    pft.init_frames(start, end);
+  }
+
 private:
   // These are part of the interface, but we should really only be
   // calling these through the derived class interface to avoid
@@ -67,18 +72,45 @@ private:
 /// means that in the case of an alloc-free-alloc pattern, the second
 /// alloc will return the same base address as the first alloc if the
 /// second alloc is of no greater size than the first.
+///
+/// Initializing the PFDs of a large range takes a while, so it may be
+/// deferred: only a prefix of the range is usable at first, and the
+/// rest is made usable a chunk at a time by \ref init_chunk().
 class SimplePFA final : public PageFrameAllocator {
 public:
-  SimplePFA(PageFrameTable &pft, uint64_t _start, uint64_t _end);
+  /// \param deferred if set, only the first chunk of the range is
+  /// initialized here.
+  SimplePFA(PageFrameTable &pft, uint64_t _start, uint64_t _end,
+            bool deferred = false);
 
   std::optional<uint64_t> alloc(unsigned num_pg) final;
   void free(uint64_t base, uint64_t num_pg) final;
 
   unsigned get_alloced_pages() const final { return alloced_pgs; }
 
+  /// Initialize the next \ref init_chunk_bytes of the range, and make
+  /// it available for allocation. This is meant to be called from a
+  /// background thread; \ref alloc() also calls it when it runs out
+  /// of initialized memory.
+  ///
+  /// \return false if the whole range was already initialized.
+  bool init_chunk();
+
+  /// Interrupts are disabled while a chunk is initialized, which
+  /// bounds its size.
+  static constexpr uint64_t init_chunk_bytes = 16 * MB;
+
 private:
+  /// Like \ref alloc(), but only considers the initialized prefix of
+  /// the range.
+  std::optional<uint64_t> alloc_initialized(unsigned num_pg);
+
   PageFrameDescriptor *needle = &pft.get_pfd(start);
   unsigned alloced_pgs = 0;
+
+  /// End of the initialized prefix of the range.
+  uint64_t init_end = start;
+  PageFrameDescriptor *init_endp = startp;
 };
 
 } // namespace mem::phys
@@ -10,6 +10,16 @@
 
 namespace mem::phys {
 
+namespace {
+PageFrameTable *global_pft = nullptr;
+}
+
+void set_pft(PageFrameTable *pft) { global_pft = pft; }
+PageFrameTable &get_pft() {
+  ASSERT(global_pft != nullptr);
+  return *global_pft;
+}
+
 PageFrameTable::PageFrameTable(std::span<e820_mm_entry> mm)
     : PageFrameTable(mm, std::nullopt) {}
 
@@ -24,21 +34,6 @@ PageFrameTable::PageFrameTable(
       }()},
       mm{mm_copy.begin(), _mm.size()}, usable_regions{normalize_mm(mm)},
       pft{_pft ? *_pft : alloc_pft()}, usable_mem_bytes{compute_usable_mem()} {
-
-  // Also zero bootloader-reclaimable memory. We observe slowdowns
-  // when trying to write to the same pages as executable instructions
-  // in QEMU so this helps with performance. (This is also a good
-  // thing for general security.)
-  //
-  // Note that any data structures within the bootloader reclaimable
-  // region will be zeroed after this (e.g., the E820 memory map), so
-  // we need to use/copy them before this point.
-  for (const auto mm_entry : mm) {
-    if (mm_entry.type == E820_MM_TYPE_BOOTLOADER_RECLAIMABLE) {
-      nonstd::memset(virt::direct_to_hhdm(mm_entry.base), 0, mm_entry.len);
-    }
-  }
-
   // If PFT was provided, check that it is valid (large enough). If
   // it is larger than implied by the memory map, we won't use the
   // extra slots.
@@ -214,12 +209,34 @@ bool PageFrameTable::register_allocator(PageFrameAllocator &allocator,
   }
 
   allocators.push_back(allocator);
+  return true;
+}
 
+void PageFrameTable::init_frames(uint64_t start, uint64_t end) {
   // Zero-initialize the corresponding PFT entries.
   auto *start_pfd = &get_pfd(start);
   auto *end_pfd = &get_pfd(end);
   nonstd::memset(start_pfd, 0, (char *)end_pfd - (char *)start_pfd);
-  return true;
+
+  // Also zero bootloader-reclaimable memory. We observe slowdowns
+  // when trying to write to the same pages as executable instructions
+  // in QEMU so this helps with performance. (This is also a good
+  // thing for general security.)
+  //
+  // Note that any data structures within the bootloader reclaimable
+  // region will be zeroed after this (e.g., the E820 memory map), so
+  // we need to use/copy them before this point.
+  for (const auto mm_entry : mm) {
+    if (mm_entry.type != E820_MM_TYPE_BOOTLOADER_RECLAIMABLE) {
+      continue;
+    }
+    const uint64_t zero_start = std::max(mm_entry.base, start);
+    const uint64_t zero_end = std::min(mm_entry.base + mm_entry.len, end);
+    if (zero_end > zero_start) {
+      nonstd::memset(virt::direct_to_hhdm(zero_start), 0,
+                     zero_end - zero_start);
+    }
+  }
 }
 
 void PageFrameTable::unregister_allocator(PageFrameAllocator &allocator) {
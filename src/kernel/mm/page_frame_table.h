@@ -27,7 +27,12 @@ namespace mem::phys {
 
 /// \brief Metadata for a single page frame in the linear address range.
 ///
-/// For now, make this 64B, same as in the Linux kernel.
+/// This is kept to 8 bytes, so that a cache line holds the PFDs of
+/// eight frames (allocator scans touch the PFDs of consecutive
+/// frames) and the PFT takes up 0.2% of physical memory. This matters
+/// since the PFT must live in the HHDM: with 4GB of memory, a 64B PFD
+/// (as in Linux) would take up 64MB of it. Metadata that is only
+/// needed for a few frames should be kept in a separate table.
 class PageFrameDescriptor {
 public:
   bool allocated : 1 = false;
@@ -37,14 +42,33 @@ public:
   /// auxiliary memory to determine which pages are usable.
   bool unusable : 1 = false;
 
-  bool rsv1 : 6 = false;
-
-  char data[63];
+  uint8_t rsv0 : 6 = 0;
+  uint8_t rsv1[3] = {};
 
   bool usable() const { return !allocated && !unusable; }
-} __attribute__((packed, aligned(64)));
 
-static_assert(sizeof(PageFrameDescriptor) == 64);
+  /// Number of references to a frame that is mapped into userspace:
+  /// one per page table mapping, plus one if the frame is owned by
+  /// the page cache. Frames shared by more than one reference are
+  /// copied on write.
+  ///
+  /// This is only maintained for userspace-mapped frames, and is
+  /// garbage otherwise.
+  uint32_t refcount() const { return rc; }
+  void set_refcount(uint32_t _rc) { rc = _rc; }
+  void inc_refcount() { ++rc; }
+
+  /// \return the new refcount.
+  uint32_t dec_refcount() {
+    DEBUG_ASSERT(rc != 0);
+    return --rc;
+  }
+
+private:
+  uint32_t rc = 0;
+};
+
+static_assert(sizeof(PageFrameDescriptor) == 8);
 
 class PageFrameAllocator;
 
@@ -116,10 +140,9 @@ private:
   std::span<e820_mm_entry> normalize_mm(std::span<e820_mm_entry> mm) const;
   std::span<PageFrameDescriptor> alloc_pft() const;
 
-  /// These are used to manage all allocators for this
-  /// PFT. Corresponding PFD entries are zeroed upon registering an
-  /// allocator. (They're not cleaned up on destruction, but this can
-  /// be done in the future if needed.)
+  /// These are used to manage all allocators for this PFT. (They're
+  /// not cleaned up on destruction, but this can be done in the
+  /// future if needed.)
   ///
   /// TODO: we should introduce some sort of access-key like mechanism
   /// to avoid friending the class. But this is okay for now.
@@ -127,6 +150,12 @@ private:
   bool register_allocator(PageFrameAllocator &allocator, uint64_t start,
                           uint64_t end);
   void unregister_allocator(PageFrameAllocator &allocator);
+
+  /// Zero the PFDs for [\a start, \a end), as well as any
+  /// bootloader-reclaimable memory in that range. Allocators call this
+  /// before using a range, which need not happen all at once; see
+  /// \ref SimplePFA::init_chunk().
+  void init_frames(uint64_t start, uint64_t end);
   util::IntrusiveListHead<PageFrameAllocator> allocators;
 
   /// \brief Copy of the input E820 memory map.
@@ -157,4 +186,10 @@ public:
   const uint64_t usable_mem_bytes;
 };
 
+/// The PFT covering all of physical memory. This is used to look up
+/// PFDs by physical address (e.g., for page refcounts). Set once on
+/// boot.
+void set_pft(PageFrameTable *pft);
+PageFrameTable &get_pft();
+
 } // namespace mem::phys
@@ -0,0 +1,44 @@
+#include "mm/shrinker.h"
+#include "mm/page_frame_allocator.h"
+#include <limits>
+
+namespace mem {
+
+namespace {
+
+util::IntrusiveListHead<Shrinker> shrinkers;
+
+/// Set while the shrinkers run, so that an allocation made while
+/// freeing objects doesn't run them recursively.
+bool shrinking = false;
+
+size_t run_shrinkers(size_t count) {
+  if (shrinking) {
+    return 0;
+  }
+  shrinking = true;
+  size_t freed = 0;
+  for (auto &shrinker : shrinkers) {
+    freed += shrinker.shrink(count);
+  }
+  shrinking = false;
+  return freed;
+}
+
+} // namespace
+
+void register_shrinker(Shrinker &shrinker) { shrinkers.push_back(shrinker); }
+
+void shrink_if_low(const phys::SimplePFA &pfa) {
+  // Not get_free_pages(), which makes a virtual call.
+  const unsigned free_pages = pfa.get_total_pages() - pfa.get_alloced_pages();
+  if (free_pages < pfa.get_total_pages() / low_watermark_divisor) {
+    run_shrinkers(shrink_batch);
+  }
+}
+
+size_t shrink_all() {
+  return run_shrinkers(std::numeric_limits<size_t>::max());
+}
+
+} // namespace mem
@@ -0,0 +1,52 @@
+#pragma once
+
+/// \file
+/// \brief Reclaiming cached objects under memory pressure.
+///
+/// Caches elsewhere in the kernel (e.g., the dcache) keep unused
+/// objects around in case they're needed again, and register a \ref
+/// Shrinker to give them back when the kernel heap runs low. The
+/// kernel heap calls \ref shrink_if_low() before taking more frames
+/// from its PFA, and \ref shrink_all() before giving up on an
+/// allocation.
+
+#include "util/intrusive_list.h"
+#include "util/objutil.h"
+#include <cstddef>
+
+namespace mem {
+
+namespace phys {
+class SimplePFA;
+}
+
+class Shrinker : public util::IntrusiveListHead<Shrinker> {
+public:
+  Shrinker() = default;
+  NON_MOVABLE(Shrinker);
+
+  /// Free up to \a count cached objects, least recently used first.
+  /// This must not allocate from the kernel heap.
+  ///
+  /// \return the number of objects freed.
+  virtual size_t shrink(size_t count) = 0;
+};
+
+/// Registering a shrinker twice has no effect.
+void register_shrinker(Shrinker &shrinker);
+
+/// The number of objects each shrinker is asked to free when memory
+/// is low.
+constexpr size_t shrink_batch = 32;
+
+/// Run the shrinkers if less than 1/\ref low_watermark_divisor of \a
+/// pfa's pages are free.
+constexpr unsigned low_watermark_divisor = 32;
+void shrink_if_low(const phys::SimplePFA &pfa);
+
+/// Free everything the shrinkers can, e.g., on OOM.
+///
+/// \return the number of objects freed.
+size_t shrink_all();
+
+} // namespace mem
@@ -2,53 +2,116 @@
 #include "memdefs.h"
 #include "mm/kmalloc.h"
 #include "perf.h"
+#include "util/algorithm.h"
+#include "util/assert.h"
+#include <array>
 
 namespace mem::virt {
 
+namespace {
+
+/// Pages reserved in the IO map for \ref KmapGuard, one per nesting
+/// level. These are allocated on first use.
+std::array<std::byte *, 2> kmap_slots{};
+unsigned kmap_depth = 0;
+
+} // namespace
+
 bool ioremap(uint64_t phys, void *virt, unsigned pg) {
-  for (int i = 0; i < pg; ++i) {
-    if (unlikely(!map(phys + (i << PG_SZ_BITS),
-                      (void *)((uint32_t)virt + (i << PG_SZ_BITS)),
-                      /*userspace=*/false,
-                      /*writable=*/true,
-                      /*uncacheable=*/true))) {
+  for (unsigned i = 0; i < pg;) {
+    const uint64_t pg_phys = phys + (i << PG_SZ_BITS);
+    void *const pg_virt = (void *)((uint32_t)virt + (i << PG_SZ_BITS));
+    if (pg - i >= PG_PER_PT && HUGEPG_ALIGNED(pg_phys) &&
+        HUGEPG_ALIGNED((size_t)pg_virt) &&
+        map_huge(pg_phys, pg_virt, /*userspace=*/false, /*writable=*/true,
+                 /*uncacheable=*/true, /*executable=*/false)) {
+      i += PG_PER_PT;
+      continue;
+    }
+
+    // Map up to the next 4MB boundary at once.
+    const unsigned n = std::min<unsigned>(
+        pg - i, PG_PER_PT - ((size_t)pg_virt >> PG_SZ_BITS) % PG_PER_PT);
+    if (unlikely(!map_range(pg_phys, pg_virt, n,
+                            /*userspace=*/false,
+                            /*writable=*/true,
+                            /*uncacheable=*/true,
+                            /*executable=*/false))) {
       return false;
     }
+    i += n;
   }
   return true;
 }
 
 void *io_alloc(unsigned pg) {
   static size_t io_region_offset = 0;
-  if (io_region_offset + (pg << PG_SZ_BITS) > io_map_sz) {
+  size_t offset = io_region_offset;
+  if (pg >= PG_PER_PT) {
+    static_assert(HUGEPG_ALIGNED(io_map_start));
+    offset = util::algorithm::ceil_pow2<HUGE_PG_SZ>(offset);
+  }
+  if (offset + (pg << PG_SZ_BITS) > io_map_sz) {
     return nullptr;
   }
-  void *res = (void *)(io_map_start + io_region_offset);
-  io_region_offset += (pg << PG_SZ_BITS);
+  void *res = (void *)(io_map_start + offset);
+  io_region_offset = offset + (pg << PG_SZ_BITS);
   return res;
 }
 
 bool vmalloc(void *virt, unsigned pg, bool writable) {
-  /// TODO: This should attempt to allocate pages past the first 1GB of
-  /// memory, and possibly fallback to the first 1GB of memory.
-  /// Otherwise it'll eat into kernel memory (memory reachable via
-  /// HHDM).
-  ///
-  for (unsigned i = 0; i < pg; ++i) {
-    // We can allocate more pages at a time, but single-page
-    // allocation is faster/more likely to succeed.
-    //
-    // Note: the kernel heap implementation ensures that this is
-    // page-aligned.
-    if (void *pg = ::operator new(PG_SZ);
-        unlikely(pg == nullptr) ||
-        unlikely(!map(hhdm_to_direct(pg),
-                      (void *)((size_t)virt + (i << PG_SZ_BITS)),
-                      /*userspace=*/true, writable))) {
+  for (unsigned i = 0; i < pg;) {
+    // Map as many pages at once as we can get contiguous frames for.
+    // Single-page allocation is more likely to succeed if memory is
+    // fragmented.
+    unsigned n = pg - i;
+    auto frames = alloc_frames(n);
+    if (!frames) {
+      n = 1;
+      frames = alloc_frames(n);
+    }
+    if (unlikely(!frames) ||
+        unlikely(!map_range(*frames, (void *)((size_t)virt + (i << PG_SZ_BITS)),
+                            n, /*userspace=*/true, writable))) {
       return false;
     }
+    i += n;
   }
   return true;
 }
 
+KmapGuard::KmapGuard(uint64_t phys) {
+  ASSERT(PG_ALIGNED(phys));
+  if (phys + PG_SZ <= hhdm_len) {
+    virt = direct_to_hhdm<std::byte>(phys);
+    return;
+  }
+
+  __asm__ volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+  ASSERT(kmap_depth < kmap_slots.size());
+  auto &slot = kmap_slots[kmap_depth++];
+  if (unlikely(slot == nullptr)) {
+    slot = reinterpret_cast<std::byte *>(io_alloc(1));
+    ASSERT(slot != nullptr);
+  }
+  const bool mapped = map(phys, slot, /*userspace=*/false, /*writable=*/true,
+                          /*uncacheable=*/false, /*executable=*/false);
+  ASSERT(mapped);
+  virt = slot;
+  highmem = true;
+}
+
+KmapGuard::~KmapGuard() {
+  if (!highmem) {
+    return;
+  }
+  ASSERT(kmap_depth > 0 && kmap_slots[kmap_depth - 1] == virt);
+  --kmap_depth;
+  unmap(virt);
+  // Restore IF.
+  if (eflags & (1 << 9)) {
+    __asm__ volatile("sti" : : : "memory");
+  }
+}
+
 } // namespace mem::virt
@@ -33,6 +33,7 @@
 #include "boot_protocol.h"
 #include "memdefs.h"
 #include "page_table.h"
+#include "util/objutil.h"
 #include <cassert>
 #include <cstddef>
 #include <functional>
@@ -74,7 +75,8 @@ inline void enumerate_page_tables() {
 
 /// Maps the contiguous virtual memory region of \a pg pages starting
 /// at \a virt to the contiguous physical memory region starting at \a
-/// phys. Mark these pages as uncacheable. Intended for mapping
+/// phys. Mark these pages as uncacheable. 4MB-aligned 4MB chunks are
+/// mapped using hugepages where possible. Intended for mapping
 /// memory-mapped or IO port physical addresses (usually assigned by
 /// firmware) into the virtual address space.
 ///
@@ -96,7 +98,8 @@ bool ioremap(uint64_t phys, void *virt, unsigned pg);
 /// pages will be allocated from the virtual memory hole reserved for
 /// this purpose (starting at \ref io_map_start).
 ///
-/// This assumes the memory is never freed.
+/// This assumes the memory is never freed. Allocations of at least
+/// 4MB are 4MB-aligned, so that they can be mapped using hugepages.
 ///
 /// \param pg The number of contiguous 4KB virtual memory pages to
 ///           allocate
@@ -112,7 +115,8 @@ void *io_alloc(unsigned pg);
 /// This will fail if we OOM when allocating physical pages, or if any
 /// of the pages in the virtual address range are already mapped.
 ///
-/// \note The allocated physical pages may not be contiguous.
+/// \note The allocated physical pages may not be contiguous, and may
+/// not be in the HHDM (see \ref mem::alloc_frames()).
 ///
 /// \note This is based on a layman's understanding of Linux's
 /// vmalloc() interface, but should not be held to any of the same
@@ -134,11 +138,32 @@ bool vmalloc(void *virt, unsigned pg, bool writable);
 /// \param phys Physical page to map to
 /// \param virt Virtual page to map from
 /// \param uncacheable Whether page should be marked uncacheable
+/// \param executable Whether instructions may be fetched from the
+///        page. This is only enforced if the CPU supports the NX bit
+///        and PAE paging is in use.
 /// \return true on success
 ///
 inline bool map(uint64_t phys, void *virt, bool userspace, bool writable,
-                bool uncacheable = false) {
-  return arch::page_table::map(phys, virt, userspace, writable, uncacheable);
+                bool uncacheable = false, bool executable = true) {
+  return arch::page_table::map(phys, virt, userspace, writable, uncacheable,
+                               executable);
+}
+
+/// Maps the (4MB) hugepage \a virt to the 4MB-aligned physical memory
+/// frame \a phys. Both must be 4MB-aligned.
+///
+/// This fails if anything is mapped in the 4MB virtual memory region;
+/// callers should fall back to \ref map() in that case. 4KB-granular
+/// operations on part of a hugepage (e.g., \ref unmap()) transparently
+/// split it into 4KB pages.
+///
+/// \return true on success
+///
+inline bool map_huge(uint64_t phys, void *virt, bool userspace,
+                     bool writable, bool uncacheable = false,
+                     bool executable = true) {
+  return arch::page_table::map_huge(phys, virt, userspace, writable,
+                                    uncacheable, executable);
 }
 
 /// Unmaps the (4KB) page containing the given virtual address from
@@ -148,10 +173,75 @@ inline bool map(uint64_t phys, void *virt, bool userspace, bool writable,
 ///
 inline bool unmap(void *virt) { return arch::page_table::unmap(virt); }
 
+/// \see arch::page_table::FlushBatch
+using FlushBatch = arch::page_table::FlushBatch;
+
+/// Maps the \a pg pages starting at \a virt to the contiguous frames
+/// starting at \a phys. This is equivalent to calling \ref map() on
+/// each page, but only walks the page directory once per page table.
+///
+/// \return true on success
+///
+inline bool map_range(uint64_t phys, void *virt, size_t pg, bool userspace,
+                      bool writable, bool uncacheable = false,
+                      bool executable = true) {
+  return arch::page_table::map_range(phys, virt, pg, userspace, writable,
+                                     uncacheable, executable);
+}
+
+/// Unmaps any mapped pages among the \a pg pages starting at \a virt.
+/// The TLB entries are invalidated when \a batch is flushed.
+/// \a on_unmap is called with the frame of each unmapped page.
+///
+/// \return the number of pages unmapped
+///
+inline size_t unmap_range(void *virt, size_t pg, FlushBatch &batch,
+                          const std::function<void(uint64_t)> &on_unmap = {}) {
+  return arch::page_table::unmap_range(virt, pg, batch, on_unmap);
+}
+
+/// Makes any mapped pages among the \a pg pages starting at \a virt
+/// writable or read-only. The TLB entries are invalidated when \a
+/// batch is flushed.
+///
+/// \return the number of mapped pages
+///
+inline size_t protect_range(void *virt, size_t pg, bool writable,
+                            FlushBatch &batch) {
+  return arch::page_table::protect_range(virt, pg, writable, batch);
+}
+
 /// Update virtual -> physical page table mapping attributes.
 ///
 inline bool mark_uncacheable(void *virt) {
   return arch::page_table::mark_uncacheable(virt);
 }
 
+/// \brief Temporary kernel mapping of a physical page.
+///
+/// Frames outside the HHDM ("highmem", e.g., userspace frames; see
+/// \ref mem::alloc_frames()) aren't otherwise accessible to the
+/// kernel. This maps such a frame into one of a few reserved pages in
+/// the IO map for the lifetime of the guard. Frames in the HHDM are
+/// simply accessed via the HHDM.
+///
+/// The reserved pages are global, so interrupts are disabled while a
+/// highmem frame is mapped, and guards must be destroyed in reverse
+/// order of construction. At most two frames may be mapped at once
+/// (e.g., the source and destination of a copy).
+///
+class KmapGuard {
+public:
+  explicit KmapGuard(uint64_t phys);
+  ~KmapGuard();
+  NON_COPYABLE(KmapGuard);
+
+  std::byte *get() const { return virt; }
+
+private:
+  std::byte *virt;
+  bool highmem = false;
+  uint32_t eflags = 0;
+};
+
 } // namespace mem::virt
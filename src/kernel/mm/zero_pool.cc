@@ -0,0 +1,122 @@
+#include "mm/zero_pool.h"
+#include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/virt.h"
+#include "nonstd/libc.h"
+#include "nonstd/memops.h"
+#include "perf.h"
+#include "sched/lock.h"
+#include <array>
+
+namespace mem {
+
+namespace {
+
+/// A fixed-capacity stack of zeroed frames. Interrupts must be
+/// disabled while it is modified, since the idle task refills it
+/// concurrently with faults in other threads.
+template <typename T, size_t N> struct Pool {
+  bool full() const { return size == N; }
+
+  std::optional<T> pop() {
+    sched::IrqGuard guard;
+    if (size == 0) {
+      return std::nullopt;
+    }
+    return frames[--size];
+  }
+
+  /// \return false if the pool filled up in the meantime.
+  bool push(T frame) {
+    sched::IrqGuard guard;
+    if (full()) {
+      return false;
+    }
+    frames[size++] = frame;
+    return true;
+  }
+
+  std::array<T, N> frames;
+  size_t size = 0;
+};
+
+/// The capacities are a tradeoff between memory held back from the
+/// allocators and how long a burst of faults the pools can absorb.
+/// Anonymous faults take up to \ref
+/// proc::VirtualMemoryArea::fault_around_pages frames at once.
+Pool<void *, 32> kernel_pool;
+Pool<uint64_t, 128> user_pool;
+
+/// See \ref refill_zero_pool() for why this uses non-temporal stores.
+void zero_page(std::byte *page) { nonstd::memops::memset_nt(page, 0, PG_SZ); }
+
+void zero_frame(uint64_t phys) {
+  virt::KmapGuard kmap{phys};
+  zero_page(kmap.get());
+}
+
+} // namespace
+
+void *alloc_zeroed_page() noexcept {
+  if (const auto page = kernel_pool.pop()) {
+    return *page;
+  }
+  auto *page = reinterpret_cast<std::byte *>(::operator new(PG_SZ));
+  if (unlikely(page == nullptr)) {
+    return nullptr;
+  }
+  nonstd::memset(page, 0, PG_SZ);
+  return page;
+}
+
+std::optional<uint64_t> alloc_zeroed_frame() noexcept {
+  if (const auto frame = user_pool.pop()) {
+    return frame;
+  }
+  const auto frame = alloc_frames(1);
+  if (likely(frame.has_value())) {
+    zero_frame(*frame);
+  }
+  return frame;
+}
+
+size_t zeroed_frames_available() noexcept { return user_pool.size; }
+
+bool refill_zero_pool() noexcept {
+  // Page tables are allocated on every fork and exec, so the kernel
+  // pool is refilled first.
+  if (!kernel_pool.full()) {
+    std::byte *page;
+    {
+      sched::IrqGuard guard;
+      page = reinterpret_cast<std::byte *>(::operator new(PG_SZ));
+    }
+    if (page == nullptr) {
+      return false;
+    }
+    zero_page(page);
+    if (!kernel_pool.push(page)) {
+      free_frames(virt::hhdm_to_direct(page), 1);
+    }
+    return true;
+  }
+
+  if (!user_pool.full()) {
+    std::optional<uint64_t> frame;
+    {
+      sched::IrqGuard guard;
+      frame = alloc_frames(1);
+    }
+    if (!frame) {
+      return false;
+    }
+    zero_frame(*frame);
+    if (!user_pool.push(*frame)) {
+      free_frames(*frame, 1);
+    }
+    return true;
+  }
+  return false;
+}
+
+} // namespace mem
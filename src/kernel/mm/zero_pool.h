@@ -0,0 +1,51 @@
+#pragma once
+
+/// \file
+/// \brief Pools of pre-zeroed frames.
+///
+/// Page faults on anonymous memory and page table allocations need
+/// zeroed pages. Rather than zeroing them on the critical path, we
+/// keep a small pool of frames that the idle task zeroes ahead of
+/// time (see \ref refill_zero_pool()). The allocation functions here
+/// take from the pool first, and only zero synchronously if it's
+/// empty.
+///
+/// There are two pools, since page tables must live in the kernel
+/// heap (the HHDM), whereas userspace frames come from \ref
+/// alloc_frames(), which prefers highmem.
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace mem {
+
+/// Allocates a zeroed page from the kernel heap, e.g., for a page
+/// table. Like a page-sized kmalloc(), but the page may also be freed
+/// with \ref free_frames().
+///
+/// \return the HHDM address of the page, or nullptr on OOM.
+void *alloc_zeroed_page() noexcept;
+
+/// Allocates a zeroed frame for a userspace mapping, as if by \ref
+/// alloc_frames(). The frame may not be accessible through the HHDM.
+///
+/// \return the physical address of the frame, or nullopt on OOM.
+std::optional<uint64_t> alloc_zeroed_frame() noexcept;
+
+/// Returns the number of frames that \ref alloc_zeroed_frame() can
+/// currently return without zeroing.
+size_t zeroed_frames_available() noexcept;
+
+/// Zero one frame and add it to a pool that isn't full. This is
+/// called by the idle task, so it does little work per call.
+///
+/// Zeroing uses non-temporal stores (MOVNTI) if SSE2 is supported, so
+/// that it doesn't evict useful cache lines: the frames likely won't
+/// be touched again until well after they're zeroed.
+///
+/// \return false if there was nothing to do (the pools are full, or
+/// memory is exhausted).
+bool refill_zero_pool() noexcept;
+
+} // namespace mem
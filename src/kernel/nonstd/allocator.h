@@ -39,4 +39,16 @@ template <class T> struct Mallocator {
   }
 };
 
+/// The allocator type for \a U that corresponds to \a Alloc, i.e.
+/// `std::allocator_traits<Alloc>::rebind_alloc<U>` for allocators
+/// that are templated on their value type. Containers use this to
+/// allocate their internal nodes and arrays.
+template <typename Alloc, typename U> struct _rebind_alloc;
+template <template <typename> typename Alloc, typename T, typename U>
+struct _rebind_alloc<Alloc<T>, U> {
+  using type = Alloc<U>;
+};
+template <typename Alloc, typename U>
+using rebind_alloc = typename _rebind_alloc<Alloc, U>::type;
+
 } // namespace nonstd
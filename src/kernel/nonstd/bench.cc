@@ -0,0 +1,69 @@
+#include "nonstd/bench.h"
+#include "nonstd/flat_hash_map.h"
+#include "nonstd/libc.h"
+#include "nonstd/node_hash_map.h"
+#include "timer.h"
+#include "util/assert.h"
+#include <cstdint>
+
+namespace nonstd::bench {
+
+namespace {
+
+/// Distinct keys that aren't consecutive, like pointers or cluster
+/// numbers.
+uint32_t key(uint32_t i) { return i * 2654435761u; }
+
+/// Cycles per operation since \a start.
+uint32_t per_op(uint64_t start, uint32_t n) {
+  return uint32_t(arch::time::rdtsc() - start) / n;
+}
+
+template <typename Map> void bench_hash_map(const char *name, uint32_t n) {
+  Map map;
+
+  uint64_t start = arch::time::rdtsc();
+  for (uint32_t i = 0; i < n; ++i) {
+    map.try_emplace(key(i), i);
+  }
+  const uint32_t insert_cycles = per_op(start, n);
+
+  uint32_t sum = 0;
+  start = arch::time::rdtsc();
+  for (uint32_t i = 0; i < n; ++i) {
+    sum += map.find(key(i))->second;
+  }
+  const uint32_t find_cycles = per_op(start, n);
+  ASSERT(sum == n * (n - 1) / 2);
+
+  uint32_t misses = 0;
+  start = arch::time::rdtsc();
+  for (uint32_t i = n; i < 2 * n; ++i) {
+    misses += !map.contains(key(i));
+  }
+  const uint32_t miss_cycles = per_op(start, n);
+  ASSERT(misses == n);
+
+  start = arch::time::rdtsc();
+  for (uint32_t i = 0; i < n; ++i) {
+    map.erase(key(i));
+  }
+  const uint32_t erase_cycles = per_op(start, n);
+  ASSERT(map.empty());
+
+  nonstd::printf("\t%u\t%u\t%u\t%u\t%s n=%u\r\n", insert_cycles, find_cycles,
+                 miss_cycles, erase_cycles, name, n);
+}
+
+} // namespace
+
+void hash_maps() {
+  nonstd::printf("hash_maps: cycles/op\r\n");
+  nonstd::printf("\tinsert\tfind\tmiss\terase\r\n");
+  for (const uint32_t n : {64, 1024, 16384}) {
+    bench_hash_map<node_hash_map<uint32_t, uint32_t>>("node_hash_map", n);
+    bench_hash_map<flat_hash_map<uint32_t, uint32_t>>("flat_hash_map", n);
+  }
+}
+
+} // namespace nonstd::bench
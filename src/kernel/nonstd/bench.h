@@ -0,0 +1,16 @@
+#pragma once
+
+/// \file
+/// \brief In-kernel container microbenchmarks.
+///
+/// See also \ref mem::bench. These are run on boot in BENCH builds.
+
+namespace nonstd::bench {
+
+/// Compare \ref flat_hash_map against \ref node_hash_map with 64,
+/// 1024 and 16384 integer keys: inserting them (including rehashes),
+/// finding them, looking up missing keys, and erasing them. Prints
+/// cycles per operation.
+void hash_maps();
+
+} // namespace nonstd::bench
@@ -8,15 +8,16 @@
 
 namespace nonstd {
 
-template <typename T> class deque {
+/// The allocator is copied along with the elements on copy, and
+/// moves with them on move and swap.
+template <typename T, typename Allocator = Mallocator<T>> class deque {
   /// Block sizing policy: I did this on vibes looking at gcc and
   /// clang's default policies. https://stackoverflow.com/q/57031917
   static constexpr size_t min_block_count = 16;
   static constexpr size_t block_size = std::max((size_t)512, 16 * sizeof(T));
   static constexpr size_t elems_per_block = block_size / sizeof(T);
 
-  using InternalAllocator = Mallocator<T *>;
-  using BlockAllocator = Mallocator<std::byte[block_size]>;
+  using InternalAllocator = rebind_alloc<Allocator, T *>;
   template <typename U> class IterImpl;
 
 public:
@@ -25,32 +26,38 @@ public:
   using reverse_iterator = std::reverse_iterator<iterator>;
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
-  deque()
-      : _block_count{min_block_count},
-        _blocks(InternalAllocator{}.allocate(_block_count)) {
+  deque() : deque(Allocator{}) {}
+  explicit deque(const Allocator &_alloc)
+      : alloc{_alloc}, _block_count{min_block_count},
+        _blocks(InternalAllocator{alloc}.allocate(_block_count)) {
     memset(_blocks, 0, sizeof(std::uintptr_t) * _block_count);
   }
-  explicit deque(size_t count) : deque{} {
+  explicit deque(size_t count, const Allocator &_alloc = {}) : deque(_alloc) {
     for (size_t i = 0; i < count; ++i) {
       emplace(end());
     }
   }
-  deque(size_t count, const T &value) : deque{} { insert(end(), count, value); }
+  deque(size_t count, const T &value, const Allocator &_alloc = {})
+      : deque(_alloc) {
+    insert(end(), count, value);
+  }
   template <std::input_iterator InputIt>
-  deque(InputIt first, InputIt last) : deque{} {
+  deque(InputIt first, InputIt last, const Allocator &_alloc = {})
+      : deque(_alloc) {
     insert(end(), first, last);
   }
 
-  deque(const deque &other) : deque(other.begin(), other.end()) {}
-  deque(deque &&other) : deque{} { *this = std::move(other); }
-  deque(std::initializer_list<T> init) : deque(init.begin(), init.end()) {}
+  deque(const deque &other) : deque(other.begin(), other.end(), other.alloc) {}
+  deque(deque &&other) : deque(other.alloc) { *this = std::move(other); }
+  deque(std::initializer_list<T> init, const Allocator &_alloc = {})
+      : deque(init.begin(), init.end(), _alloc) {}
 
   ~deque() {
     clear();
     // \a shrink_to_fit() necessary to reclaim the blocks, which
     // should all be empty now.
     shrink_to_fit();
-    InternalAllocator{}.deallocate(_blocks, _block_count);
+    InternalAllocator{alloc}.deallocate(_blocks, _block_count);
 #ifdef DEBUG
     for (size_t i = 0; i < _block_count; ++i) {
       ASSERT(_blocks[i] == nullptr);
@@ -71,6 +78,8 @@ public:
     return *this;
   }
 
+  Allocator get_allocator() const { return alloc; }
+
   // element access
   T &at(size_t pos) {
     ASSERT(pos < size());
@@ -148,6 +157,7 @@ public:
   void resize(size_t count, const T &value);
   void swap(deque &other) {
     using std::swap;
+    swap(alloc, other.alloc);
     swap(_blocks, other._blocks);
     swap(_block_count, other._block_count);
     swap(_size, other._size);
@@ -280,6 +290,8 @@ private:
                      block_elem.rem};
   }
 
+  [[no_unique_address]] Allocator alloc;
+
   size_t _block_count = 0;
 
   /// Internal array of \a _block_count blocks.
@@ -301,44 +313,42 @@ private:
 };
 
 // non-member functions
-template <typename T>
-bool operator==(const deque<T> &lhs, const deque<T> &rhs) {
+template <typename T, typename A>
+bool operator==(const deque<T, A> &lhs, const deque<T, A> &rhs) {
   return lhs.size() == rhs.size() &&
          std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
 }
 
 // template function definitions
-template <typename T> void deque<T>::shrink_to_fit() {
+template <typename T, typename Allocator>
+void deque<T, Allocator>::shrink_to_fit() {
   // Deallocate extra blocks at the end.
   for (size_t i =
            (start_block + ((start_idx + _size - 1) / elems_per_block + 1)) %
            _block_count;
        i != start_block && _blocks[i] != nullptr; i = (i + 1) % _block_count) {
-    BlockAllocator{}.deallocate(
-        (typename BlockAllocator::value_type *)_blocks[i], 1);
+    alloc.deallocate(_blocks[i], elems_per_block);
     _blocks[i] = nullptr;
   }
   // Deallocate extra blocks at start.
   for (; start_idx >= elems_per_block;
        start_idx -= elems_per_block,
        start_block = (start_block + 1) % _block_count) {
-    BlockAllocator{}.deallocate(
-        (typename BlockAllocator::value_type *)_blocks[start_block], 1);
+    alloc.deallocate(_blocks[start_block], elems_per_block);
     _blocks[start_block] = nullptr;
   }
   // The above cases don't account for an empty deque. There's
   // probably a cleaner way to do this but whatevs.
   if (empty() && _blocks[start_block] != nullptr) {
     start_idx = 0;
-    BlockAllocator{}.deallocate(
-        (typename BlockAllocator::value_type *)_blocks[start_block], 1);
+    alloc.deallocate(_blocks[start_block], elems_per_block);
     _blocks[start_block] = nullptr;
   }
 }
 
-template <typename T>
-auto deque<T>::insert(const_iterator pos, size_t count, const T &value)
-    -> iterator {
+template <typename T, typename Allocator>
+auto deque<T, Allocator>::insert(const_iterator pos, size_t count,
+                                 const T &value) -> iterator {
   const size_t idx = pos.idx - start_idx;
   size_t cur_idx = idx;
   // Note: this fails if inserting count>1 and we're not inserting
@@ -353,10 +363,10 @@ auto deque<T>::insert(const_iterator pos, size_t count, const T &value)
   return make_iterator(idx);
 }
 
-template <typename T>
+template <typename T, typename Allocator>
 template <std::input_iterator InputIt>
-auto deque<T>::insert(const_iterator pos, InputIt first, InputIt last)
-    -> iterator {
+auto deque<T, Allocator>::insert(const_iterator pos, InputIt first,
+                                 InputIt last) -> iterator {
   const size_t idx = pos.idx - start_idx;
   size_t cur_idx = idx;
   // Note: this fails if inserting multiple elements and we're not
@@ -369,9 +379,10 @@ auto deque<T>::insert(const_iterator pos, InputIt first, InputIt last)
   return make_iterator(idx);
 }
 
-template <typename T>
+template <typename T, typename Allocator>
 template <typename... Args>
-auto deque<T>::emplace(const_iterator pos, Args &&...args) -> iterator {
+auto deque<T, Allocator>::emplace(const_iterator pos, Args &&...args)
+    -> iterator {
   const size_t idx = pos.idx - start_idx;
   size_t i = 0;
   if (pos == end()) {
@@ -396,7 +407,8 @@ auto deque<T>::emplace(const_iterator pos, Args &&...args) -> iterator {
   return make_iterator(idx);
 }
 
-template <typename T> auto deque<T>::erase(const_iterator pos) -> iterator {
+template <typename T, typename Allocator>
+auto deque<T, Allocator>::erase(const_iterator pos) -> iterator {
   const size_t idx = pos.idx - start_idx;
   (*this)[idx].~T();
   if (pos == begin()) {
@@ -411,8 +423,9 @@ template <typename T> auto deque<T>::erase(const_iterator pos) -> iterator {
   return make_iterator(idx);
 }
 
-template <typename T>
-auto deque<T>::erase(const_iterator first, const_iterator last) -> iterator {
+template <typename T, typename Allocator>
+auto deque<T, Allocator>::erase(const_iterator first, const_iterator last)
+    -> iterator {
   const size_t idx = first.idx - start_idx;
   auto it = make_iterator(idx);
   if (it == last) {
@@ -423,7 +436,8 @@ auto deque<T>::erase(const_iterator first, const_iterator last) -> iterator {
   return it /* (== last) */;
 }
 
-template <typename T> void deque<T>::resize(size_t count) {
+template <typename T, typename Allocator>
+void deque<T, Allocator>::resize(size_t count) {
   ssize_t diff = count - _size;
   if (diff < 0) {
     // We can't use erase() since the current implementation doesn't
@@ -439,7 +453,8 @@ template <typename T> void deque<T>::resize(size_t count) {
   }
 }
 
-template <typename T> void deque<T>::resize(size_t count, const T &value) {
+template <typename T, typename Allocator>
+void deque<T, Allocator>::resize(size_t count, const T &value) {
   ssize_t diff = count - size();
   if (diff < 0) {
     // We can't use erase() since the current implementation doesn't
@@ -455,10 +470,11 @@ template <typename T> void deque<T>::resize(size_t count, const T &value) {
   }
 }
 
-template <typename T> void deque<T>::allocate_block(bool start) {
+template <typename T, typename Allocator>
+void deque<T, Allocator>::allocate_block(bool start) {
   const auto realloc_blocks_array = [&] {
     size_t new_block_count = _block_count * 2;
-    T **new_blocks = InternalAllocator{}.allocate(new_block_count);
+    T **new_blocks = InternalAllocator{alloc}.allocate(new_block_count);
 
     // Copy _blocks[start_block, start_block+_block_count)
     // (potentially wrapped) to new_blocks[0, _block_count) (not
@@ -470,7 +486,7 @@ template <typename T> void deque<T>::allocate_block(bool start) {
     }
     std::fill(new_blocks + _block_count, new_blocks + new_block_count, nullptr);
 
-    InternalAllocator{}.deallocate(_blocks, _block_count);
+    InternalAllocator{alloc}.deallocate(_blocks, _block_count);
     _block_count = new_block_count;
     _blocks = new_blocks;
     start_block = 0;
@@ -485,7 +501,7 @@ template <typename T> void deque<T>::allocate_block(bool start) {
     if (!start_idx) {
       // Allocate a new block.
       start_block = (start_block + _block_count - 1) % _block_count;
-      _blocks[start_block] = (T *)BlockAllocator{}.allocate(1);
+      _blocks[start_block] = alloc.allocate(elems_per_block);
     }
   } else {
     const size_t end_idx = start_idx + size();
@@ -499,7 +515,7 @@ template <typename T> void deque<T>::allocate_block(bool start) {
     T *&block = _blocks[block_idx];
     if (elem_idx == 0 && block == nullptr) {
       // Allocate a new block.
-      block = (T *)BlockAllocator{}.allocate(1);
+      block = alloc.allocate(elems_per_block);
     }
   }
 }
@@ -0,0 +1,510 @@
+#pragma once
+
+#include "nonstd/allocator.h"
+#include "nonstd/hash_bytes.h"
+#include "util/assert.h"
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <type_traits>
+
+namespace nonstd {
+
+namespace _flat_hash_map {
+
+/// Control byte for each slot: the low 7 bits of the slot's hash if
+/// it's full (so the high bit is clear), or \ref ctrl_empty.
+using ctrl_t = int8_t;
+constexpr ctrl_t ctrl_empty = -128;
+
+/// A bitmask over the slots in a \ref Group. Each slot is \a Shift
+/// bits wide; only its top bit may be set. Iterating yields the
+/// indices of the set slots, in increasing order.
+template <typename T, unsigned Shift> class BitMask {
+public:
+  explicit BitMask(T _mask) : mask{_mask} {}
+
+  explicit operator bool() const { return mask != 0; }
+  unsigned lowest() const {
+    if constexpr (sizeof(T) > sizeof(unsigned)) {
+      // __builtin_ctzll() is a libgcc call on i386.
+      const auto lo = static_cast<unsigned>(mask);
+      const auto hi = static_cast<unsigned>(mask >> 32);
+      return (lo != 0 ? __builtin_ctz(lo) : 32 + __builtin_ctz(hi)) >> Shift;
+    } else {
+      return __builtin_ctz(mask) >> Shift;
+    }
+  }
+
+  BitMask begin() const { return *this; }
+  BitMask end() const { return BitMask{0}; }
+  unsigned operator*() const { return lowest(); }
+  BitMask &operator++() {
+    mask &= mask - 1;
+    return *this;
+  }
+  bool operator==(const BitMask &) const = default;
+
+private:
+  T mask;
+};
+
+/// Matches 8 control bytes at once using bit tricks on a 64-bit word
+/// (SIMD within a register). SwissTable uses 16-wide SSE2 groups, but
+/// the kernel must not touch the SSE registers outside of
+/// sched::kernel_fpu_begin(), and so is built with -mno-sse (see the
+/// Makefile).
+struct Group {
+  static constexpr unsigned width = 8;
+  static constexpr uint64_t lsbs = 0x0101010101010101ULL;
+  static constexpr uint64_t msbs = 0x8080808080808080ULL;
+
+  explicit Group(const ctrl_t *ctrl)
+      : ctrl{*reinterpret_cast<const unaligned_u64 *>(ctrl)} {}
+
+  /// This may have false positives (when a byte is one greater than a
+  /// matching byte), which are filtered out by the key comparison.
+  BitMask<uint64_t, 3> match(ctrl_t h2) const {
+    const uint64_t x = ctrl ^ (lsbs * uint8_t(h2));
+    return BitMask<uint64_t, 3>((x - lsbs) & ~x & msbs);
+  }
+  BitMask<uint64_t, 3> match_empty() const {
+    return BitMask<uint64_t, 3>(ctrl & msbs);
+  }
+
+  using unaligned_u64 = uint64_t __attribute__((may_alias, aligned(1)));
+  uint64_t ctrl;
+};
+
+/// Mixes the bits of a hash, since \ref nonstd::hash is the identity
+/// for integers and the table uses its low bits (lowbias32 from
+/// https://nullprogram.com/blog/2018/07/31/).
+inline size_t mix(size_t h) {
+  h ^= h >> 16;
+  h *= 0x7feb352dU;
+  h ^= h >> 15;
+  h *= 0x846ca68bU;
+  h ^= h >> 16;
+  return h;
+}
+
+} // namespace _flat_hash_map
+
+/// Like absl::flat_hash_map: an open-addressing hash table that
+/// stores its elements inline in one array, so lookups don't chase
+/// pointers like in \ref node_hash_map.
+///
+/// Each slot has a control byte holding 7 bits of the element's hash
+/// (or marking the slot empty). A lookup compares a whole group of
+/// control bytes against the hash at once, and only compares keys of
+/// slots that match.
+///
+/// Unlike SwissTable, probing is linear (a group at a time), which
+/// allows erasure by shifting later elements of the probe sequence
+/// back rather than leaving tombstones. The control bytes are
+/// followed by copies of the first `Group::width - 1` bytes, so that
+/// a group can be loaded from any slot.
+///
+/// Insertions and erasures invalidate all iterators, pointers and
+/// references into the map.
+template <typename K, typename V,
+          typename Allocator = Mallocator<std::pair<const K, V>>>
+class flat_hash_map {
+  template <typename U> class IterImpl;
+  using ctrl_t = _flat_hash_map::ctrl_t;
+  using Group = _flat_hash_map::Group;
+  using _value_type = std::pair<const K, V>;
+  /// The key is mutable in storage, so that elements can be moved.
+  using slot_type = std::pair<K, V>;
+  using CtrlAllocator = rebind_alloc<Allocator, ctrl_t>;
+  using SlotAllocator = rebind_alloc<Allocator, slot_type>;
+
+public:
+  using iterator = IterImpl<_value_type>;
+  using const_iterator = IterImpl<const _value_type>;
+
+  flat_hash_map() = default;
+  explicit flat_hash_map(const Allocator &_alloc) : alloc{_alloc} {}
+  flat_hash_map(size_t bucket_count, const Allocator &_alloc = {})
+      : alloc{_alloc} {
+    reserve(bucket_count);
+  }
+  template <std::input_iterator InputIt>
+  flat_hash_map(InputIt first, InputIt last, size_t bucket_count = 0,
+                const Allocator &_alloc = {})
+      : flat_hash_map(bucket_count, _alloc) {
+    while (first != last) {
+      insert(*first++);
+    }
+  }
+  flat_hash_map(std::initializer_list<_value_type> init,
+                size_t bucket_count = 0, const Allocator &_alloc = {})
+      : flat_hash_map(init.begin(), init.end(), bucket_count, _alloc) {}
+
+  flat_hash_map(const flat_hash_map &other)
+      : flat_hash_map(other.begin(), other.end(), other.size(), other.alloc) {}
+  flat_hash_map(flat_hash_map &&other) noexcept : alloc{other.alloc} {
+    *this = std::move(other);
+  }
+
+  ~flat_hash_map() {
+    clear();
+    deallocate();
+  }
+
+  flat_hash_map &operator=(const flat_hash_map &other) {
+    *this = flat_hash_map{other};
+    return *this;
+  }
+  flat_hash_map &operator=(flat_hash_map &&other) noexcept {
+    using std::swap;
+    swap(alloc, other.alloc);
+    swap(_capacity, other._capacity);
+    swap(_size, other._size);
+    swap(_ctrl, other._ctrl);
+    swap(_slots, other._slots);
+    return *this;
+  }
+
+  Allocator get_allocator() const { return alloc; }
+
+  // iterators
+  iterator begin() { return iterator{this, skip_empty(0)}; }
+  const_iterator begin() const { return const_iterator{this, skip_empty(0)}; }
+  iterator end() { return iterator{this, _capacity}; }
+  const_iterator end() const { return const_iterator{this, _capacity}; }
+
+  // capacity
+  bool empty() const { return _size == 0; }
+  size_t size() const { return _size; }
+
+  // modifiers
+  void clear();
+  std::pair<iterator, bool> insert(const _value_type &val) {
+    return emplace(val);
+  }
+  std::pair<iterator, bool> insert(_value_type &&val) {
+    return emplace(std::move(val));
+  }
+  /// Like \ref node_hash_map::emplace(), this assigns the value if the
+  /// key already exists.
+  template <typename... Args> std::pair<iterator, bool> emplace(Args &&...args);
+  template <std::equality_comparable_with<K> _K, typename... Args>
+  std::pair<iterator, bool> try_emplace(_K &&key, Args &&...args);
+  /// Unlike \ref node_hash_map::erase(), this doesn't return the next
+  /// iterator, since erasure may move elements.
+  void erase(const_iterator pos) { erase_slot(pos.idx); }
+  template <std::equality_comparable_with<K> _K> size_t erase(_K &&key) {
+    if (const size_t idx = find_slot(key, hash_of(key)); idx != npos) {
+      erase_slot(idx);
+      return 1;
+    }
+    return 0;
+  }
+
+  // lookup
+  template <std::equality_comparable_with<K> _K> V &at(_K &&key) {
+    const size_t idx = find_slot(key, hash_of(key));
+    ASSERT(idx != npos);
+    return _slots[idx].second;
+  }
+  template <std::equality_comparable_with<K> _K> const V &at(_K &&key) const {
+    const size_t idx = find_slot(key, hash_of(key));
+    ASSERT(idx != npos);
+    return _slots[idx].second;
+  }
+  template <std::equality_comparable_with<K> _K> V &operator[](_K &&key) {
+    auto [it, _] = try_emplace(std::forward<_K>(key));
+    return it->second;
+  }
+  template <std::equality_comparable_with<K> _K> size_t count(_K &&key) const {
+    return size_t(contains(std::forward<_K>(key)));
+  }
+  template <std::equality_comparable_with<K> _K> iterator find(_K &&key) {
+    const size_t idx = find_slot(key, hash_of(key));
+    return idx == npos ? end() : iterator{this, idx};
+  }
+  template <std::equality_comparable_with<K> _K>
+  const_iterator find(_K &&key) const {
+    const size_t idx = find_slot(key, hash_of(key));
+    return idx == npos ? end() : const_iterator{this, idx};
+  }
+  template <std::equality_comparable_with<K> _K> bool contains(_K &&key) const {
+    return find_slot(key, hash_of(key)) != npos;
+  }
+
+  // bucket interface
+  size_t bucket_count() const { return _capacity; }
+
+  // hash policy
+  /// Grow to at least \a count slots (a power of two).
+  void rehash(size_t count);
+  /// Grow so that \a count elements fit without rehashing.
+  void reserve(size_t count) { rehash(count + count / 3); }
+
+private:
+  /// The maximum load factor is 3/4. Linear probing degrades quickly
+  /// beyond this, and erasure has to rehash the rest of the probe
+  /// sequence.
+  static constexpr bool over_max_load(size_t size, size_t capacity) {
+    return 4 * size > 3 * capacity;
+  }
+  static constexpr size_t min_capacity = 16;
+  static_assert(min_capacity >= Group::width);
+  static constexpr size_t npos = -1;
+
+  template <typename U> class IterImpl {
+  public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = U;
+    using pointer = value_type *;
+    using reference = value_type &;
+    using iterator_category = std::forward_iterator_tag;
+
+    // std::input_or_output_iterator
+    value_type &operator*() const { return map->slot(idx); }
+    value_type *operator->() const { return &map->slot(idx); }
+
+    // std::forward_iterator
+    IterImpl() = default;
+    bool operator==(IterImpl other) const {
+      return map == other.map && idx == other.idx;
+    }
+    IterImpl &operator++() {
+      idx = map->skip_empty(idx + 1);
+      return *this;
+    }
+    IterImpl operator++(int) {
+      IterImpl rv = *this;
+      ++*this;
+      return rv;
+    }
+
+    // implicit const_iterator conversion
+    operator auto() const { return IterImpl<const U>{map, idx}; }
+
+  private:
+    using Map = std::conditional_t<std::is_const_v<U>, const flat_hash_map,
+                                   flat_hash_map>;
+    friend class IterImpl<std::remove_const_t<U>>;
+    friend class flat_hash_map;
+
+    IterImpl(Map *_map, size_t _idx) : map{_map}, idx{_idx} {}
+    Map *map = nullptr;
+    size_t idx = 0;
+  };
+  static_assert(std::forward_iterator<iterator>);
+  static_assert(std::forward_iterator<const_iterator>);
+
+  template <typename _K> static size_t hash_of(_K &&key) {
+    return _flat_hash_map::mix(hash<std::remove_reference_t<_K>>{}(key));
+  }
+  static size_t h1(size_t hash) { return hash >> 7; }
+  static ctrl_t h2(size_t hash) { return hash & 0x7F; }
+
+  _value_type &slot(size_t idx) {
+    return *std::launder(reinterpret_cast<_value_type *>(&_slots[idx]));
+  }
+  const _value_type &slot(size_t idx) const {
+    return *std::launder(reinterpret_cast<const _value_type *>(&_slots[idx]));
+  }
+  bool is_full(size_t idx) const { return _ctrl[idx] >= 0; }
+  size_t skip_empty(size_t idx) const {
+    while (idx < _capacity && !is_full(idx)) {
+      ++idx;
+    }
+    return idx;
+  }
+  /// Also updates the cloned control byte, if any.
+  void set_ctrl(size_t idx, ctrl_t ctrl) {
+    _ctrl[idx] = ctrl;
+    if (idx < Group::width - 1) {
+      _ctrl[_capacity + idx] = ctrl;
+    }
+  }
+
+  /// \return the index of \a key, or \ref npos.
+  template <typename _K> size_t find_slot(const _K &key, size_t hash) const;
+  /// Returns the first empty slot in the probe sequence of \a hash.
+  /// There must be one.
+  size_t find_empty(size_t hash) const;
+  void erase_slot(size_t idx);
+  /// Make room for one more element.
+  void grow() {
+    if (_capacity == 0 || over_max_load(_size + 1, _capacity)) {
+      rehash(std::max(2 * _capacity, min_capacity));
+    }
+  }
+  void deallocate() {
+    if (_capacity != 0) {
+      CtrlAllocator{alloc}.deallocate(_ctrl, _capacity + Group::width - 1);
+      SlotAllocator{alloc}.deallocate(_slots, _capacity);
+    }
+  }
+
+  [[no_unique_address]] Allocator alloc;
+  /// A power of two, or 0 if nothing is allocated.
+  size_t _capacity = 0;
+  size_t _size = 0;
+  ctrl_t *_ctrl = nullptr;
+  slot_type *_slots = nullptr;
+};
+
+// non-member functions
+template <typename K, typename V, typename A>
+bool operator==(const flat_hash_map<K, V, A> &lhs,
+                const flat_hash_map<K, V, A> &rhs) {
+  return lhs.size() == rhs.size() &&
+         std::all_of(lhs.begin(), lhs.end(), [&rhs](auto &kv) {
+           auto it = rhs.find(kv.first);
+           return it != rhs.end() && it->second == kv.second;
+         });
+}
+
+// template function definitions
+template <typename K, typename V, typename Allocator>
+void flat_hash_map<K, V, Allocator>::clear() {
+  for (size_t idx = 0; idx < _capacity; ++idx) {
+    if (is_full(idx)) {
+      _slots[idx].~slot_type();
+      set_ctrl(idx, _flat_hash_map::ctrl_empty);
+    }
+  }
+  _size = 0;
+}
+
+template <typename K, typename V, typename Allocator>
+template <typename... Args>
+auto flat_hash_map<K, V, Allocator>::emplace(Args &&...args)
+    -> std::pair<iterator, bool> {
+  slot_type val(std::forward<Args>(args)...);
+  const size_t hash = hash_of(val.first);
+  if (const size_t idx = find_slot(val.first, hash); idx != npos) {
+    _slots[idx].second = std::move(val.second);
+    return {iterator{this, idx}, false};
+  }
+
+  grow();
+  const size_t idx = find_empty(hash);
+  ::new (&_slots[idx]) slot_type(std::move(val));
+  set_ctrl(idx, h2(hash));
+  ++_size;
+  return {iterator{this, idx}, true};
+}
+
+template <typename K, typename V, typename Allocator>
+template <std::equality_comparable_with<K> _K, typename... Args>
+auto flat_hash_map<K, V, Allocator>::try_emplace(_K &&key, Args &&...args)
+    -> std::pair<iterator, bool> {
+  const size_t hash = hash_of(key);
+  if (const size_t idx = find_slot(key, hash); idx != npos) {
+    return {iterator{this, idx}, false};
+  }
+
+  grow();
+  const size_t idx = find_empty(hash);
+  ::new (&_slots[idx])
+      slot_type(std::piecewise_construct_t{},
+                std::forward_as_tuple(std::forward<_K>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...));
+  set_ctrl(idx, h2(hash));
+  ++_size;
+  return {iterator{this, idx}, true};
+}
+
+template <typename K, typename V, typename Allocator>
+template <typename _K>
+size_t flat_hash_map<K, V, Allocator>::find_slot(const _K &key,
+                                                 size_t hash) const {
+  if (_capacity == 0) {
+    return npos;
+  }
+  const size_t mask = _capacity - 1;
+  for (size_t pos = h1(hash) & mask;; pos = (pos + Group::width) & mask) {
+    const Group group{&_ctrl[pos]};
+    for (const unsigned i : group.match(h2(hash))) {
+      const size_t idx = (pos + i) & mask;
+      if (key == _slots[idx].first) {
+        return idx;
+      }
+    }
+    // Elements are never placed after an empty slot in their probe
+    // sequence.
+    if (group.match_empty()) {
+      return npos;
+    }
+  }
+}
+
+template <typename K, typename V, typename Allocator>
+size_t flat_hash_map<K, V, Allocator>::find_empty(size_t hash) const {
+  const size_t mask = _capacity - 1;
+  for (size_t pos = h1(hash) & mask;; pos = (pos + Group::width) & mask) {
+    if (const auto empty = Group{&_ctrl[pos]}.match_empty()) {
+      return (pos + empty.lowest()) & mask;
+    }
+  }
+}
+
+template <typename K, typename V, typename Allocator>
+void flat_hash_map<K, V, Allocator>::erase_slot(size_t idx) {
+  ASSERT(idx < _capacity && is_full(idx));
+  _slots[idx].~slot_type();
+  set_ctrl(idx, _flat_hash_map::ctrl_empty);
+  --_size;
+
+  // Backward-shift deletion: move later elements in the same run of
+  // full slots into the hole, unless that would put them before their
+  // home slot. This restores the invariant that there are no empty
+  // slots between an element and its home slot.
+  const size_t mask = _capacity - 1;
+  for (size_t hole = idx, next = (idx + 1) & mask; is_full(next);
+       next = (next + 1) & mask) {
+    const size_t home = h1(hash_of(_slots[next].first)) & mask;
+    if (((next - home) & mask) < ((next - hole) & mask)) {
+      continue;
+    }
+    ::new (&_slots[hole]) slot_type(std::move(_slots[next]));
+    _slots[next].~slot_type();
+    set_ctrl(hole, _ctrl[next]);
+    set_ctrl(next, _flat_hash_map::ctrl_empty);
+    hole = next;
+  }
+}
+
+template <typename K, typename V, typename Allocator>
+void flat_hash_map<K, V, Allocator>::rehash(size_t count) {
+  if (_capacity == 0 && count == 0) {
+    return;
+  }
+  size_t capacity = std::max(_capacity, min_capacity);
+  while (capacity < count || over_max_load(_size, capacity)) {
+    capacity *= 2;
+  }
+  if (capacity == _capacity) {
+    return;
+  }
+
+  flat_hash_map tmp(alloc);
+  tmp._capacity = capacity;
+  tmp._ctrl = CtrlAllocator{alloc}.allocate(tmp._capacity + Group::width - 1);
+  tmp._slots = SlotAllocator{alloc}.allocate(tmp._capacity);
+  std::fill_n(tmp._ctrl, tmp._capacity + Group::width - 1,
+              _flat_hash_map::ctrl_empty);
+  for (size_t idx = 0; idx < _capacity; ++idx) {
+    if (is_full(idx)) {
+      const size_t hash = hash_of(_slots[idx].first);
+      const size_t new_idx = tmp.find_empty(hash);
+      ::new (&tmp._slots[new_idx]) slot_type(std::move(_slots[idx]));
+      tmp.set_ctrl(new_idx, h2(hash));
+      ++tmp._size;
+    }
+  }
+  *this = std::move(tmp);
+}
+
+} // namespace nonstd
@@ -1,61 +1,69 @@
 #include "nonstd/hash_bytes.h"
-#include "libc_minimal.h"
 
 namespace {
 
-// https://github.com/martinus/robin-hood-hashing/issues/36
-template <typename T> T unaligned_load(void const *ptr) noexcept {
-  // using memcpy so we don't get into unaligned load problems.
-  // compiler should optimize this very well anyways.
-  T t;
-  nonstd::memcpy(&t, ptr, sizeof(T));
-  return t;
+constexpr uint32_t prime1 = 0x9E3779B1U;
+constexpr uint32_t prime2 = 0x85EBCA77U;
+constexpr uint32_t prime3 = 0xC2B2AE3DU;
+constexpr uint32_t prime4 = 0x27D4EB2FU;
+constexpr uint32_t prime5 = 0x165667B1U;
+
+/// A plain unaligned load rather than memcpy(), which is an indirect
+/// call (see nonstd::memops) that the compiler can't inline.
+uint32_t load_u32(const uint8_t *ptr) {
+  using unaligned_u32 = uint32_t __attribute__((may_alias, aligned(1)));
+  return *reinterpret_cast<const unaligned_u32 *>(ptr);
+}
+
+uint32_t rotl(uint32_t x, unsigned r) { return (x << r) | (x >> (32 - r)); }
+
+uint32_t xxh_round(uint32_t acc, uint32_t word) {
+  return rotl(acc + word * prime2, 13) * prime1;
 }
 
 } // namespace
 
 namespace nonstd {
 
-// Implementation of Murmur hash for 32-bit size_t.
-// Copied from libsupcxx
+// xxHash32 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md).
 size_t hash_bytes(const void *ptr, size_t len, size_t seed) {
-  const size_t m = 0x5bd1e995;
-  size_t hash = seed ^ len;
-  const char *buf = static_cast<const char *>(ptr);
-
-  // Mix 4 bytes at a time into the hash.
-  while (len >= 4) {
-    size_t k = unaligned_load<size_t>(buf);
-    k *= m;
-    k ^= k >> 24;
-    k *= m;
-    hash *= m;
-    hash ^= k;
-    buf += 4;
-    len -= 4;
+  static_assert(sizeof(size_t) == sizeof(uint32_t));
+  const auto *buf = static_cast<const uint8_t *>(ptr);
+  const uint8_t *const end = buf + len;
+  uint32_t hash;
+
+  // Mix 16 bytes at a time into four independent accumulators.
+  if (len >= 16) {
+    uint32_t v1 = seed + prime1 + prime2;
+    uint32_t v2 = seed + prime2;
+    uint32_t v3 = seed;
+    uint32_t v4 = seed - prime1;
+    for (; end - buf >= 16; buf += 16) {
+      v1 = xxh_round(v1, load_u32(buf));
+      v2 = xxh_round(v2, load_u32(buf + 4));
+      v3 = xxh_round(v3, load_u32(buf + 8));
+      v4 = xxh_round(v4, load_u32(buf + 12));
+    }
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+  } else {
+    hash = seed + prime5;
   }
+  hash += len;
 
-  size_t k;
-  // Handle the last few bytes of the input array.
-  switch (len) {
-  case 3:
-    k = static_cast<unsigned char>(buf[2]);
-    hash ^= k << 16;
-    [[fallthrough]];
-  case 2:
-    k = static_cast<unsigned char>(buf[1]);
-    hash ^= k << 8;
-    [[fallthrough]];
-  case 1:
-    k = static_cast<unsigned char>(buf[0]);
-    hash ^= k;
-    hash *= m;
-  };
-
-  // Do a few final mixes of the hash.
-  hash ^= hash >> 13;
-  hash *= m;
+  // Mix the remaining words, then bytes.
+  for (; end - buf >= 4; buf += 4) {
+    hash = rotl(hash + load_u32(buf) * prime3, 17) * prime4;
+  }
+  for (; buf < end; ++buf) {
+    hash = rotl(hash + *buf * prime5, 11) * prime1;
+  }
+
+  // Avalanche.
   hash ^= hash >> 15;
+  hash *= prime2;
+  hash ^= hash >> 13;
+  hash *= prime3;
+  hash ^= hash >> 16;
   return hash;
 }
 
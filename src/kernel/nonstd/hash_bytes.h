@@ -7,8 +7,8 @@
 
 namespace nonstd {
 
-// Implementation of Murmur hash for 32-bit size_t.
-// Copied from libsupcxx
+// xxHash32. This reads a word at a time, and four words at a time for
+// inputs of at least 16 bytes.
 size_t hash_bytes(const void *ptr, size_t len, size_t seed = 0xc70f6907UL);
 
 // Hash specializations
@@ -13,9 +13,13 @@ namespace nonstd {
 ///
 /// I thought I was clever with the end iterators but it turns out I
 /// re-re-discovered circular linked lists.
-template <typename T> class list {
+///
+/// The allocator is copied along with the elements on copy, and moves
+/// with them on move and swap. Splicing requires both lists to use
+/// the same memory.
+template <typename T, typename Allocator = Mallocator<T>> class list {
   struct Node;
-  using Allocator = Mallocator<Node>;
+  using NodeAllocator = rebind_alloc<Allocator, Node>;
   template <typename U> class IterImpl;
 
 public:
@@ -25,15 +29,24 @@ public:
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   list() = default;
-  explicit list(size_t count) { insert(end(), count, T{}); }
-  list(size_t count, const T &value) { insert(end(), count, value); }
-  template <std::input_iterator InputIt> list(InputIt first, InputIt last) {
+  explicit list(const Allocator &_alloc) : alloc{_alloc} {}
+  explicit list(size_t count, const Allocator &_alloc = {}) : alloc{_alloc} {
+    insert(end(), count, T{});
+  }
+  list(size_t count, const T &value, const Allocator &_alloc = {})
+      : alloc{_alloc} {
+    insert(end(), count, value);
+  }
+  template <std::input_iterator InputIt>
+  list(InputIt first, InputIt last, const Allocator &_alloc = {})
+      : alloc{_alloc} {
     insert(end(), first, last);
   }
 
-  list(const list &other) : list(other.begin(), other.end()) {}
+  list(const list &other) : list(other.begin(), other.end(), other.alloc) {}
   list(list &&other) { *this = std::move(other); }
-  list(std::initializer_list<T> init) : list(init.begin(), init.end()) {}
+  list(std::initializer_list<T> init, const Allocator &_alloc = {})
+      : list(init.begin(), init.end(), _alloc) {}
 
   ~list() { clear(); }
 
@@ -42,6 +55,7 @@ public:
     return *this;
   }
   list &operator=(list &&other) {
+    std::swap(alloc, other.alloc);
     std::swap(_size, other._size);
     // This is tricky: save these since we'll overwrite _back on the
     // next swap if the list is empty.
@@ -53,6 +67,8 @@ public:
     return *this;
   }
 
+  Allocator get_allocator() const { return alloc; }
+
   // element access
   T &front() { return _front->val; }
   const T &front() const { return _front->val; }
@@ -130,7 +146,7 @@ public:
   iterator emplace(const_iterator pos, Args &&...args) {
     Node &next = *pos.node;
     Node *prev = next.prev;
-    auto *new_node = Allocator{}.allocate(1);
+    auto *new_node = NodeAllocator{alloc}.allocate(1);
     ::new (new_node) Node{std::forward<Args>(args)...};
     new_node->prev = prev;
     new_node->next = &next;
@@ -146,7 +162,7 @@ public:
     next.prev = cur.prev;
     cur.prev->next = &next;
     cur.~Node();
-    Allocator{}.deallocate(&cur, 1);
+    NodeAllocator{alloc}.deallocate(&cur, 1);
     --_size;
     return iterator{&next};
   }
@@ -261,19 +277,22 @@ private:
   Node *_back = end().node;
   Node *_front = _back;
   size_t _size = 0;
+  [[no_unique_address]] Allocator alloc;
 };
 
 // non-member functions
-template <typename T> bool operator==(const list<T> &lhs, const list<T> &rhs) {
+template <typename T, typename A>
+bool operator==(const list<T, A> &lhs, const list<T, A> &rhs) {
   return lhs.size() == rhs.size() &&
          std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
 }
 
 // template function definitions
-template <typename T>
-inline void list<T>::splice_impl(const_iterator pos, list &other,
-                                 const_iterator first, const_iterator last,
-                                 typename const_iterator::difference_type n) {
+template <typename T, typename Allocator>
+inline void
+list<T, Allocator>::splice_impl(const_iterator pos, list &other,
+                                const_iterator first, const_iterator last,
+                                typename const_iterator::difference_type n) {
   // These nodes might be overwritten by swaps.
   auto *prev = pos.node->prev;
   auto *first_prev = first.node->prev;
@@ -0,0 +1,254 @@
+#include "nonstd/memops.h"
+#include "cpuid.h"
+#include "libc_minimal.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace nonstd::memops {
+
+namespace {
+
+/// For unaligned word accesses.
+using uword = uint32_t __attribute__((may_alias, aligned(1)));
+
+/// Hides \a p from the optimizer, so that it doesn't turn the loops
+/// below back into (recursive) calls to memcpy() or memmove().
+template <typename T> void opaque(T *&p) { __asm__("" : "+r"(p)); }
+
+/// Replicates the low byte of \a c into each byte of a word.
+uint32_t splat(int c) { return uint8_t(c) * 0x01010101u; }
+
+bool always() { return true; }
+
+////////////////////////////////////////////////////////////////////////////////
+// Byte-by-byte (the old implementation, for comparison)
+////////////////////////////////////////////////////////////////////////////////
+
+void *memcpy_byte(void *dest, const void *src, size_t n) {
+  auto *d = reinterpret_cast<uint8_t *>(dest);
+  const auto *s = reinterpret_cast<const uint8_t *>(src);
+  for (; n > 0; --n) {
+    opaque(d);
+    *d++ = *s++;
+  }
+  return dest;
+}
+
+void *memset_byte(void *dest, int c, size_t n) {
+  auto *d = reinterpret_cast<uint8_t *>(dest);
+  for (; n > 0; --n) {
+    opaque(d);
+    *d++ = c;
+  }
+  return dest;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// rep movsd/stosd
+////////////////////////////////////////////////////////////////////////////////
+
+void *memcpy_movsd(void *dest, const void *src, size_t n) {
+  void *const ret = dest;
+  size_t dwords = n / 4;
+  __asm__ volatile("rep movsl\n\t"
+                   "mov %3, %%ecx\n\t"
+                   "rep movsb"
+                   : "+D"(dest), "+S"(src), "+c"(dwords)
+                   : "r"(n % 4)
+                   : "memory");
+  return ret;
+}
+
+void *memset_stosd(void *dest, int c, size_t n) {
+  void *const ret = dest;
+  size_t dwords = n / 4;
+  __asm__ volatile("rep stosl\n\t"
+                   "mov %3, %%ecx\n\t"
+                   "rep stosb"
+                   : "+D"(dest), "+c"(dwords)
+                   : "a"(splat(c)), "r"(n % 4)
+                   : "memory");
+  return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// ERMS rep movsb/stosb
+////////////////////////////////////////////////////////////////////////////////
+
+void *memcpy_movsb(void *dest, const void *src, size_t n) {
+  void *const ret = dest;
+  __asm__ volatile("rep movsb"
+                   : "+D"(dest), "+S"(src), "+c"(n)
+                   :
+                   : "memory");
+  return ret;
+}
+
+void *memset_stosb(void *dest, int c, size_t n) {
+  void *const ret = dest;
+  __asm__ volatile("rep stosb" : "+D"(dest), "+c"(n) : "a"(c) : "memory");
+  return ret;
+}
+
+bool supports_erms() { return arch::cpuid::has_erms(); }
+
+////////////////////////////////////////////////////////////////////////////////
+// Non-temporal stores (MOVNTI)
+////////////////////////////////////////////////////////////////////////////////
+//
+// MOVNTI only takes general-purpose registers, so unlike the XMM
+// variants it doesn't require the kernel to save SSE state.
+
+/// Copies up to 3 bytes so that \a d is dword-aligned.
+size_t align_head(uint8_t *&d, const uint8_t *&s, size_t n) {
+  const size_t head = std::min<size_t>(-uintptr_t(d) % 4, n);
+  memcpy_movsd(d, s, head);
+  d += head;
+  s += head;
+  return n - head;
+}
+
+void *memcpy_movnti(void *dest, const void *src, size_t n) {
+  auto *d = reinterpret_cast<uint8_t *>(dest);
+  const auto *s = reinterpret_cast<const uint8_t *>(src);
+  n = align_head(d, s, n);
+  for (; n >= 16; n -= 16, d += 16, s += 16) {
+    uint32_t tmp;
+    __asm__ volatile("mov 0(%2), %0\n\t"
+                     "movnti %0, 0(%1)\n\t"
+                     "mov 4(%2), %0\n\t"
+                     "movnti %0, 4(%1)\n\t"
+                     "mov 8(%2), %0\n\t"
+                     "movnti %0, 8(%1)\n\t"
+                     "mov 12(%2), %0\n\t"
+                     "movnti %0, 12(%1)"
+                     : "=&r"(tmp)
+                     : "r"(d), "r"(s)
+                     : "memory");
+  }
+  memcpy_movsd(d, s, n);
+  // Non-temporal stores are weakly-ordered.
+  __asm__ volatile("sfence" : : : "memory");
+  return dest;
+}
+
+void *memset_movnti(void *dest, int c, size_t n) {
+  auto *d = reinterpret_cast<uint8_t *>(dest);
+  const size_t head = std::min<size_t>(-uintptr_t(d) % 4, n);
+  memset_stosd(d, c, head);
+  d += head;
+  n -= head;
+  const uint32_t val = splat(c);
+  for (; n >= 16; n -= 16, d += 16) {
+    __asm__ volatile("movnti %1, 0(%0)\n\t"
+                     "movnti %1, 4(%0)\n\t"
+                     "movnti %1, 8(%0)\n\t"
+                     "movnti %1, 12(%0)"
+                     :
+                     : "r"(d), "r"(val)
+                     : "memory");
+  }
+  memset_stosd(d, c, n);
+  __asm__ volatile("sfence" : : : "memory");
+  return dest;
+}
+
+bool supports_nt() { return arch::cpuid::has_sse2(); }
+
+constexpr Impl impl_table[] = {
+    {"byte", memcpy_byte, memset_byte, always},
+    {"rep movsd", memcpy_movsd, memset_stosd, always},
+    {"rep movsb (ERMS)", memcpy_movsb, memset_stosb, supports_erms},
+    {"movnti", memcpy_movnti, memset_movnti, supports_nt},
+};
+
+const Impl *impl = &impl_table[1];
+const Impl *impl_large = &impl_table[1];
+const Impl *impl_nt = &impl_table[1];
+
+} // namespace
+
+std::span<const Impl> impls() { return impl_table; }
+
+void select() {
+  impl = supports_erms() ? &impl_table[2] : &impl_table[1];
+  impl_nt = supports_nt() ? &impl_table[3] : impl;
+  impl_large = impl_nt;
+}
+
+const Impl &selected() { return *impl; }
+
+const Impl &selected_large() { return *impl_large; }
+
+void *memset_nt(void *s, int c, size_t n) { return impl_nt->memset(s, c, n); }
+
+} // namespace nonstd::memops
+
+namespace nonstd {
+
+using memops::impl;
+using memops::impl_large;
+using memops::nt_threshold;
+using memops::opaque;
+using memops::uword;
+
+extern "C" {
+
+void *memcpy(void *dest, const void *src, size_t n) {
+  return (n < nt_threshold ? impl : impl_large)->memcpy(dest, src, n);
+}
+
+void *memset(void *s, int c, size_t n) {
+  return (n < nt_threshold ? impl : impl_large)->memset(s, c, n);
+}
+
+void *memmove(void *dest, const void *src, size_t n) {
+  auto *d = reinterpret_cast<uint8_t *>(dest);
+  const auto *s = reinterpret_cast<const uint8_t *>(src);
+  if (s + n <= d || d + n <= s) {
+    return memcpy(dest, src, n);
+  }
+  if (d <= s) {
+    // The string instructions copy forwards, which is safe if the
+    // destination comes first.
+    return impl->memcpy(dest, src, n);
+  }
+
+  // Copy backwards. We don't use `std; rep movsb` since the string
+  // instructions are slow with the direction flag set.
+  d += n;
+  s += n;
+  for (; n >= 4; n -= 4) {
+    opaque(d);
+    d -= 4;
+    s -= 4;
+    *reinterpret_cast<uword *>(d) = *reinterpret_cast<const uword *>(s);
+  }
+  for (; n > 0; --n) {
+    opaque(d);
+    *--d = *--s;
+  }
+  return dest;
+}
+
+int memcmp(const void *s1, const void *s2, size_t n) {
+  const auto *p1 = reinterpret_cast<const uint8_t *>(s1);
+  const auto *p2 = reinterpret_cast<const uint8_t *>(s2);
+  // Skip over equal words. The words are compared for equality only,
+  // so endianness doesn't matter; the first differing byte is found
+  // below.
+  for (; n >= 4 && *reinterpret_cast<const uword *>(p1) ==
+                       *reinterpret_cast<const uword *>(p2);
+       n -= 4, p1 += 4, p2 += 4) {
+  }
+  for (; n > 0; --n, ++p1, ++p2) {
+    if (*p1 != *p2) {
+      return *p1 < *p2 ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+} // extern "C"
+
+} // namespace nonstd
@@ -0,0 +1,60 @@
+#pragma once
+
+/// \file
+/// \brief Implementations of memcpy() and memset(), selected on boot.
+///
+/// memcpy(), memset(), memmove() and memcmp() (declared in
+/// libc_minimal.h) are hot: the compiler emits calls to them for
+/// struct copies and zero-initialization, and the kernel uses them
+/// to copy pages, buffers and strings. There are several ways to
+/// implement them on x86, and which is fastest depends on the CPU and
+/// on the size of the operation:
+///
+/// - `rep movsd`/`rep stosd` work everywhere.
+/// - `rep movsb`/`rep stosb` are at least as fast on CPUs with
+///   Enhanced REP MOVSB (ERMS), and don't need a separate tail loop.
+/// - Non-temporal stores (MOVNTI, with SSE2) bypass the cache. These
+///   are slower for small buffers, but large copies would otherwise
+///   evict the whole cache.
+///
+/// \ref select() picks an implementation once based on CPUID. \ref
+/// impls() exposes all of them for testing and benchmarking.
+
+#include <cstddef>
+#include <span>
+
+namespace nonstd::memops {
+
+struct Impl {
+  const char *name;
+  void *(*memcpy)(void *dest, const void *src, size_t n);
+  void *(*memset)(void *s, int c, size_t n);
+  /// Whether the current CPU supports this implementation.
+  bool (*supported)();
+};
+
+/// All implementations, starting with the byte-by-byte baseline.
+std::span<const Impl> impls();
+
+/// memcpy() and memset() of at least this many bytes use non-temporal
+/// stores, if supported. This is on the order of the L2 cache size,
+/// beyond which the destination likely wouldn't stay in the cache
+/// anyways.
+constexpr size_t nt_threshold = 256 * 1024;
+
+/// Select the implementations for this CPU. Until this is called,
+/// the `rep movsd` implementation is used, which works on any x86.
+void select();
+
+/// The implementation used below \ref nt_threshold.
+const Impl &selected();
+
+/// The implementation used at or above \ref nt_threshold.
+const Impl &selected_large();
+
+/// memset() with non-temporal stores regardless of \ref nt_threshold,
+/// for memory that won't be read soon (e.g., pre-zeroed pages). Falls
+/// back to \ref selected() if the CPU doesn't support MOVNTI (SSE2).
+void *memset_nt(void *s, int c, size_t n);
+
+} // namespace nonstd::memops
@@ -0,0 +1,128 @@
+#include "nonstd/memory_resource.h"
+#include "nonstd/allocator.h"
+#include <algorithm>
+
+namespace nonstd {
+
+namespace {
+
+/// The first chunk allocated by a \ref MonotonicArena without enough
+/// space in its buffer.
+constexpr size_t min_chunk_size = 256;
+
+class HeapResource final : public MemoryResource {
+  void *do_allocate(size_t bytes, size_t) final {
+    return Mallocator<std::byte>{}.allocate(bytes);
+  }
+  void do_deallocate(void *ptr, size_t bytes, size_t) final {
+    Mallocator<std::byte>{}.deallocate(static_cast<std::byte *>(ptr), bytes);
+  }
+};
+
+constinit HeapResource heap;
+
+std::byte *align_up(std::byte *ptr, size_t align) {
+  ASSERT((align & (align - 1)) == 0);
+  return reinterpret_cast<std::byte *>(
+      (reinterpret_cast<uintptr_t>(ptr) + align - 1) & ~(align - 1));
+}
+
+size_t ceil_multiple(size_t n, size_t m) { return (n + m - 1) / m * m; }
+
+} // namespace
+
+MemoryResource *heap_resource() { return &heap; }
+
+////////////////////////////////////////////////////////////////////////////////
+// MonotonicArena
+////////////////////////////////////////////////////////////////////////////////
+
+MonotonicArena::MonotonicArena(std::span<std::byte> buffer,
+                               MemoryResource *_upstream)
+    : upstream{_upstream}, initial{buffer}, cur{buffer.data()},
+      end{buffer.data() + buffer.size()},
+      next_chunk_size{std::max(min_chunk_size, buffer.size())} {}
+
+void MonotonicArena::release() {
+  while (chunks != nullptr) {
+    Chunk *const chunk = chunks;
+    chunks = chunk->next;
+    upstream->deallocate(chunk, chunk->size, alignof(Chunk));
+  }
+  cur = initial.data();
+  end = initial.data() + initial.size();
+  next_chunk_size = std::max(min_chunk_size, initial.size());
+}
+
+void *MonotonicArena::bump(size_t bytes, size_t align) {
+  std::byte *const ptr = align_up(cur, align);
+  if (ptr > end || size_t(end - ptr) < bytes) {
+    return nullptr;
+  }
+  cur = ptr + bytes;
+  return ptr;
+}
+
+void *MonotonicArena::do_allocate(size_t bytes, size_t align) {
+  if (void *const ptr = bump(bytes, align)) {
+    return ptr;
+  }
+
+  const size_t size = std::max(next_chunk_size, sizeof(Chunk) + bytes + align);
+  auto *const chunk =
+      static_cast<Chunk *>(upstream->allocate(size, alignof(Chunk)));
+  *chunk = {.next = chunks, .size = size};
+  chunks = chunk;
+  cur = reinterpret_cast<std::byte *>(chunk + 1);
+  end = reinterpret_cast<std::byte *>(chunk) + size;
+  next_chunk_size = 2 * size;
+  return bump(bytes, align);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// FixedPool
+////////////////////////////////////////////////////////////////////////////////
+
+FixedPool::FixedPool(size_t _block_size, std::span<std::byte> buffer,
+                     MemoryResource *_upstream)
+    : upstream{_upstream},
+      block_size{ceil_multiple(std::max(_block_size, sizeof(FreeBlock)),
+                               alignof(FreeBlock))},
+      block_align{std::min(block_size & -block_size,
+                           alignof(std::max_align_t))} {
+  std::byte *const start = align_up(buffer.data(), block_align);
+  std::byte *const buffer_end = buffer.data() + buffer.size();
+  const size_t count =
+      start > buffer_end ? 0 : size_t(buffer_end - start) / block_size;
+  pool = {start, count * block_size};
+  // Push in reverse so that blocks are handed out in address order.
+  for (size_t i = count; i-- > 0;) {
+    auto *const block = reinterpret_cast<FreeBlock *>(start + i * block_size);
+    block->next = free_list;
+    free_list = block;
+  }
+  free_count = count;
+}
+
+void *FixedPool::do_allocate(size_t bytes, size_t align) {
+  if (bytes > block_size || align > block_align || free_list == nullptr) {
+    return upstream->allocate(bytes, align);
+  }
+  FreeBlock *const block = free_list;
+  free_list = block->next;
+  --free_count;
+  return block;
+}
+
+void FixedPool::do_deallocate(void *ptr, size_t bytes, size_t align) {
+  if (!owns(ptr)) {
+    upstream->deallocate(ptr, bytes, align);
+    return;
+  }
+  auto *const block = static_cast<FreeBlock *>(ptr);
+  block->next = free_list;
+  free_list = block;
+  ++free_count;
+}
+
+} // namespace nonstd
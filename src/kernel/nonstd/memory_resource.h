@@ -0,0 +1,162 @@
+#pragma once
+
+/// \file
+/// \brief Polymorphic memory resources for the nonstd containers.
+///
+/// The containers take an allocator template parameter, which
+/// defaults to \ref Mallocator (the kernel heap). A \ref
+/// PolymorphicAllocator instead forwards to a \ref MemoryResource
+/// chosen at runtime, like `std::pmr`. This lets short-lived work
+/// allocate from a \ref MonotonicArena (e.g. backed by a buffer on the
+/// stack) and free everything at once, or recycle equal-sized nodes
+/// through a \ref FixedPool.
+///
+/// ```
+/// std::byte buf[512];
+/// nonstd::MonotonicArena arena{buf};
+/// nonstd::vector<Extent, nonstd::PolymorphicAllocator<Extent>> extents{
+///     &arena};
+/// ```
+
+#include "util/assert.h"
+#include "util/objutil.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace nonstd {
+
+class MemoryResource {
+public:
+  virtual ~MemoryResource() = default;
+
+  void *allocate(size_t bytes, size_t align = alignof(std::max_align_t)) {
+    ++alloc_count;
+    void *const ptr = do_allocate(bytes, align);
+    ASSERT(ptr != nullptr);
+    return ptr;
+  }
+  void deallocate(void *ptr, size_t bytes,
+                  size_t align = alignof(std::max_align_t)) {
+    ++dealloc_count;
+    do_deallocate(ptr, bytes, align);
+  }
+
+  /// Number of calls to \ref allocate() and \ref deallocate(), for
+  /// leak checking (see the LeakChecker test fixture). These are
+  /// counted even if deallocation is a no-op.
+  uint64_t alloc_count = 0;
+  uint64_t dealloc_count = 0;
+
+protected:
+  virtual void *do_allocate(size_t bytes, size_t align) = 0;
+  virtual void do_deallocate(void *ptr, size_t bytes, size_t align) = 0;
+};
+
+/// The kernel heap, via \ref Mallocator. Note that the kernel heap
+/// doesn't honor alignment.
+MemoryResource *heap_resource();
+
+/// Bump-allocates from a buffer, and then from chunks of geometrically
+/// increasing size from an upstream resource once the buffer runs
+/// out. Deallocation is a no-op; everything is freed at once by \ref
+/// release() or on destruction.
+class MonotonicArena final : public MemoryResource {
+public:
+  explicit MonotonicArena(std::span<std::byte> buffer,
+                          MemoryResource *_upstream = heap_resource());
+  explicit MonotonicArena(MemoryResource *_upstream = heap_resource())
+      : MonotonicArena{{}, _upstream} {}
+  ~MonotonicArena() { release(); }
+
+  NON_MOVABLE(MonotonicArena);
+
+  /// Free all allocations, and start again from the initial buffer.
+  void release();
+
+  /// Bytes left in the current buffer or chunk.
+  size_t remaining() const { return end - cur; }
+
+private:
+  struct Chunk {
+    Chunk *next;
+    size_t size;
+  };
+
+  void *do_allocate(size_t bytes, size_t align) final;
+  void do_deallocate(void *, size_t, size_t) final {}
+  /// \return nullptr if the current buffer is too small.
+  void *bump(size_t bytes, size_t align);
+
+  MemoryResource *const upstream;
+  const std::span<std::byte> initial;
+  std::byte *cur;
+  std::byte *end;
+  /// Allocated from \ref upstream, most recent first.
+  Chunk *chunks = nullptr;
+  size_t next_chunk_size;
+};
+
+/// A pool of equal-sized blocks carved out of a buffer, kept on a
+/// free list. This suits node-based containers like \ref list, where
+/// every allocation is a single node. Allocations that don't fit in
+/// a block (in size or alignment) or that arrive when the pool is
+/// empty go to the upstream resource.
+class FixedPool final : public MemoryResource {
+public:
+  FixedPool(size_t _block_size, std::span<std::byte> buffer,
+            MemoryResource *_upstream = heap_resource());
+
+  NON_MOVABLE(FixedPool);
+
+  /// Number of free blocks in the pool.
+  size_t available() const { return free_count; }
+
+private:
+  struct FreeBlock {
+    FreeBlock *next;
+  };
+
+  void *do_allocate(size_t bytes, size_t align) final;
+  void do_deallocate(void *ptr, size_t bytes, size_t align) final;
+  bool owns(const void *ptr) const {
+    return ptr >= pool.data() && ptr < pool.data() + pool.size();
+  }
+
+  MemoryResource *const upstream;
+  const size_t block_size;
+  /// The largest power of two dividing \ref block_size, up to the
+  /// maximum fundamental alignment.
+  const size_t block_align;
+  std::span<std::byte> pool;
+  FreeBlock *free_list = nullptr;
+  size_t free_count = 0;
+};
+
+/// An allocator that forwards to a \ref MemoryResource. Like the
+/// resource pointer, this is copied along with the container's
+/// storage on copy, move and swap.
+template <typename T> class PolymorphicAllocator {
+public:
+  typedef T value_type;
+
+  PolymorphicAllocator() : _resource{heap_resource()} {}
+  PolymorphicAllocator(MemoryResource *r) : _resource{r} {}
+  template <typename U>
+  PolymorphicAllocator(const PolymorphicAllocator<U> &other) noexcept
+      : _resource{other.resource()} {}
+
+  [[nodiscard]] T *allocate(size_t n) {
+    return static_cast<T *>(_resource->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *p, size_t n) noexcept {
+    _resource->deallocate(p, n * sizeof(T), alignof(T));
+  }
+
+  MemoryResource *resource() const { return _resource; }
+
+private:
+  MemoryResource *_resource;
+};
+
+} // namespace nonstd
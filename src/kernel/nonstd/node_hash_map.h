@@ -14,44 +14,55 @@ namespace nonstd {
 
 /// Like absl::node_hash_map or std::unordered_map. This guarantees
 /// pointer/reference stability unlike absl::flat_hash_map.
-template <typename K, typename V> class node_hash_map {
+///
+/// The allocator is copied along with the elements on copy, and moves
+/// with them on move and swap.
+template <typename K, typename V,
+          typename Allocator = Mallocator<std::pair<const K, V>>>
+class node_hash_map {
   template <typename U> class IterImpl;
   struct Node;
   using _value_type = std::pair<const K, V>;
+  using NodeList = list<Node, rebind_alloc<Allocator, Node>>;
+  using node_iterator = typename NodeList::iterator;
+  using BucketAllocator = rebind_alloc<Allocator, node_iterator>;
 
 public:
   using iterator = IterImpl<Node>;
   using const_iterator = IterImpl<const Node>;
-  using Allocator = Mallocator<typename list<Node>::iterator>;
 
   node_hash_map() : node_hash_map(0) {}
-  node_hash_map(size_t bucket_count)
+  explicit node_hash_map(const Allocator &alloc) : node_hash_map(0, alloc) {}
+  node_hash_map(size_t bucket_count, const Allocator &alloc = {})
       : _bucket_count{next_bucket_count(bucket_count)},
-        _buckets{Allocator{}.allocate(_bucket_count)} {
+        _buckets{BucketAllocator{alloc}.allocate(_bucket_count)},
+        _data{alloc} {
     for (size_t i = 0; i < _bucket_count; ++i) {
       ::new (&_buckets[i]) node_iterator;
     }
   }
   template <std::input_iterator InputIt>
-  node_hash_map(InputIt first, InputIt last, size_t bucket_count = 0)
-      : node_hash_map{bucket_count} {
+  node_hash_map(InputIt first, InputIt last, size_t bucket_count = 0,
+                const Allocator &alloc = {})
+      : node_hash_map(bucket_count, alloc) {
     while (first != last) {
       insert(*first++);
     }
   }
   node_hash_map(std::initializer_list<_value_type> init,
-                size_t bucket_count = 0)
-      : node_hash_map{init.begin(), init.end(), bucket_count} {}
+                size_t bucket_count = 0, const Allocator &alloc = {})
+      : node_hash_map{init.begin(), init.end(), bucket_count, alloc} {}
 
   node_hash_map(const node_hash_map &other)
-      : node_hash_map{other.begin(), other.end()} {}
-  node_hash_map(node_hash_map &&other) noexcept : node_hash_map{} {
+      : node_hash_map{other.begin(), other.end(), 0, other.get_allocator()} {}
+  node_hash_map(node_hash_map &&other) noexcept
+      : node_hash_map(other.get_allocator()) {
     *this = std::move(other);
   }
 
   ~node_hash_map() {
     clear();
-    Allocator{}.deallocate(_buckets, _bucket_count);
+    BucketAllocator{get_allocator()}.deallocate(_buckets, _bucket_count);
   }
 
   node_hash_map &operator=(const node_hash_map &other) {
@@ -66,6 +77,8 @@ public:
     return *this;
   }
 
+  Allocator get_allocator() const { return _data.get_allocator(); }
+
   // iterators
   iterator begin() { return iterator{_data.begin()}; }
   const_iterator begin() const { return const_iterator{_data.begin()}; }
@@ -176,10 +189,9 @@ private:
     operator auto() const { return IterImpl<const U>{it}; }
 
   private:
-    using BaseIt = std::conditional_t<
-        std::is_const_v<U>,
-        typename list<std::remove_const_t<U>>::const_iterator,
-        typename list<U>::iterator>;
+    using BaseIt = std::conditional_t<std::is_const_v<U>,
+                                      typename NodeList::const_iterator,
+                                      typename NodeList::iterator>;
     friend class IterImpl<std::remove_const_t<U>>;
     friend class node_hash_map;
 
@@ -189,8 +201,6 @@ private:
   static_assert(std::forward_iterator<iterator>);
   static_assert(std::forward_iterator<const_iterator>);
 
-  using node_iterator = typename list<Node>::iterator;
-
   size_t get_bucket(size_t hash) const { return hash % _bucket_count; }
   bool same_bucket(node_iterator it, size_t bucket) const {
     return it != _data.end() && get_bucket(it->hash) == bucket;
@@ -201,13 +211,13 @@ private:
   size_t _bucket_count = 0;
   // TODO: use forward_list to save 4 bytes per element
   node_iterator *_buckets = nullptr;
-  list<Node> _data;
+  NodeList _data;
 };
 
 // non-member functions
-template <typename K, typename V>
-bool operator==(const node_hash_map<K, V> &lhs,
-                const node_hash_map<K, V> &rhs) {
+template <typename K, typename V, typename A>
+bool operator==(const node_hash_map<K, V, A> &lhs,
+                const node_hash_map<K, V, A> &rhs) {
   return lhs.size() == rhs.size() &&
          std::all_of(lhs.begin(), lhs.end(), [&rhs](auto &kv) {
            auto it = rhs.find(kv.first);
@@ -216,9 +226,10 @@ bool operator==(const node_hash_map<K, V> &lhs,
 }
 
 // template function definitions
-template <typename K, typename V>
+template <typename K, typename V, typename Allocator>
 template <typename... Args>
-auto node_hash_map<K, V>::emplace(Args &&...args) -> std::pair<iterator, bool> {
+auto node_hash_map<K, V, Allocator>::emplace(Args &&...args)
+    -> std::pair<iterator, bool> {
   // Note: this always constructs a node (even if it's not
   // inserted), AND it's always moved if it's inserted. It should be
   // constructed in-place to avoid the move (but we can't avoid the
@@ -248,9 +259,9 @@ auto node_hash_map<K, V>::emplace(Args &&...args) -> std::pair<iterator, bool> {
   return {iterator{rv}, true};
 }
 
-template <typename K, typename V>
+template <typename K, typename V, typename Allocator>
 template <std::equality_comparable_with<K> _K, typename... Args>
-auto node_hash_map<K, V>::try_emplace(_K &&key, Args &&...args)
+auto node_hash_map<K, V, Allocator>::try_emplace(_K &&key, Args &&...args)
     -> std::pair<iterator, bool> {
   const size_t _hash = hash<std::remove_reference_t<_K>>{}(key);
   const size_t idx = get_bucket(_hash);
@@ -276,8 +287,8 @@ auto node_hash_map<K, V>::try_emplace(_K &&key, Args &&...args)
   return {iterator{rv}, true};
 }
 
-template <typename K, typename V>
-auto node_hash_map<K, V>::erase(const_iterator pos) -> iterator {
+template <typename K, typename V, typename Allocator>
+auto node_hash_map<K, V, Allocator>::erase(const_iterator pos) -> iterator {
   const size_t idx = get_bucket(pos.it->hash);
   auto &bucket = _buckets[idx];
   ASSERT(bucket != node_iterator{});
@@ -292,9 +303,9 @@ auto node_hash_map<K, V>::erase(const_iterator pos) -> iterator {
   return iterator{_data.erase(pos.it)};
 }
 
-template <typename K, typename V>
+template <typename K, typename V, typename Allocator>
 template <std::equality_comparable_with<K> _K>
-auto node_hash_map<K, V>::find(_K &&key) -> iterator {
+auto node_hash_map<K, V, Allocator>::find(_K &&key) -> iterator {
   const size_t _hash =
       hash<std::remove_reference_t<_K>>{}(std::forward<_K>(key));
   const size_t idx = get_bucket(_hash);
@@ -310,9 +321,9 @@ auto node_hash_map<K, V>::find(_K &&key) -> iterator {
   return end();
 }
 
-template <typename K, typename V>
+template <typename K, typename V, typename Allocator>
 template <std::equality_comparable_with<K> _K>
-auto node_hash_map<K, V>::find(_K &&key) const -> const_iterator {
+auto node_hash_map<K, V, Allocator>::find(_K &&key) const -> const_iterator {
   const size_t _hash =
       hash<std::remove_reference_t<_K>>{}(std::forward<_K>(key));
   const size_t idx = get_bucket(_hash);
@@ -328,13 +339,13 @@ auto node_hash_map<K, V>::find(_K &&key) const -> const_iterator {
   return end();
 }
 
-template <typename K, typename V>
-void node_hash_map<K, V>::rehash(size_t count) {
+template <typename K, typename V, typename Allocator>
+void node_hash_map<K, V, Allocator>::rehash(size_t count) {
   if (count <= _bucket_count) {
     return;
   }
 
-  node_hash_map tmp{count};
+  node_hash_map tmp{count, get_allocator()};
   auto it = _data.begin();
   while (it != _data.end()) {
     const size_t idx = tmp.get_bucket(it->hash);
@@ -351,8 +362,9 @@ void node_hash_map<K, V>::rehash(size_t count) {
   *this = std::move(tmp);
 }
 
-template <typename K, typename V>
-constexpr size_t node_hash_map<K, V>::next_bucket_count(size_t min_buckets) {
+template <typename K, typename V, typename Allocator>
+constexpr size_t
+node_hash_map<K, V, Allocator>::next_bucket_count(size_t min_buckets) {
   // i = 16
   // while i < 2**32-1:
   //   while any(i*n==0 for n in range(2, int(ceil(sqrt(i))))): i+=1
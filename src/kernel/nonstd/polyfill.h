@@ -12,7 +12,7 @@ namespace nonstd {
 // <utility>, cpp23
 template <typename Enum>
 requires std::is_enum_v<Enum>
-auto to_underlying(Enum e) {
+constexpr auto to_underlying(Enum e) {
   return static_cast<std::underlying_type_t<Enum>>(e);
 }
 
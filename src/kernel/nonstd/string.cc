@@ -7,29 +7,49 @@
 
 namespace nonstd {
 
-string::string(size_t count, char ch)
-    : len{count}, _capacity{len}, _data{Allocator{}.allocate(_capacity + 1)} {
+string::string(size_t count, char ch, MemoryResource *resource)
+    : len{count}, _resource{resource} {
+  allocate(len);
   memset(_data, ch, len);
   _data[len] = '\0';
 }
 
 string::string(const char *s) : string{s, strlen(s)} {}
 
-string::string(const char *s, size_t count)
-    : len{count}, _capacity{len}, _data{Allocator{}.allocate(_capacity + 1)} {
+string::string(const char *s, size_t count, MemoryResource *resource)
+    : len{count}, _resource{resource} {
+  allocate(len);
   memcpy(_data, s, len);
   _data[len] = '\0';
 }
 
-string::string(string_view sv) : string{sv.data(), sv.length()} {}
+string::string(string_view sv, MemoryResource *resource)
+    : string{sv.data(), sv.length(), resource} {}
 
-string::string(const string &s) : string{s._data, s.len} {}
+string::string(const string &s) : string{s._data, s.len, s._resource} {}
 
 string::string(string &&s) noexcept { *this = std::move(s); }
 
-string::~string() {
-  if (_capacity != 0) {
-    Allocator{}.deallocate(_data, _capacity + 1);
+string::~string() { deallocate(); }
+
+void string::allocate(size_t capacity) {
+  ASSERT(is_local());
+  if (capacity > local_capacity) {
+    _data = _resource != nullptr
+                ? static_cast<char *>(_resource->allocate(capacity + 1, 1))
+                : Allocator{}.allocate(capacity + 1);
+    _capacity = capacity;
+  }
+}
+
+void string::deallocate() {
+  if (!is_local()) {
+    if (_resource != nullptr) {
+      _resource->deallocate(_data, _capacity + 1, 1);
+    } else {
+      Allocator{}.deallocate(_data, _capacity + 1);
+    }
+    _data = _local;
   }
 }
 
@@ -39,9 +59,25 @@ string &string::operator=(const string &s) {
 }
 
 string &string::operator=(string &&s) noexcept {
-  std::swap(len, s.len);
-  std::swap(_capacity, s._capacity);
-  std::swap(_data, s._data);
+  if (this == &s) {
+    return *this;
+  }
+  if (!s.is_local() || _resource != s._resource) {
+    deallocate();
+    _resource = s._resource;
+  }
+  if (s.is_local()) {
+    // Our capacity is at least the local capacity.
+    memcpy(_data, s._data, s.len + 1);
+  } else {
+    // Steal the allocation.
+    _data = s._data;
+    _capacity = s._capacity;
+    s._data = s._local;
+  }
+  len = s.len;
+  s.len = 0;
+  s._data[0] = '\0';
   return *this;
 }
 
@@ -68,21 +104,18 @@ const char &string::at(size_t pos) const {
 string::operator string_view() const { return {_data, len}; }
 
 void string::reserve(size_t new_capacity) {
-  if (new_capacity <= _capacity) {
+  if (new_capacity <= capacity()) {
     // No effect.
     return;
   }
   // We need to resize -- resize to at least double the current
   // capacity for O(1) amortized insertion.
-  new_capacity = std::max(new_capacity, _capacity * 2);
-  char *const old_data = _data;
-  _data = Allocator{}.allocate(new_capacity + 1);
-  memcpy(_data, old_data, len);
-  _data[len] = '\0';
-  if (_capacity != 0) {
-    Allocator{}.deallocate(old_data, _capacity + 1);
-  }
-  _capacity = new_capacity;
+  new_capacity = std::max(new_capacity, capacity() * 2);
+  string tmp{_resource};
+  tmp.allocate(new_capacity);
+  memcpy(tmp._data, _data, len + 1);
+  tmp.len = len;
+  *this = std::move(tmp);
 }
 
 void string::push_back(char c) {
@@ -115,9 +148,9 @@ void string::resize(size_t count) {
 }
 
 void string::swap(string &s) {
-  std::swap(len, s.len);
-  std::swap(_capacity, s._capacity);
-  std::swap(_data, s._data);
+  string tmp{std::move(s)};
+  s = std::move(*this);
+  *this = std::move(tmp);
 }
 
 string operator+(const string &lhs, const string &rhs) {
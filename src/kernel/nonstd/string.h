@@ -2,11 +2,18 @@
 
 #include "nonstd/allocator.h"
 #include "nonstd/hash_bytes.h"
+#include "nonstd/memory_resource.h"
 #include "nonstd/string_view.h"
 #include <cstddef>
 
 namespace nonstd {
 
+/// Strings of up to \ref local_capacity characters are stored inline
+/// (the small-string optimization), since most strings in the kernel
+/// are short, e.g. FAT 8.3 names. Longer strings are allocated,
+/// from the kernel heap unless a \ref MemoryResource is given. Like
+/// the allocator of the other containers, the resource is copied on
+/// copy and moves with the characters on move and swap.
 class string {
   using Allocator = Mallocator<char>;
   template <typename U> class IterImpl;
@@ -18,14 +25,17 @@ public:
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   static constexpr size_t npos = -1;
+  /// The capacity without allocating.
+  static constexpr size_t local_capacity = 15;
 
   string() = default;
-  string(size_t count, char ch);
+  explicit string(MemoryResource *resource) : _resource{resource} {}
+  string(size_t count, char ch, MemoryResource *resource = nullptr);
   template <std::input_iterator InputIt> string(InputIt first, InputIt last);
   string(const char *);
-  string(const char *, size_t count);
+  string(const char *, size_t count, MemoryResource *resource = nullptr);
   string(std::nullptr_t) = delete;
-  explicit string(string_view);
+  explicit string(string_view, MemoryResource *resource = nullptr);
   string(const string &);
   string(string &&) noexcept;
 
@@ -37,6 +47,11 @@ public:
   string &operator=(string_view);
   string &operator=(std::nullptr_t) = delete;
 
+  /// \return the resource that long strings are allocated from.
+  MemoryResource *resource() const {
+    return _resource != nullptr ? _resource : heap_resource();
+  }
+
   // element access
   char &at(size_t pos);
   const char &at(size_t pos) const;
@@ -71,7 +86,9 @@ public:
   size_t size() const { return len; }
   size_t length() const { return len; }
   void reserve(size_t new_capacity);
-  size_t capacity() const { return _capacity; }
+  size_t capacity() const {
+    return is_local() ? local_capacity : _capacity;
+  }
 
   // modifiers
   void clear() { resize(0); }
@@ -145,9 +162,22 @@ private:
     pointer ptr = nullptr;
   };
 
+  bool is_local() const { return _data == _local; }
+  /// Points \ref _data at a buffer for at least \a capacity
+  /// characters (plus the null terminator). The string must be local.
+  void allocate(size_t capacity);
+  void deallocate();
+
+  /// Either \ref _local or an allocated buffer.
+  char *_data = _local;
   size_t len = 0;
-  size_t _capacity = 0;
-  char *_data = nullptr;
+  /// nullptr for the kernel heap, which skips the virtual call.
+  MemoryResource *_resource = nullptr;
+  union {
+    /// Only valid if the string isn't local.
+    size_t _capacity;
+    char _local[local_capacity + 1] = {};
+  };
 };
 
 static_assert(std::contiguous_iterator<string::iterator>);
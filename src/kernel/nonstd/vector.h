@@ -8,8 +8,9 @@
 
 namespace nonstd {
 
-template <typename T> class vector {
-  using Allocator = Mallocator<T>;
+/// The allocator is copied along with the elements on copy, and
+/// moves with them on move and swap.
+template <typename T, typename Allocator = Mallocator<T>> class vector {
   template <typename U> class IterImpl;
 
 public:
@@ -19,34 +20,40 @@ public:
   using const_reverse_iterator = std::reverse_iterator<const_iterator>;
 
   vector() = default;
-  vector(size_t count)
-      : len{count}, _capacity{len}, _data{Allocator{}.allocate(_capacity)} {
+  explicit vector(const Allocator &_alloc) : alloc{_alloc} {}
+  vector(size_t count, const Allocator &_alloc = {})
+      : alloc{_alloc}, len{count}, _capacity{len},
+        _data{alloc.allocate(_capacity)} {
     for (size_t i = 0; i < len; ++i) {
       ::new (&_data[i]) T{};
     }
   }
-  vector(size_t count, const T &value)
-      : len{count}, _capacity{len}, _data{Allocator{}.allocate(_capacity)} {
+  vector(size_t count, const T &value, const Allocator &_alloc = {})
+      : alloc{_alloc}, len{count}, _capacity{len},
+        _data{alloc.allocate(_capacity)} {
     for (size_t i = 0; i < len; ++i) {
       ::new (&_data[i]) T(value);
     }
   }
-  template <std::input_iterator InputIt> vector(InputIt first, InputIt last) {
+  template <std::input_iterator InputIt>
+  vector(InputIt first, InputIt last, const Allocator &_alloc = {})
+      : alloc{_alloc} {
     while (first != last) {
       emplace_back(*first++);
     }
   }
 
   vector(const vector &v)
-      : len{v.len}, _capacity{v._capacity}, _data{Allocator{}.allocate(
-                                                _capacity)} {
+      : alloc{v.alloc}, len{v.len}, _capacity{v._capacity},
+        _data{alloc.allocate(_capacity)} {
     for (size_t i = 0; i < len; ++i) {
       ::new (&_data[i]) T(v[i]);
     }
   }
   vector(vector &&v) noexcept { *this = std::move(v); }
-  vector(std::initializer_list<T> v)
-      : len{v.size()}, _capacity{len}, _data{Allocator{}.allocate(_capacity)} {
+  vector(std::initializer_list<T> v, const Allocator &_alloc = {})
+      : alloc{_alloc}, len{v.size()}, _capacity{len},
+        _data{alloc.allocate(_capacity)} {
     T *it = _data;
     for (auto &elem : v) {
       ::new (it++) T(std::move(elem));
@@ -58,7 +65,7 @@ public:
       for (size_t i = 0; i < len; ++i) {
         _data[i].~T();
       }
-      Allocator{}.deallocate(_data, _capacity);
+      alloc.deallocate(_data, _capacity);
     }
   }
 
@@ -71,6 +78,8 @@ public:
     return *this;
   }
 
+  Allocator get_allocator() const { return alloc; }
+
   // element access
   T &at(size_t pos) {
     ASSERT(pos < size());
@@ -136,6 +145,7 @@ public:
     len = count;
   }
   void swap(vector &v) {
+    std::swap(alloc, v.alloc);
     std::swap(len, v.len);
     std::swap(_capacity, v._capacity);
     std::swap(_data, v._data);
@@ -204,17 +214,19 @@ private:
   static_assert(std::random_access_iterator<reverse_iterator>);
   static_assert(std::random_access_iterator<const_reverse_iterator>);
 
+  [[no_unique_address]] Allocator alloc;
   size_t len = 0;
   size_t _capacity = 0;
   T *_data = nullptr;
 };
 
 // non-member functions
-template <typename T>
-inline bool operator==(const vector<T> &lhs, const vector<T> &rhs);
+template <typename T, typename A>
+inline bool operator==(const vector<T, A> &lhs, const vector<T, A> &rhs);
 
 // template function definitions
-template <typename T> void vector<T>::reserve(size_t new_capacity) {
+template <typename T, typename Allocator>
+void vector<T, Allocator>::reserve(size_t new_capacity) {
   if (new_capacity <= _capacity) {
     // No effect.
     return;
@@ -224,19 +236,19 @@ template <typename T> void vector<T>::reserve(size_t new_capacity) {
   // capacity for O(1) amortized insertion.
   new_capacity = std::max(new_capacity, _capacity * 2);
   T *const old_data = _data;
-  _data = Allocator{}.allocate(new_capacity);
+  _data = alloc.allocate(new_capacity);
   for (size_t i = 0; i < len; ++i) {
     ::new (&_data[i]) T(std::move(old_data[i]));
     old_data[i].~T();
   }
   if (_capacity != 0) {
-    Allocator{}.deallocate(old_data, _capacity);
+    alloc.deallocate(old_data, _capacity);
   }
   _capacity = new_capacity;
 }
 
-template <typename T>
-bool operator==(const vector<T> &lhs, const vector<T> &rhs) {
+template <typename T, typename A>
+bool operator==(const vector<T, A> &lhs, const vector<T, A> &rhs) {
   return lhs.size() == rhs.size() &&
          std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
 }
@@ -0,0 +1,185 @@
+#include "proc/io_ring.h"
+#include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/page_frame_table.h"
+#include "mm/virt.h"
+#include "nonstd/libc.h"
+#include "nonstd/polyfill.h"
+#include "perf.h"
+#include "proc/process.h"
+#include "sched/lock.h"
+#include "util/algorithm.h"
+
+namespace proc {
+
+namespace {
+
+/// Syscalls that may be submitted via the ring.
+bool supported(uint32_t nr) {
+  switch (Syscall(nr)) {
+  case Syscall::Read:
+  case Syscall::Open:
+  case Syscall::Close:
+  case Syscall::Lseek:
+  case Syscall::Null:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// Cache line-align the SQE/CQE arrays.
+constexpr size_t ring_align = 64;
+
+} // namespace
+
+IoRing::IoRing(Process &_proc, sched::Scheduler &_sched, size_t addr,
+               uint32_t entries, uint32_t flags, fs::Result &res)
+    : proc{_proc}, sched{_sched} {
+  if (entries > io_ring_max_entries || !util::algorithm::pow2(entries) ||
+      (flags & ~io_ring_sq_poll)) {
+    res = fs::Result::InvalidArgs;
+    return;
+  }
+
+  // Size the CQ at twice the SQ (like Linux) so that a full SQ can be
+  // submitted while userspace still holds some unreaped completions.
+  sq_entries = entries;
+  cq_entries = 2 * entries;
+  const size_t sq_off =
+      util::algorithm::ceil_pow2<ring_align>(sizeof(IoRingHeader));
+  const size_t cq_off = util::algorithm::ceil_pow2<ring_align>(
+      sq_off + entries * sizeof(IoRingSqe));
+  const size_t sz = cq_off + cq_entries * sizeof(IoRingCqe);
+  num_pages = util::algorithm::ceil_pow2<PG_SZ>(sz) / PG_SZ;
+
+  // Allocate the region before creating the VMA, so that there's no
+  // VMA to remove on OOM. Note: the kernel heap implementation
+  // ensures that multi-page allocations are page-aligned and
+  // physically contiguous.
+  auto *region =
+      reinterpret_cast<std::byte *>(::operator new(num_pages * PG_SZ));
+  if (region == nullptr) {
+    res = fs::Result::OutOfMemory;
+    return;
+  }
+
+  // This validates \a addr.
+  proc.mmap(addr, num_pages * PG_SZ,
+            VirtualMemoryArea::Access{.writable = true, .readable = true},
+            VirtualMemoryArea::Flags{.map_anon = true, .map_shared = true},
+            fs::InvalidFD, 0, res);
+  if (res != fs::Result::Ok) {
+    // kfree() doesn't free anything.
+    mem::free_frames(mem::virt::hhdm_to_direct(region), num_pages);
+    return;
+  }
+  nonstd::memset(region, 0, num_pages * PG_SZ);
+
+  // Eagerly map the shared pages, so the page fault handler never
+  // sees this VMA.
+  for (size_t i = 0; i < num_pages; ++i) {
+    const uint64_t phys = mem::virt::hhdm_to_direct(region + i * PG_SZ);
+    const bool success =
+        mem::virt::map(phys, reinterpret_cast<void *>(addr + i * PG_SZ),
+                       /*userspace=*/true, /*writable=*/true);
+    ASSERT(success);
+    mem::phys::get_pft().get_pfd(phys).set_refcount(1);
+  }
+
+  hdr = reinterpret_cast<IoRingHeader *>(region);
+  sqes = reinterpret_cast<IoRingSqe *>(region + sq_off);
+  cqes = reinterpret_cast<IoRingCqe *>(region + cq_off);
+  hdr->sq_entries = sq_entries;
+  hdr->cq_entries = cq_entries;
+  hdr->sq_off = sq_off;
+  hdr->cq_off = cq_off;
+
+  if (flags & io_ring_sq_poll) {
+    poll_tid = sched.new_thread(&proc, poll_thread, this);
+  }
+}
+
+IoRing::~IoRing() {
+  stop();
+
+  // The shared pages are still mapped by the VMA. They are freed
+  // with the rest of the address space.
+}
+
+bool IoRing::stop() {
+  if (!polling()) {
+    return false;
+  }
+  if (sched.running_tid() == poll_tid) {
+    poll_tid = sched::InvalidTID;
+    return true;
+  }
+
+  __atomic_store_n(&stop_polling, true, __ATOMIC_RELEASE);
+  while (polling()) {
+    sched.schedule();
+  }
+  return false;
+}
+
+uint32_t IoRing::submit(uint32_t max) {
+  if (hdr == nullptr) {
+    return 0;
+  }
+
+  // Userspace may write the SQ tail and CQ head at any time. x86 is
+  // TSO, so acquire/release only need to constrain the compiler.
+  // These are only used as counters; ring indices are always masked
+  // by the kernel's entry counts.
+  const uint32_t sq_tail = __atomic_load_n(&hdr->sq_tail, __ATOMIC_ACQUIRE);
+  const uint32_t cq_head = __atomic_load_n(&hdr->cq_head, __ATOMIC_ACQUIRE);
+
+  uint32_t submitted = 0;
+  for (; submitted < max && sq_head != sq_tail &&
+         cq_tail - cq_head < cq_entries;
+       ++submitted) {
+    // Copy the entry out of shared memory, so userspace can't modify
+    // it while we're executing it.
+    const IoRingSqe sqe = sqes[sq_head++ & (sq_entries - 1)];
+    __atomic_store_n(&hdr->sq_head, sq_head, __ATOMIC_RELEASE);
+
+    SyscallContext ctx{
+        .nr = sqe.nr,
+        .args = {sqe.args[0], sqe.args[1], sqe.args[2], sqe.args[3],
+                 sqe.args[4]},
+    };
+    const int32_t rval =
+        likely(supported(sqe.nr))
+            ? do_syscall(proc, ctx)
+            : -nonstd::to_underlying(fs::Result::Unsupported);
+
+    cqes[cq_tail++ & (cq_entries - 1)] = {.user_data = sqe.user_data,
+                                          .res = rval};
+    __atomic_store_n(&hdr->cq_tail, cq_tail, __ATOMIC_RELEASE);
+  }
+  return submitted;
+}
+
+void IoRing::poll_thread(void *_ring) {
+  auto *ring = reinterpret_cast<IoRing *>(_ring);
+  for (;;) {
+    if (__atomic_load_n(&ring->stop_polling, __ATOMIC_ACQUIRE)) {
+      // Interrupts stay disabled until we've switched away, since the
+      // ring (and process) may be deleted as soon as \ref stop()
+      // sees that we've exited.
+      auto &_sched = ring->sched;
+      sched::mutex_lock();
+      __atomic_store_n(&ring->poll_tid, sched::InvalidTID, __ATOMIC_RELEASE);
+      _sched.exit_thread();
+    }
+
+    // Yield when idle. This is a busy poll; there's no wakeup
+    // mechanism yet.
+    if (ring->submit(ring->sq_entries) == 0) {
+      ring->sched.schedule();
+    }
+  }
+}
+
+} // namespace proc
@@ -0,0 +1,87 @@
+#pragma once
+
+/// \file io_ring.h
+/// \brief Kernel side of the shared submission/completion rings.
+///
+/// \see proc/syscalls.h for the userspace ABI.
+
+#include "fs/result.h"
+#include "proc/syscalls.h"
+#include "sched/kthread.h"
+#include "util/objutil.h"
+#include <cstddef>
+
+namespace proc {
+
+class Process;
+
+/// A pair of submission/completion rings owned by a \ref Process.
+///
+/// The rings are allocated as physically-contiguous kernel memory,
+/// which the kernel accesses via the HHDM, and are mapped into the
+/// process at the requested address as a shared anonymous \ref
+/// VirtualMemoryArea.
+///
+/// Submissions are executed synchronously through the syscall table,
+/// so completions are currently posted in submission order. (Disk
+/// reads are blocking.) The ABI doesn't promise this, to leave room
+/// for async disk-backed reads.
+class IoRing {
+public:
+  /// Create the rings and map them into \a proc at \a addr. Must be
+  /// called from the context of \a proc.
+  IoRing(Process &proc, sched::Scheduler &sched, size_t addr,
+         uint32_t entries, uint32_t flags, fs::Result &res);
+  /// Stops the polling thread, if any. \see stop()
+  ~IoRing();
+
+  NON_MOVABLE(IoRing);
+
+  /// Stop the polling thread (if any) and wait for it to exit. The
+  /// thread only exits between submissions, so this must be called
+  /// with interrupts enabled.
+  ///
+  /// \return true if called from the polling thread itself (e.g., a
+  /// submitted syscall faulted and the process is being killed). The
+  /// thread is then only forgotten, and the caller must destroy it.
+  bool stop();
+
+  /// Execute up to \a max submission queue entries. This stops early
+  /// if the submission queue is empty or the completion queue is
+  /// full.
+  ///
+  /// \return the number of entries consumed.
+  uint32_t submit(uint32_t max);
+
+  /// True if a kernel thread is polling the submission queue.
+  bool polling() const {
+    return __atomic_load_n(&poll_tid, __ATOMIC_ACQUIRE) != sched::InvalidTID;
+  }
+
+private:
+  static void poll_thread(void *ring);
+
+  Process &proc;
+  sched::Scheduler &sched;
+
+  /// HHDM address of the shared region. Userspace can write all of
+  /// it, so only `sq_tail` and `cq_head` are read back; the other
+  /// header fields are only published to userspace.
+  IoRingHeader *hdr = nullptr;
+  IoRingSqe *sqes = nullptr;
+  IoRingCqe *cqes = nullptr;
+  size_t num_pages = 0;
+
+  /// Kernel-owned copies of the header fields.
+  uint32_t sq_entries = 0;
+  uint32_t cq_entries = 0;
+  uint32_t sq_head = 0;
+  uint32_t cq_tail = 0;
+
+  sched::ThreadID poll_tid = sched::InvalidTID;
+  /// Set by \ref stop(), and checked by the polling thread between
+  /// submissions.
+  bool stop_polling = false;
+};
+
+} // namespace proc
@@ -1,16 +1,21 @@
 #include "proc/process.h"
 #include "fs/result.h"
 #include "fs/vfs.h"
-#include "gdt.h"
 #include "libc_minimal.h"
 #include "memdefs.h"
+#include "mm/kmalloc.h"
+#include "mm/page_frame_table.h"
 #include "mm/virt.h"
+#include "mm/zero_pool.h"
 #include "nonstd/memory.h"
 #include "page_table.h"
 #include "proc/elf.h"
+#include "proc/io_ring.h"
 #include "sched/kthread.h"
+#include "sched/lock.h"
 #include "stack.h"
 #include "util/algorithm.h"
+#include "util/objutil.h"
 #include "util/pathutil.h"
 
 #define CHECK_RES                                                              \
@@ -58,11 +63,401 @@ VirtualMemoryArea::~VirtualMemoryArea() {
     dentry->dec_rc();
   }
 
-// NOCOMMIT TODO: walk the page table, unmap each page. If the
-// mapped page refcount drops to zero, also free the page.
-#if 0
-  ASSERT(false);
-#endif
+  // The pages are unmapped by \ref Process::~Process(), together with
+  // the rest of the address space. (We don't support munmap yet, so a
+  // VMA is only destroyed along with its process.)
+}
+
+namespace {
+
+/// Maps the frame \a phys at \a page with permissions \a prot. If
+/// \a shared, the frame is already referenced elsewhere (e.g., by the
+/// page cache) and its refcount is incremented; otherwise the frame is
+/// exclusively owned by this mapping.
+void map_frame(uint64_t phys, void *page, VirtualMemoryArea::Access prot,
+               bool shared, fs::Result &res) {
+  // This only fails if a page table can't be allocated.
+  if (!mem::virt::map(phys, page, /*userspace=*/true, prot.writable,
+                      /*uncacheable=*/false, prot.executable)) {
+    res = fs::Result::OutOfMemory;
+    return;
+  }
+  auto &pfd = mem::phys::get_pft().get_pfd(phys);
+  if (shared) {
+    pfd.inc_refcount();
+  } else {
+    pfd.set_refcount(1);
+  }
+}
+
+/// Maps a newly-allocated page at \a page that is exclusively owned
+/// by the current address space. Its contents are initialized by \a
+/// fill, which is passed a temporary kernel mapping of the page.
+template <typename Fill>
+void map_private_page(void *page, VirtualMemoryArea::Access prot,
+                      fs::Result &res, Fill &&fill) {
+  const auto frame = mem::alloc_frames(1);
+  if (!frame) {
+    res = fs::Result::OutOfMemory;
+    return;
+  }
+  {
+    mem::virt::KmapGuard kmap{*frame};
+    fill(kmap.get());
+  }
+  map_frame(*frame, page, prot, /*shared=*/false, res);
+  if (res != fs::Result::Ok) {
+    mem::free_frames(*frame, 1);
+  }
+}
+
+/// Maps a zeroed page at \a page that is exclusively owned by the
+/// current address space. The frame is taken from the pre-zeroed pool
+/// if possible.
+void map_zeroed_page(void *page, VirtualMemoryArea::Access prot,
+                     fs::Result &res) {
+  const auto frame = mem::alloc_zeroed_frame();
+  if (!frame) {
+    res = fs::Result::OutOfMemory;
+    return;
+  }
+  map_frame(*frame, page, prot, /*shared=*/false, res);
+  if (res != fs::Result::Ok) {
+    mem::free_frames(*frame, 1);
+  }
+}
+
+/// Zero the frames [\a phys, \a phys + \a num_pg pages).
+void zero_frames(uint64_t phys, unsigned num_pg) {
+  for (unsigned i = 0; i < num_pg; ++i) {
+    mem::virt::KmapGuard kmap{phys + i * PG_SZ};
+    nonstd::memset(kmap.get(), 0, PG_SZ);
+  }
+}
+
+/// Drops a reference on each frame passed to \ref put(), and frees
+/// the frames whose last reference it was. Physically contiguous runs
+/// of frames (e.g., hugepages, or anonymous pages allocated in one
+/// batch) are returned to the PFA in one call.
+class FrameReleaser {
+public:
+  FrameReleaser() : pft{mem::phys::get_pft()} {}
+  ~FrameReleaser() { flush(); }
+  NON_COPYABLE(FrameReleaser);
+
+  void put(uint64_t phys) {
+    if (pft.get_pfd(phys).dec_refcount() != 0) {
+      return;
+    }
+    if (run_pg > 0 && phys == run_start + run_pg * PG_SZ) {
+      ++run_pg;
+      return;
+    }
+    flush();
+    run_start = phys;
+    run_pg = 1;
+  }
+
+  void flush() {
+    if (run_pg > 0) {
+      mem::free_frames(run_start, run_pg);
+      run_pg = 0;
+    }
+  }
+
+private:
+  mem::phys::PageFrameTable &pft;
+  uint64_t run_start = 0;
+  unsigned run_pg = 0;
+};
+
+bool is_mapped(size_t page) {
+  return arch::page_table::get_phys((void *)page).has_value();
+}
+
+/// \see zero_page()
+std::byte *zero_pg = nullptr;
+
+/// The shared zero page. This backs read faults on private anonymous
+/// memory until the first write. It holds a permanent reference on
+/// itself, so it is always copied on write.
+std::byte *zero_page() {
+  if (unlikely(zero_pg == nullptr)) {
+    zero_pg = reinterpret_cast<std::byte *>(mem::alloc_zeroed_page());
+    ASSERT(zero_pg != nullptr);
+    mem::phys::get_pft()
+        .get_pfd(mem::virt::hhdm_to_direct(zero_pg))
+        .set_refcount(1);
+  }
+  return zero_pg;
+}
+
+} // namespace
+
+void VirtualMemoryArea::map_pages(size_t start, size_t end, bool write,
+                                  bool read_in, fs::Result &res) const {
+  ASSERT(PG_ALIGNED(start) && PG_ALIGNED(end));
+  ASSERT(start >= addr &&
+         end <= util::algorithm::ceil_pow2<PG_SZ>(addr + len));
+
+  if (flags.map_anon && flags.map_private && !write) {
+    // Map the zero page read-only; the real frame is allocated by
+    // \ref write_fault() on the first write.
+    const uint64_t zero_phys = mem::virt::hhdm_to_direct(zero_page());
+    Access read_only = prot;
+    read_only.writable = false;
+    for (size_t pg = start; pg < end; pg += PG_SZ) {
+      if (is_mapped(pg)) {
+        continue;
+      }
+      map_frame(zero_phys, (void *)pg, read_only, /*shared=*/true, res);
+      if (res != fs::Result::Ok) {
+        return;
+      }
+    }
+    return;
+  }
+
+  if (flags.map_anon) {
+    // Use hugepages for aligned 4MB blocks that lie entirely in the
+    // range, if nothing is mapped there yet.
+    for (size_t blk = util::algorithm::ceil_pow2<HUGE_PG_SZ>(start);
+         blk + HUGE_PG_SZ <= end; blk += HUGE_PG_SZ) {
+      map_huge_page(blk);
+    }
+
+    size_t missing = 0;
+    for (size_t pg = start; pg < end; pg += PG_SZ) {
+      missing += !is_mapped(pg);
+    }
+
+    // Pre-zeroed frames are used first. Each remaining run of
+    // unmapped pages is allocated, zeroed and mapped at once, falling
+    // back to single frames if memory is too fragmented (like \ref
+    // mem::virt::vmalloc()).
+    size_t pooled = std::min(missing, mem::zeroed_frames_available());
+    auto &pft = mem::phys::get_pft();
+    for (size_t pg = start; pg < end;) {
+      if (is_mapped(pg)) {
+        pg += PG_SZ;
+        continue;
+      }
+      if (pooled > 0) {
+        map_zeroed_page((void *)pg, prot, res);
+        if (res != fs::Result::Ok) {
+          return;
+        }
+        --pooled;
+        pg += PG_SZ;
+        continue;
+      }
+      size_t run_end = pg + PG_SZ;
+      while (run_end < end && !is_mapped(run_end)) {
+        run_end += PG_SZ;
+      }
+      unsigned num_pg = (run_end - pg) / PG_SZ;
+      auto frames = mem::alloc_frames(num_pg);
+      if (!frames && num_pg > 1) {
+        num_pg = 1;
+        frames = mem::alloc_frames(num_pg);
+      }
+      if (!frames) {
+        res = fs::Result::OutOfMemory;
+        return;
+      }
+      zero_frames(*frames, num_pg);
+      if (!mem::virt::map_range(*frames, (void *)pg, num_pg,
+                                /*userspace=*/true, prot.writable,
+                                /*uncacheable=*/false, prot.executable)) {
+        // Out of memory for page tables. Some of the pages may have
+        // been mapped.
+        mem::virt::FlushBatch batch;
+        mem::virt::unmap_range((void *)pg, num_pg, batch);
+        batch.flush();
+        mem::free_frames(*frames, num_pg);
+        res = fs::Result::OutOfMemory;
+        return;
+      }
+      for (size_t i = 0; i < num_pg; ++i) {
+        pft.get_pfd(*frames + i * PG_SZ).set_refcount(1);
+      }
+      pg += num_pg * PG_SZ;
+    }
+    return;
+  }
+
+  ASSERT(dentry != nullptr);
+  fs::Inode &inode = dentry->inode;
+  for (size_t pg = start; pg < end; pg += PG_SZ) {
+    if (is_mapped(pg)) {
+      continue;
+    }
+
+    const size_t pgoff = (offset + (pg - addr)) / PG_SZ;
+    std::byte *cached =
+        read_in ? inode.get_page(pgoff, res) : inode.find_page(pgoff);
+    if (res != fs::Result::Ok) {
+      return;
+    }
+    if (cached == nullptr) {
+      continue;
+    }
+
+    if (flags.map_private && prot.writable && write) {
+      map_private_page((void *)pg, prot, res, [&](std::byte *frame) {
+        nonstd::memcpy(frame, cached, PG_SZ);
+      });
+    } else if (flags.map_private && prot.writable) {
+      // Map the cached page read-only; \ref write_fault() copies it
+      // on the first write, since the page cache holds a reference.
+      Access read_only = prot;
+      read_only.writable = false;
+      map_frame(mem::virt::hhdm_to_direct(cached), (void *)pg, read_only,
+                /*shared=*/true, res);
+    } else {
+      // TODO: writes to \a map_shared mappings are never written back.
+      map_frame(mem::virt::hhdm_to_direct(cached), (void *)pg, prot,
+                /*shared=*/true, res);
+    }
+    if (res != fs::Result::Ok) {
+      return;
+    }
+  }
+}
+
+bool VirtualMemoryArea::map_huge_page(size_t blk) const {
+  ASSERT(HUGEPG_ALIGNED(blk) && flags.map_anon);
+  ASSERT(blk >= addr &&
+         blk + HUGE_PG_SZ <= util::algorithm::ceil_pow2<PG_SZ>(addr + len));
+  if (!arch::page_table::pde_empty((void *)blk)) {
+    return false;
+  }
+
+  const auto frames = mem::alloc_frames(PG_PER_PT, PG_PER_PT);
+  if (!frames) {
+    return false;
+  }
+  zero_frames(*frames, PG_PER_PT);
+
+  const uint64_t phys = *frames;
+  if (!mem::virt::map_huge(phys, (void *)blk, /*userspace=*/true,
+                           prot.writable, /*uncacheable=*/false,
+                           prot.executable)) {
+    mem::free_frames(phys, PG_PER_PT);
+    return false;
+  }
+
+  // Refcounts are still per 4KB frame, since the hugepage may be
+  // split later (e.g., by fork).
+  auto &pft = mem::phys::get_pft();
+  for (unsigned i = 0; i < PG_PER_PT; ++i) {
+    pft.get_pfd(phys + i * PG_SZ).set_refcount(1);
+  }
+  return true;
+}
+
+void VirtualMemoryArea::fault(size_t fault_addr, bool write,
+                              fs::Result &res) const {
+  ASSERT(fault_addr >= addr && fault_addr < addr + len);
+  const size_t page = util::algorithm::floor_pow2<PG_SZ>(fault_addr);
+
+  // Transparently use a hugepage if the aligned 4MB block containing
+  // \a page lies entirely within this VMA, and nothing in it is mapped
+  // yet. (Read faults on private memory map the zero page instead.)
+  if (const size_t blk = util::algorithm::floor_pow2<HUGE_PG_SZ>(page);
+      flags.map_anon && (write || flags.map_shared) && blk >= addr &&
+      blk + HUGE_PG_SZ <= addr + len && map_huge_page(blk)) {
+    return;
+  }
+
+  // The fault-around window is the aligned block of \ref
+  // fault_around_pages pages containing \a page, clipped to this VMA.
+  ASSERT(util::algorithm::pow2(fault_around_pages));
+  const size_t window_sz = fault_around_pages * PG_SZ;
+  const size_t window_base = page & ~(window_sz - 1);
+  size_t window_start = std::max(addr, window_base);
+  size_t window_end =
+      std::min(size_t(util::algorithm::ceil_pow2<PG_SZ>(addr + len)),
+               window_base + window_sz);
+
+  if (!flags.map_anon) {
+    // Only the faulting page is read in. Its neighbors are mapped if
+    // they are already in the page cache.
+    dentry->inode.get_page((offset + (page - addr)) / PG_SZ, res);
+    if (res != fs::Result::Ok) {
+      return;
+    }
+
+    // Writes to private pages copy them, so only the faulting page
+    // is mapped. Otherwise, neighbors are mapped read-only and copied
+    // on write.
+    if (flags.map_private && prot.writable && write) {
+      window_start = page;
+      window_end = page + PG_SZ;
+    }
+  }
+
+  map_pages(window_start, window_end, write, /*read_in=*/false, res);
+}
+
+void VirtualMemoryArea::populate(size_t start, size_t end,
+                                 fs::Result &res) const {
+  map_pages(start, end, /*write=*/prot.writable, /*read_in=*/true, res);
+}
+
+void VirtualMemoryArea::prefetch(size_t start, size_t end,
+                                 fs::Result &res) const {
+  if (flags.map_anon) {
+    return;
+  }
+  for (size_t pg = start; pg < end; pg += PG_SZ) {
+    dentry->inode.get_page((offset + (pg - addr)) / PG_SZ, res);
+    if (res != fs::Result::Ok) {
+      return;
+    }
+  }
+}
+
+void VirtualMemoryArea::discard(size_t start, size_t end) const {
+  // Frames are freed before the TLB is flushed. This is okay since
+  // nothing can reuse them (and userspace can't run) until \a batch
+  // goes out of scope.
+  mem::virt::FlushBatch batch;
+  FrameReleaser releaser;
+  mem::virt::unmap_range((void *)start, (end - start) / PG_SZ, batch,
+                         [&](uint64_t phys) { releaser.put(phys); });
+}
+
+void VirtualMemoryArea::write_fault(size_t fault_addr, fs::Result &res) const {
+  ASSERT(fault_addr >= addr && fault_addr < addr + len);
+  ASSERT(prot.writable);
+  void *const page = (void *)util::algorithm::floor_pow2<PG_SZ>(fault_addr);
+
+  const auto phys = arch::page_table::get_phys(page);
+  ASSERT(phys.has_value());
+  auto &pfd = mem::phys::get_pft().get_pfd(*phys);
+
+  // Shared mappings (after a fork) and private pages that are no
+  // longer shared can simply be made writable again.
+  if (flags.map_shared || pfd.refcount() == 1) {
+    arch::page_table::set_writable(page);
+    return;
+  }
+
+  // Otherwise copy the page. The TLB entry for the old frame is
+  // flushed by \ref mem::virt::unmap() before we map the copy.
+  const bool from_zero_page =
+      zero_pg != nullptr && *phys == mem::virt::hhdm_to_direct(zero_pg);
+  mem::virt::unmap(page);
+  pfd.dec_refcount();
+  if (from_zero_page) {
+    map_zeroed_page(page, prot, res);
+    return;
+  }
+  map_private_page(page, prot, res, [&](std::byte *frame) {
+    mem::virt::KmapGuard src{*phys};
+    nonstd::memcpy(frame, src.get(), PG_SZ);
+  });
 }
 
 namespace {
@@ -91,12 +486,9 @@ Process::Process(sched::Scheduler &_sched, nonstd::string_view bin_path,
                  fs::Result &res)
     : sched{_sched} {
 
-  // This is the page table created by exec(), which only copies the
-  // kernel mappings.
-  //
-  // TODO: more complicated cloning methods for fork(), clone() etc.
-  page_directory = arch::page_table::clone_kernel_page_directory(
-      arch::page_table::get_page_directory());
+  // This is the page table created by exec(), which only contains the
+  // (shared) kernel mappings.
+  page_directory = arch::page_table::clone_kernel_page_directory();
 
   {
     // We have to temporarily enter the context of the new process,
@@ -120,7 +512,7 @@ Process::Process(sched::Scheduler &_sched, nonstd::string_view bin_path,
        VirtualMemoryArea::Flags{.map_anon = true, .map_private = true},
        fs::InvalidFD, 0, res);
   CHECK_RES;
-  esp3 = (void *)stack_top;
+  user_regs.esp = stack_top;
 
   // TODO: open stdin/stdout/stderr
 
@@ -130,11 +522,80 @@ Process::Process(sched::Scheduler &_sched, nonstd::string_view bin_path,
       this);
 }
 
+Process::Process(Process &parent, const SyscallContext &ctx, fs::Result &res)
+    : sched{parent.sched} {
+  fds.reserve(parent.fds.size());
+  for (const auto &file : parent.fds) {
+    fds.emplace_back();
+    if (file.has_value()) {
+      fds.back().emplace(*file->dentry, file->fd);
+      fds.back()->offset = file->offset;
+    }
+  }
+
+  for (const auto &vma : parent.vmas) {
+    auto *copy = new VirtualMemoryArea(vma.addr, vma.len, vma.prot, vma.flags,
+                                       vma.dentry, vma.offset, res);
+    ASSERT(res == fs::Result::Ok);
+    vmas.push_back(*copy);
+    vma_tree.insert(*copy);
+  }
+
+  // The parent must be the current address space.
+  ASSERT(parent.page_directory == arch::page_table::get_page_directory());
+  page_directory = arch::page_table::fork_page_directory();
+
+  // The child resumes from the syscall with a return value of 0.
+  user_regs = {
+      .eax = 0,
+      .ebx = ctx.args[0],
+      .ecx = ctx.args[1],
+      .edx = ctx.args[2],
+      .esi = ctx.args[3],
+      .edi = ctx.args[4],
+      .ebp = ctx.ebp,
+      .esp = ctx.esp3,
+      .eip = ctx.eip3,
+  };
+
+  // The io_ring (if any) is not inherited, but its shared mapping is.
+
+  tid = sched.new_thread(
+      this,
+      [](void *p) { reinterpret_cast<Process *>(p)->jump_to_userspace(); },
+      this);
+  sched.copy_fpu_state(parent.tid, tid);
+}
+
 Process::~Process() {
-  // NOCOMMIT TODO: cleanup page tables
-  //
-  // VM mappings will automatically be cleaned up when the VMA objects
-  // get destructed
+  delete io_ring;
+
+  vma_tree.clear();
+  while (!vmas.empty()) {
+    auto &vma = vmas.next();
+    vma.erase();
+    delete &vma;
+  }
+
+  // Release every userspace page in one pass over the page tables,
+  // rather than per VMA. Frames that are still referenced elsewhere
+  // (after a fork, or by the page cache) are kept.
+  FrameReleaser releaser;
+  arch::page_table::destroy_page_directory(
+      page_directory, [&](uint64_t phys) { releaser.put(phys); });
+}
+
+const VirtualMemoryArea *Process::find_vma(size_t addr) {
+  if (last_vma != nullptr && addr >= last_vma->addr &&
+      addr - last_vma->addr < last_vma->len) {
+    return last_vma;
+  }
+
+  const auto *vma = vma_tree.find(addr);
+  if (vma != nullptr) {
+    last_vma = vma;
+  }
+  return vma;
 }
 
 fs::FileDescriptor Process::get_next_fd() {
@@ -150,12 +611,15 @@ fs::FileDescriptor Process::get_next_fd() {
 }
 
 fs::FileDescriptor Process::open(nonstd::string_view path, fs::Result &res) {
+  // Get the fd first, since growing \ref fds may shrink the dcache
+  // and free the (unreferenced) dentry. The fd is left unused if the
+  // lookup fails.
+  const fs::FileDescriptor fd = get_next_fd();
   fs::Dentry *dentry = pathname_lookup(path, res);
   if (dentry == nullptr) {
     return fs::InvalidFD;
   }
 
-  const fs::FileDescriptor fd = get_next_fd();
   fds[fd].emplace(*dentry, fd);
   return fd;
 }
@@ -198,7 +662,7 @@ void Process::creat(nonstd::string_view path, fs::Result &res) {
     return;
   }
 
-  res = parent->inode.creat(basename);
+  res = fs::creat(*parent, basename);
 }
 
 void Process::lseek(fs::FileDescriptor fd, ssize_t offset, Seek whence,
@@ -241,29 +705,84 @@ void *Process::mmap(size_t addr, size_t length, VirtualMemoryArea::Access prot,
     dentry = fds[fd]->dentry;
   }
 
-  auto it = vmas.begin();
-  for (; it != vmas.end(); ++it) {
-    if (util::algorithm::range_overlaps2(addr, length, it->addr, it->len,
-                                         /*inclusive=*/false)) {
-      res = fs::Result::MappingExists;
-      return nullptr;
-    }
-
-    if (it->addr > addr) {
-      break;
-    }
+  if (vma_tree.find_overlap(addr, addr + length) != nullptr) {
+    res = fs::Result::MappingExists;
+    return nullptr;
   }
 
-  // Insert VMA in sorted order.
-  auto new_vma =
-      vmas.emplace(it, addr, length, prot, flags, dentry, offset, res);
+  auto *new_vma =
+      new VirtualMemoryArea(addr, length, prot, flags, dentry, offset, res);
   if (res != fs::Result::Ok) {
-    vmas.erase(new_vma);
+    delete new_vma;
     return nullptr;
   }
+
+  // Insert VMA in sorted order, i.e., before the next VMA.
+  if (auto *next = vma_tree.lower_bound(addr); next != nullptr) {
+    next->push_back(*new_vma);
+  } else {
+    vmas.push_back(*new_vma);
+  }
+  vma_tree.insert(*new_vma);
+
+  if (flags.map_populate) {
+    // Like Linux, failing to populate doesn't fail the mmap; the
+    // remaining pages are faulted in lazily.
+    ASSERT(page_directory == arch::page_table::get_page_directory());
+    fs::Result populate_res = fs::Result::Ok;
+    new_vma->populate(addr, util::algorithm::ceil_pow2<PG_SZ>(addr + length),
+                      populate_res);
+  }
   return reinterpret_cast<void *>(new_vma->addr);
 }
 
+void Process::madvise(size_t addr, size_t length, Advice advice,
+                      fs::Result &res) {
+  if (!PG_ALIGNED(addr)) {
+    res = fs::Result::InvalidArgs;
+    return;
+  }
+  if (advice != Advice::Normal && advice != Advice::WillNeed &&
+      advice != Advice::DontNeed) {
+    res = fs::Result::Unsupported;
+    return;
+  }
+
+  // Apply to each VMA overlapping the range. Unmapped holes in the
+  // range are ignored.
+  ASSERT(page_directory == arch::page_table::get_page_directory());
+  const size_t end = util::algorithm::ceil_pow2<PG_SZ>(addr + length);
+  for (size_t start = addr; start < end;) {
+    const auto *vma = vma_tree.find_overlap(start, end);
+    if (vma == nullptr) {
+      break;
+    }
+    const size_t vma_start = std::max(start, vma->addr);
+    const size_t vma_end = std::min(
+        end, size_t(util::algorithm::ceil_pow2<PG_SZ>(vma->addr + vma->len)));
+
+    switch (advice) {
+    case Advice::Normal:
+      break;
+    case Advice::WillNeed:
+      vma->prefetch(vma_start, vma_end, res);
+      break;
+    case Advice::DontNeed:
+      // Shared anonymous pages have no backing store to fault back in
+      // from, and may still be used by another process or the kernel
+      // (e.g., the io_ring).
+      if (vma->flags.map_anon && vma->flags.map_shared) {
+        res = fs::Result::InvalidArgs;
+        break;
+      }
+      vma->discard(vma_start, vma_end);
+      break;
+    }
+    CHECK_RES;
+    start = vma_end;
+  }
+}
+
 ssize_t Process::read(fs::FileDescriptor fd, void *buf, size_t count,
                       fs::Result &res) {
   if (fd >= fds.size() || fds[fd] == std::nullopt) {
@@ -282,8 +801,52 @@ ssize_t Process::read(fs::FileDescriptor fd, void *buf, size_t count,
 
 void Process::exit(int status) {
   ASSERT(tid != sched::InvalidTID);
-  sched.destroy_thread(tid);
+
+  // Let the io_ring's polling thread finish its submission, unless
+  // it's the running thread (i.e., a submitted syscall faulted).
+  const bool in_poll_thread = io_ring != nullptr && io_ring->stop();
+
+  // destroy_thread() doesn't return when destroying the running
+  // thread, so the process is deleted first. Interrupts stay disabled
+  // until we've switched away: this thread must not be scheduled
+  // again once its address space is gone.
+  sched::mutex_lock();
+  auto &_sched = sched;
+  const auto _tid = tid;
+  const auto running = in_poll_thread ? _sched.running_tid() : _tid;
   delete this;
+  if (running != _tid) {
+    // Not the running thread, so this returns.
+    _sched.destroy_thread(_tid);
+  }
+  _sched.destroy_thread(running);
+}
+
+void Process::io_ring_setup(size_t addr, uint32_t entries, uint32_t flags,
+                            fs::Result &res) {
+  if (io_ring != nullptr) {
+    res = fs::Result::MappingExists;
+    return;
+  }
+
+  io_ring = new IoRing(*this, sched, addr, entries, flags, res);
+  if (res != fs::Result::Ok) {
+    delete io_ring;
+    io_ring = nullptr;
+  }
+}
+
+uint32_t Process::io_ring_enter(uint32_t to_submit, fs::Result &res) {
+  if (io_ring == nullptr) {
+    res = fs::Result::InvalidArgs;
+    return 0;
+  }
+
+  // The polling thread is the only consumer of the submission queue.
+  if (io_ring->polling()) {
+    return 0;
+  }
+  return io_ring->submit(to_submit);
 }
 
 // TODO: implement these
@@ -314,10 +877,10 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
   res = proc::elf::parse_executable(elf_image_buf, parsed_elf);
   CHECK_RES;
 
-  eip3 = (void *)parsed_elf.hdr->entry;
+  user_regs.eip = parsed_elf.hdr->entry;
 
-  nonstd::unique_ptr<std::byte> scoped_buf{
-      reinterpret_cast<std::byte *>(::operator new(PG_SZ))};
+  // Partial pages are copied out of the page cache.
+  fs::Inode &bin_inode = fds[bin_fd]->dentry->inode;
 
   // Map text and data regions.
   const elf::PHEntry *phentry = parsed_elf.ph_table;
@@ -344,10 +907,12 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
     // 4. Possibly some number of anonymous pages, rounded up to the
     //    next full page.
     //
-    // (2) and (4) can be mapped via mmap, (1) and (3) needs to be
-    // copied manually into private anonymous mappings as mmap doesn't
-    // support partial mappings. Thus we may need to copy up to two
-    // pages per segment.
+    // (2) and (4) can be mapped via mmap, and are demand-paged. (1)
+    // and (3) needs to be copied manually into private anonymous
+    // mappings as mmap doesn't support partial mappings. Thus we may
+    // need to copy up to two pages per segment. These are filled via
+    // a temporary kernel mapping, since the kernel can't write to
+    // read-only userspace pages (CR0.WP is set).
     //
     // An example of a segment that requires all four mappings:
     //
@@ -369,20 +934,30 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
     const VirtualMemoryArea::Flags flags{.map_private = true};
     const VirtualMemoryArea::Flags flags_anon{.map_anon = true,
                                               .map_private = true};
-    const auto copy_page = [&](size_t offset) {
+    const auto get_page = [&](size_t offset) {
       ASSERT(PG_ALIGNED(offset));
-      lseek(bin_fd, PG_SZ, Seek::Set, res);
-      CHECK_RES;
-      const ssize_t n = read(bin_fd, scoped_buf.get(), PG_SZ, res);
-      CHECK_RES;
+      return bin_inode.get_page(offset / PG_SZ, res);
     };
 
+    if (!prot.writable && phentry->memsz == phentry->filesz) {
+      // Read-only segments without a zero-filled tail can be
+      // demand-paged straight from the page cache in their entirety,
+      // including the bytes surrounding the segment in its first and
+      // last pages (Linux does the same).
+      mmap(floor_pg(phentry->vaddr),
+           ceil_pg(phentry->vaddr + phentry->filesz) -
+               floor_pg(phentry->vaddr),
+           prot, flags, bin_fd, floor_pg(phentry->offset), res);
+      CHECK_RES;
+      continue;
+    }
+
     if (!PG_ALIGNED(phentry->vaddr)) {
       // 1
       mmap(floor_pg(phentry->vaddr), PG_SZ, prot, flags_anon, fs::InvalidFD, 0,
            res);
       CHECK_RES;
-      copy_page(floor_pg(phentry->offset));
+      const std::byte *src = get_page(floor_pg(phentry->offset));
       CHECK_RES;
 
       const size_t pg_start = floor_pg(phentry->vaddr);
@@ -391,10 +966,14 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
           std::min(uint64_t(phentry->vaddr + phentry->filesz),
                    ceil_pg(phentry->vaddr)) -
           pg_start;
-      nonstd::memset((void *)pg_start, 0, start_off);
-      nonstd::memcpy((void *)(pg_start + start_off),
-                     scoped_buf.get() + start_off, end_off - start_off);
-      nonstd::memset((void *)(pg_start + end_off), 0, PG_SZ - end_off);
+      map_private_page((void *)pg_start, prot, res,
+                       [&](std::byte *frame) {
+                         nonstd::memset(frame, 0, start_off);
+                         nonstd::memcpy(frame + start_off, src + start_off,
+                                        end_off - start_off);
+                         nonstd::memset(frame + end_off, 0, PG_SZ - end_off);
+                       });
+      CHECK_RES;
     }
 
     const size_t full_pg_start = ceil_pg(phentry->vaddr);
@@ -411,13 +990,18 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
       // 3
       mmap(full_pg_end, PG_SZ, prot, flags_anon, fs::InvalidFD, 0, res);
       CHECK_RES;
-      copy_page(full_pg_end);
+      const std::byte *src =
+          get_page(phentry->offset + (full_pg_end - phentry->vaddr));
       CHECK_RES;
 
       const size_t pg_start = full_pg_end;
       const size_t end_off = (phentry->vaddr + phentry->filesz) - pg_start;
-      nonstd::memcpy((void *)pg_start, scoped_buf.get(), end_off);
-      nonstd::memset((void *)(pg_start + end_off), 0, PG_SZ - end_off);
+      map_private_page((void *)pg_start, prot, res,
+                       [&](std::byte *frame) {
+                         nonstd::memcpy(frame, src, end_off);
+                         nonstd::memset(frame + end_off, 0, PG_SZ - end_off);
+                       });
+      CHECK_RES;
     }
 
     const size_t memsz_ceil = ceil_pg(phentry->vaddr + phentry->memsz);
@@ -434,15 +1018,11 @@ void Process::map_elf_segments(nonstd::string_view bin_path, fs::Result &res) {
 }
 
 void Process::jump_to_userspace() {
-  // Set esp0 to the top of the current (4KB) stack. This will clobber
-  // the small part of the existing stack (which should only be the
-  // stack frame of \a jump_to_userspace), but that's okay and
-  // expected.
-  size_t esp0;
-  __asm__("mov %%esp, %0" : : "m"(esp0));
-  arch::gdt::set_tss_esp0((void *)util::algorithm::ceil_pow2<PG_SZ>(esp0));
-
-  arch::sched::enter_userspace(esp3, eip3);
+  // esp0 was set to the top of this thread's kernel stack by the
+  // scheduler. This will clobber the small part of the existing stack
+  // (which should only be the stack frame of \a jump_to_userspace) on
+  // the next entry into the kernel, but that's okay and expected.
+  arch::sched::enter_userspace(&user_regs);
 }
 
 } // namespace proc
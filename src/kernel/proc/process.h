@@ -17,10 +17,16 @@
 #include "fs/result.h"
 #include "fs/vfs.h"
 #include "page_table.h"
+#include "proc/syscalls.h"
 #include "sched/kthread.h"
+#include "stack.h"
+#include "util/intrusive_interval_tree.h"
+#include "util/intrusive_list.h"
 
 namespace proc {
 
+class IoRing;
+
 /// Representation of a memory mapping, a.k.a. "virtual memory area"
 /// or VMA. Akin to Linux's \a vm_area_struct.
 ///
@@ -28,7 +34,12 @@ namespace proc {
 /// maintains a reference count on a dentry. A \ref VirtualMemoryArea can only
 /// be created from an open \a fs::File, but does not require that the
 /// \a fs::File be kept open.
-class VirtualMemoryArea {
+///
+/// A process's VMAs are kept both in an address-sorted list and in an
+/// interval tree for lookup by address.
+class VirtualMemoryArea
+    : public util::IntrusiveListHead<VirtualMemoryArea>,
+      public util::IntrusiveIntervalTreeNode<VirtualMemoryArea> {
 public:
   struct Access {
     bool executable : 1 = false;
@@ -41,26 +52,81 @@ public:
     bool map_anon : 1 = false;
     bool map_private : 1 = false;
     bool map_shared : 1 = false;
-    uint8_t rsv0 : 5 = 0;
+    /// Map the whole range on mmap rather than on fault.
+    bool map_populate : 1 = false;
+    uint8_t rsv0 : 4 = 0;
   };
 
   VirtualMemoryArea(size_t addr, size_t len, Access prot, Flags flags,
                     fs::Dentry *dentry, size_t offset, fs::Result &res);
   ~VirtualMemoryArea();
 
-  NON_COPYABLE(VirtualMemoryArea);
+  NON_MOVABLE(VirtualMemoryArea);
+
+  /// Used by \ref util::IntrusiveIntervalTree.
+  size_t interval_start() const { return addr; }
+  size_t interval_end() const { return addr + len; }
+
+  /// Map the page containing \a addr (which must lie in this VMA) into
+  /// the current address space. Anonymous pages are zero-filled, and
+  /// file-backed pages are served from the inode's page cache.
+  ///
+  /// File-backed pages map the page cache frame directly, except that
+  /// write faults on writable \a map_private pages get a private copy.
+  /// Read faults on those map the frame read-only, and it is copied by
+  /// \ref write_fault() on the first write. Likewise, read faults
+  /// (\a write is false) on private anonymous pages map a shared zero
+  /// page read-only.
+  ///
+  /// Pages in the surrounding window of \ref fault_around_pages pages
+  /// are also mapped if they aren't already: anonymous pages are taken
+  /// from the pre-zeroed pool (see mm/zero_pool.h), or allocated and
+  /// zeroed a run at a time, and file-backed pages are mapped if they
+  /// are already in the page cache.
+  void fault(size_t addr, bool write, fs::Result &res) const;
+
+  /// Size of the fault-around window in pages. Must be a power of
+  /// two; 1 disables fault-around.
+  static inline size_t fault_around_pages = 16;
+
+  /// Map all unmapped pages in [\a start, \a end), reading in
+  /// file-backed pages as needed. Each run of anonymous pages is
+  /// allocated at once if memory isn't too fragmented. Used by \a
+  /// map_populate and madvise(WILLNEED).
+  void populate(size_t start, size_t end, fs::Result &res) const;
+
+  /// Read the file-backed pages in [\a start, \a end) into the page
+  /// cache without mapping them. Used by madvise(WILLNEED).
+  void prefetch(size_t start, size_t end, fs::Result &res) const;
+
+  /// Unmap [\a start, \a end). Frames whose last reference this was
+  /// are freed. Later accesses fault the pages in again; for private
+  /// anonymous memory, this means the contents are lost. Used by
+  /// madvise(DONTNEED), which doesn't allow shared anonymous VMAs.
+  void discard(size_t start, size_t end) const;
+
+  /// Handle a write to the present, read-only page containing \a
+  /// addr in this (writable) VMA. The page was write-protected by
+  /// fork, or is the zero page: \a map_shared pages and private pages
+  /// that are no longer shared are made writable, and other private
+  /// pages are copied.
+  void write_fault(size_t addr, fs::Result &res) const;
 
-  VirtualMemoryArea(VirtualMemoryArea &&vma) { *this = std::move(vma); }
-  VirtualMemoryArea &operator=(VirtualMemoryArea &&vma) {
-    std::swap(addr, vma.addr);
-    std::swap(len, vma.len);
-    std::swap(prot, vma.prot);
-    std::swap(flags, vma.flags);
-    std::swap(dentry, vma.dentry);
-    std::swap(offset, vma.offset);
-    return *this;
-  }
+private:
+  /// Map the unmapped pages in [\a start, \a end). File-backed pages
+  /// that aren't in the page cache are read in if \a read_in, and
+  /// are skipped otherwise. Writable private pages are only copied if
+  /// \a write. \see fault()
+  void map_pages(size_t start, size_t end, bool write, bool read_in,
+                 fs::Result &res) const;
+
+  /// Map the 4MB-aligned block \a blk (which must lie in this
+  /// anonymous VMA) with a zeroed hugepage. Fails if anything is
+  /// already mapped in the block, or if there is no 4MB-contiguous
+  /// free memory, in which case 4KB pages should be used.
+  bool map_huge_page(size_t blk) const;
 
+public:
   size_t addr;
   size_t len;
   Access prot;
@@ -86,6 +152,9 @@ class Process {
 public:
   Process(sched::Scheduler &sched, nonstd::string_view bin_path,
           fs::Result &res);
+  /// fork(): copy \a parent, which must be the current process. The
+  /// child resumes in userspace where \a ctx returns to.
+  Process(Process &parent, const SyscallContext &ctx, fs::Result &res);
   ~Process();
 
   fs::FileDescriptor open(nonstd::string_view path, fs::Result &res);
@@ -103,14 +172,21 @@ public:
              VirtualMemoryArea::Flags flags, fs::FileDescriptor fd,
              size_t offset, fs::Result &res);
   ssize_t read(fs::FileDescriptor fd, void *buf, size_t count, fs::Result &res);
+  void madvise(size_t addr, size_t length, Advice advice, fs::Result &res);
   void exit(int status);
+  void io_ring_setup(size_t addr, uint32_t entries, uint32_t flags,
+                     fs::Result &res);
+  uint32_t io_ring_enter(uint32_t to_submit, fs::Result &res);
 
-  /// Used by page fault handler.
-  const nonstd::list<VirtualMemoryArea> &get_vmas() const { return vmas; }
+  /// Returns the VMA containing \a addr, or nullptr if there is
+  /// none. Used by page fault handler.
+  const VirtualMemoryArea *find_vma(size_t addr);
 
   /// Used by scheduler.
   void enter_virtual_address_space() const;
 
+  sched::ThreadID get_tid() const { return tid; }
+
 private:
   /// Returns the smallest available file descriptor.
   fs::FileDescriptor get_next_fd();
@@ -126,19 +202,29 @@ private:
   sched::Scheduler &sched;
 
   /// Used by \ref jump_to_userspace.
-  void *eip3 = nullptr;
-  void *esp3 = nullptr;
+  arch::sched::UserRegisters user_regs{};
 
   sched::ThreadID tid = sched::InvalidTID;
 
   /// nullopt if file is closed.
   nonstd::vector<std::optional<fs::File>> fds;
 
-  /// Virtual memory areas/mappings, sorted by address.
-  nonstd::list<VirtualMemoryArea> vmas;
+  /// Virtual memory areas/mappings, sorted by address. These are
+  /// owned by the process.
+  util::IntrusiveListHead<VirtualMemoryArea> vmas;
+
+  /// Index of \ref vmas by address.
+  util::IntrusiveIntervalTree<VirtualMemoryArea> vma_tree;
+
+  /// The VMA last returned by \ref find_vma(). Faults tend to be
+  /// clustered in the same VMA (e.g., when touching a new buffer).
+  const VirtualMemoryArea *last_vma = nullptr;
 
   /// Virtual address space.
   arch::page_table::PageDirectoryEntry *page_directory;
+
+  /// Submission/completion rings, or nullptr if not set up.
+  IoRing *io_ring = nullptr;
 };
 
 } // namespace proc
@@ -0,0 +1,219 @@
+#include "proc/syscalls.h"
+#include "fs/result.h"
+#include "mm/virt.h"
+#include "nonstd/libc.h"
+#include "nonstd/polyfill.h"
+#include "perf.h"
+#include "proc/process.h"
+#include <array>
+#include <bit>
+
+namespace proc {
+
+namespace {
+
+using SyscallHandler = int32_t (*)(Process &, const SyscallContext &,
+                                   fs::Result &);
+
+/// Returns true if [addr, addr+len) lies entirely in userspace.
+bool user_range_ok(uint32_t addr, uint32_t len) {
+  return addr + len >= addr && addr + len <= mem::virt::hhdm_start;
+}
+
+/// Returns the userspace string at (\a addr, \a len), or sets \a res
+/// if it is not a valid userspace range.
+nonstd::string_view user_string(uint32_t addr, uint32_t len,
+                                fs::Result &res) {
+  if (!user_range_ok(addr, len)) {
+    res = fs::Result::BadAddress;
+    return {};
+  }
+  return {reinterpret_cast<const char *>(addr), len};
+}
+
+#define CHECK_RES                                                              \
+  if (res != fs::Result::Ok) {                                                 \
+    return -1;                                                                 \
+  }
+
+int32_t sys_exit(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  nonstd::printf("Processing exit syscall w/ retcode %u\r\n", ctx.args[0]);
+  proc.exit(ctx.args[0]);
+  __builtin_unreachable();
+}
+
+int32_t sys_read(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  if (!user_range_ok(ctx.args[1], ctx.args[2])) {
+    res = fs::Result::BadAddress;
+    return -1;
+  }
+  return proc.read(ctx.args[0], reinterpret_cast<void *>(ctx.args[1]),
+                   ctx.args[2], res);
+}
+
+int32_t sys_open(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  return proc.open(path, res);
+}
+
+int32_t sys_close(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  proc.close(ctx.args[0], res);
+  return 0;
+}
+
+int32_t sys_creat(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  proc.creat(path, res);
+  return 0;
+}
+
+int32_t sys_link(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto target = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  const auto link = user_string(ctx.args[2], ctx.args[3], res);
+  CHECK_RES;
+  proc.link(target, link, res);
+  return 0;
+}
+
+int32_t sys_unlink(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  proc.unlink(path, res);
+  return 0;
+}
+
+int32_t sys_lseek(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  if (ctx.args[2] > nonstd::to_underlying(Seek::End)) {
+    res = fs::Result::InvalidArgs;
+    return -1;
+  }
+  proc.lseek(ctx.args[0], static_cast<int32_t>(ctx.args[1]),
+             Seek{static_cast<int>(ctx.args[2])}, res);
+  return 0;
+}
+
+int32_t sys_mkdir(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  proc.mkdir(path, res);
+  return 0;
+}
+
+int32_t sys_rmdir(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  proc.rmdir(path, res);
+  return 0;
+}
+
+int32_t sys_truncate(Process &proc, const SyscallContext &ctx,
+                     fs::Result &res) {
+  const auto path = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  proc.truncate(path, ctx.args[2], res);
+  return 0;
+}
+
+int32_t sys_mmap(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  const auto prot =
+      std::bit_cast<VirtualMemoryArea::Access>(uint8_t(ctx.args[2]));
+  const auto flags =
+      std::bit_cast<VirtualMemoryArea::Flags>(uint8_t(ctx.args[2] >> 8));
+  if (!user_range_ok(ctx.args[0], ctx.args[1])) {
+    res = fs::Result::BadAddress;
+    return -1;
+  }
+  return reinterpret_cast<int32_t>(proc.mmap(ctx.args[0], ctx.args[1], prot,
+                                             flags, ctx.args[3], ctx.args[4],
+                                             res));
+}
+
+int32_t sys_null(Process &, const SyscallContext &, fs::Result &) { return 0; }
+
+int32_t sys_debug_print(Process &, const SyscallContext &ctx,
+                        fs::Result &res) {
+  const auto str = user_string(ctx.args[0], ctx.args[1], res);
+  CHECK_RES;
+  // TODO: nonstd::printf doesn't support precision ("%.*s") yet.
+  for (const char c : str) {
+    nonstd::printf("%c", c);
+  }
+  return 0;
+}
+
+int32_t sys_io_ring_setup(Process &proc, const SyscallContext &ctx,
+                          fs::Result &res) {
+  proc.io_ring_setup(ctx.args[0], ctx.args[1], ctx.args[2], res);
+  return 0;
+}
+
+int32_t sys_io_ring_enter(Process &proc, const SyscallContext &ctx,
+                          fs::Result &res) {
+  return proc.io_ring_enter(ctx.args[0], res);
+}
+
+int32_t sys_fork(Process &proc, const SyscallContext &ctx, fs::Result &res) {
+  auto *child = new Process(proc, ctx, res);
+  CHECK_RES;
+  return child->get_tid();
+}
+
+int32_t sys_madvise(Process &proc, const SyscallContext &ctx,
+                    fs::Result &res) {
+  if (!user_range_ok(ctx.args[0], ctx.args[1])) {
+    res = fs::Result::BadAddress;
+    return -1;
+  }
+  proc.madvise(ctx.args[0], ctx.args[1], Advice{ctx.args[2]}, res);
+  return 0;
+}
+
+#undef CHECK_RES
+
+/// Syscall table, indexed by syscall number. Unused entries are
+/// nullptr.
+constexpr auto syscall_table = [] {
+  std::array<SyscallHandler, nonstd::to_underlying(Syscall::Count)> table{};
+  const auto set = [&](Syscall nr, SyscallHandler handler) {
+    table[nonstd::to_underlying(nr)] = handler;
+  };
+  set(Syscall::Exit, sys_exit);
+  set(Syscall::Read, sys_read);
+  set(Syscall::Open, sys_open);
+  set(Syscall::Close, sys_close);
+  set(Syscall::Creat, sys_creat);
+  set(Syscall::Link, sys_link);
+  set(Syscall::Unlink, sys_unlink);
+  set(Syscall::Lseek, sys_lseek);
+  set(Syscall::Mkdir, sys_mkdir);
+  set(Syscall::Rmdir, sys_rmdir);
+  set(Syscall::Truncate, sys_truncate);
+  set(Syscall::Mmap, sys_mmap);
+  set(Syscall::Null, sys_null);
+  set(Syscall::DebugPrint, sys_debug_print);
+  set(Syscall::IoRingSetup, sys_io_ring_setup);
+  set(Syscall::IoRingEnter, sys_io_ring_enter);
+  set(Syscall::Fork, sys_fork);
+  set(Syscall::Madvise, sys_madvise);
+  return table;
+}();
+
+} // namespace
+
+int32_t do_syscall(Process &proc, SyscallContext &ctx) {
+  if (unlikely(ctx.nr >= syscall_table.size() ||
+               syscall_table[ctx.nr] == nullptr)) {
+    nonstd::printf("Unknown syscall %u\r\n", ctx.nr);
+    return -nonstd::to_underlying(fs::Result::Unsupported);
+  }
+
+  fs::Result res = fs::Result::Ok;
+  const int32_t rval = syscall_table[ctx.nr](proc, ctx, res);
+  return likely(res == fs::Result::Ok) ? rval
+                                       : -nonstd::to_underlying(res);
+}
+
+} // namespace proc
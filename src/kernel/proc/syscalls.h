@@ -1,14 +1,166 @@
 #pragma once
 
 /// \file syscalls.h
-/// \brief Syscall enum
+/// \brief Syscall enum and dispatch.
+///
+/// Syscall ABI (shared by the `int 0x80` and SYSENTER entry paths):
+/// - eax: syscall number (\ref Syscall)
+/// - ebx, ecx, edx, esi, edi: arguments 1-5
+/// - eax (return): the negated \ref fs::Result on failure (i.e., a
+///   value in [-4095, -1] when interpreted as signed), otherwise the
+///   syscall's return value. Note that mmap may successfully return
+///   addresses that are negative when interpreted as signed.
+///
+/// SYSENTER additionally requires that userspace pushes the return
+/// address onto its stack and passes its stack pointer in ebp, since
+/// SYSENTER doesn't save the return address. The kernel returns to
+/// that address with the return address popped off the user stack;
+/// ebp is not restored. E.g.:
+///
+///     push %ebp
+///     push $1f
+///     mov %esp, %ebp
+///     sysenter
+///   1:
+///     pop %ebp
+///
+/// ecx and edx are clobbered on the SYSENTER path (they hold the
+/// userspace stack and instruction pointer for SYSEXIT), and the
+/// direction flag is cleared (as at any call boundary in the SysV ABI).
+///
+/// This file is also included by userspace programs, so it should not
+/// depend on other kernel headers.
 
 #include <cstdint>
 
 namespace proc {
 
+/// Syscall numbers. Arguments are listed in register order.
 enum class Syscall : uint16_t {
-  Exit = 1,
+  Exit = 1,   /// (status)
+  Read,       /// (fd, buf, count) -> bytes read
+  Open,       /// (path, path_len) -> fd
+  Close,      /// (fd)
+  Creat,      /// (path, path_len)
+  Link,       /// (target, target_len, link, link_len)
+  Unlink,     /// (path, path_len)
+  Lseek,      /// (fd, offset, whence)
+  Mkdir,      /// (path, path_len)
+  Rmdir,      /// (path, path_len)
+  Truncate,   /// (path, path_len, len)
+  Mmap,       /// (addr, length, prot | flags << 8, fd, offset) -> addr
+  Null,       /// () -> 0. For benchmarking syscall overhead.
+  DebugPrint, /// (str, len). Print to the kernel console.
+  IoRingSetup, /// (addr, entries, flags). \see IoRingHeader
+  IoRingEnter, /// (to_submit) -> number of entries submitted
+  Fork,        /// () -> child pid in the parent, 0 in the child
+  Madvise,     /// (addr, length, advice). \see Advice
+
+  Count, /// Not a syscall; the number of syscall numbers.
+};
+
+/// madvise(2) advice. The values match Linux's.
+enum class Advice : uint32_t {
+  /// No special treatment.
+  Normal = 0,
+  /// Read file-backed pages into the page cache ahead of time.
+  WillNeed = 3,
+  /// Unmap the pages and free their frames. Private anonymous pages
+  /// are zero-filled on the next access. Not allowed on shared
+  /// anonymous mappings.
+  DontNeed = 4,
+};
+
+/// Register state at syscall entry. This is normalized across entry
+/// paths, which each build this on the kernel stack.
+///
+/// The layout is relied upon by the SYSENTER entry stub.
+struct SyscallContext {
+  uint32_t nr;
+  uint32_t args[5];
+
+  /// Where to return to in userspace.
+  uint32_t eip3;
+  uint32_t esp3;
+
+  /// Only meaningful for the `int 0x80` path; on the SYSENTER path
+  /// this is the userspace stack pointer.
+  uint32_t ebp;
+} __attribute__((packed));
+static_assert(sizeof(SyscallContext) == 9 * sizeof(uint32_t));
+
+/// \name io_ring ABI
+///
+/// A process may set up a pair of submission/completion rings shared
+/// with the kernel, to batch syscalls without a privilege transition
+/// per call. The rings live in a single shared mapping that starts
+/// with an \ref IoRingHeader.
+///
+/// - Userspace writes \ref IoRingSqe entries at `sq_tail`, then
+///   advances `sq_tail`. The kernel consumes entries from `sq_head`.
+///   Entries are consumed on \ref Syscall::IoRingEnter, or
+///   continuously by a kernel thread if \ref io_ring_sq_poll was set.
+/// - The kernel writes a \ref IoRingCqe per consumed entry at
+///   `cq_tail`. Userspace reaps completions from `cq_head` without
+///   trapping, then advances `cq_head`.
+///
+/// Heads and tails are free-running counters; the ring index is the
+/// counter modulo the (power-of-two) number of entries. Completions
+/// may arrive out of submission order, so they should be matched up
+/// using `user_data`.
+///
+/// Only \ref Syscall::Read, \ref Syscall::Open, \ref Syscall::Close,
+/// \ref Syscall::Lseek and \ref Syscall::Null may be submitted.
+/// Others complete with \ref fs::Result::Unsupported.
+///
+/// @{
+
+/// A syscall to be executed by the kernel.
+struct IoRingSqe {
+  uint32_t nr;
+  uint32_t args[5];
+  uint32_t user_data;
+  uint32_t rsv0;
+};
+static_assert(sizeof(IoRingSqe) == 32);
+
+/// The result of an \ref IoRingSqe.
+struct IoRingCqe {
+  uint32_t user_data;
+  /// Same encoding as a syscall return value.
+  int32_t res;
+};
+static_assert(sizeof(IoRingCqe) == 8);
+
+struct IoRingHeader {
+  uint32_t sq_head; /// Written by kernel.
+  uint32_t sq_tail; /// Written by userspace.
+  uint32_t cq_head; /// Written by userspace.
+  uint32_t cq_tail; /// Written by kernel.
+
+  uint32_t sq_entries;
+  uint32_t cq_entries;
+
+  /// Byte offsets of the SQE/CQE arrays from the start of the header.
+  uint32_t sq_off;
+  uint32_t cq_off;
 };
 
-}
+/// \ref Syscall::IoRingSetup flag: spawn a kernel thread that polls
+/// the submission queue, so \ref Syscall::IoRingEnter isn't needed.
+constexpr uint32_t io_ring_sq_poll = 1 << 0;
+
+/// Maximum number of submission queue entries.
+constexpr uint32_t io_ring_max_entries = 1024;
+
+/// @}
+
+class Process;
+
+/// Dispatch a syscall to the handler for \a ctx.nr in the syscall
+/// table.
+///
+/// \return the value to return to userspace in eax.
+int32_t do_syscall(Process &proc, SyscallContext &ctx);
+
+} // namespace proc
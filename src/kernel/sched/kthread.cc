@@ -1,9 +1,11 @@
 #include "sched/kthread.h"
 #include "asm.h"
+#include "fpu.h"
+#include "gdt.h"
 #include "memdefs.h"
 #include "mm/kmalloc.h"
+#include "nonstd/flat_hash_map.h"
 #include "nonstd/libc.h"
-#include "nonstd/node_hash_map.h"
 #include "perf.h"
 #include "proc/process.h"
 #include "sched/lock.h"
@@ -17,9 +19,36 @@
 
 namespace sched {
 
+namespace {
+
+/// The thread whose state is in the FPU registers, if any. This is
+/// global rather than per-Scheduler, since there is only one FPU.
+KernelThread *fpu_owner = nullptr;
+
+/// Set between \ref kernel_fpu_begin() and \ref kernel_fpu_end().
+bool in_kernel_fpu = false;
+unsigned kernel_fpu_eflags;
+
+/// \see \ref KernelThread::fpu_buf.
+std::byte *alloc_fpu_buf() {
+  auto *buf = reinterpret_cast<std::byte *>(::operator new(
+      sizeof(arch::fpu::State) + alignof(arch::fpu::State) - 1));
+  ASSERT(buf != nullptr);
+  return buf;
+}
+
+} // namespace
+
 KernelThread::KernelThread(Scheduler &_scheduler, void *_stack)
     : stack{_stack}, scheduler(_scheduler) {}
 
+arch::fpu::State *KernelThread::fpu_state() const {
+  ASSERT(fpu_buf != nullptr);
+  return reinterpret_cast<arch::fpu::State *>(
+      util::algorithm::ceil_pow2<alignof(arch::fpu::State)>(
+          (size_t)fpu_buf));
+}
+
 Scheduler::Scheduler() {
   // Insert a dummy TID at \a InvalidTID, so no process ever uses it.
   tid_map.emplace(InvalidTID, nullptr);
@@ -56,6 +85,7 @@ ThreadID Scheduler::new_thread(proc::Process *proc, void (*fcn)(void *),
   auto *thread = new KernelThread(*this);
   ASSERT(thread != nullptr);
   assign_next_tid(thread);
+  thread->stack_top = stk;
   thread->stack = arch::sched::setup_stack(stk, thread, fcn, data);
   thread->proc = proc;
 
@@ -108,8 +138,18 @@ void Scheduler::schedule(bool switch_stack) {
   runnable.push_back(*current_task);
   context_switch_start = arch::time::rdtsc();
 
+  // Trap on the new task's first FPU instruction, unless the
+  // registers already hold its state.
+  if (arch::fpu::enabled()) {
+    arch::fpu::set_task_switched(new_task != fpu_owner);
+  }
+
   if (new_task->proc != nullptr) {
     new_task->proc->enter_virtual_address_space();
+
+    // Interrupts and syscalls from userspace (both `int 0x80` and
+    // SYSENTER) enter on this thread's kernel stack.
+    arch::gdt::set_tss_esp0(new_task->stack_top);
   }
 
   // Unit tests aren't multithreaded, don't actually switch stacks but
@@ -127,10 +167,11 @@ void Scheduler::print_stats() const {
   nonstd::printf("scheduler stats:\r\n"
                  "\tcontext switches: %u\r\n"
                  "\tcycles/switch: %llu\r\n"
+                 "\tFPU traps: %u\r\n"
                  "\trunnable count: %u\r\n",
                  context_switch_count,
                  context_switch_cum_cycles / context_switch_count,
-                 runnable.size());
+                 fpu_trap_count, runnable.size());
 }
 
 void Scheduler::post_context_switch_bookkeeping() {
@@ -186,6 +227,13 @@ void Scheduler::delete_task(KernelThread *thread) {
   thread->erase();
   tid_map.erase(thread->tid);
 
+  if (thread->fpu_buf != nullptr) {
+    if (fpu_owner == thread) {
+      fpu_owner = nullptr;
+    }
+    ::operator delete(thread->fpu_buf);
+  }
+
   // TODO: use std::byte* in more places rather than void*
   auto *stack_pg =
       (std::byte *)util::algorithm::floor_pow2<PG_SZ>((size_t)thread->stack);
@@ -193,6 +241,55 @@ void Scheduler::delete_task(KernelThread *thread) {
   delete thread;
 }
 
+void Scheduler::handle_fpu_trap() {
+  IrqGuard guard;
+  ASSERT(running);
+  ASSERT(arch::fpu::enabled());
+  ASSERT(!in_kernel_fpu);
+  arch::fpu::set_task_switched(false);
+  ++fpu_trap_count;
+  if (fpu_owner == running) {
+    return;
+  }
+
+  if (fpu_owner != nullptr) {
+    arch::fpu::save(*fpu_owner->fpu_state());
+  }
+  if (running->fpu_buf == nullptr) {
+    running->fpu_buf = alloc_fpu_buf();
+    arch::fpu::reset();
+  } else {
+    arch::fpu::restore(*running->fpu_state());
+  }
+  fpu_owner = running;
+}
+
+void Scheduler::copy_fpu_state(ThreadID from, ThreadID to) {
+  IrqGuard guard;
+  const auto from_it = tid_map.find(from);
+  const auto to_it = tid_map.find(to);
+  ASSERT(from_it != tid_map.end() && to_it != tid_map.end());
+  const KernelThread *src = from_it->second;
+  KernelThread *dst = to_it->second;
+  ASSERT(dst->fpu_buf == nullptr);
+  if (src->fpu_buf == nullptr) {
+    // The FPU will be initialized on first use, as for \a src.
+    return;
+  }
+
+  if (fpu_owner == src) {
+    // Bring the saved state up to date. The registers stay valid, so
+    // \a src keeps ownership.
+    const bool ts = arch::fpu::task_switched();
+    arch::fpu::set_task_switched(false);
+    arch::fpu::save(*src->fpu_state());
+    arch::fpu::set_task_switched(ts);
+  }
+  dst->fpu_buf = alloc_fpu_buf();
+  nonstd::memcpy(dst->fpu_state(), src->fpu_state(),
+                 sizeof(arch::fpu::State));
+}
+
 void Scheduler::assign_next_tid(KernelThread *new_thread) {
   // No available IDs. Note that the \ref InvalidTID ThreadID is
   // already consumed by a dummy entry, so the loop below will skip
@@ -204,6 +301,29 @@ void Scheduler::assign_next_tid(KernelThread *new_thread) {
   new_thread->tid = tid_counter - 1;
 }
 
+void kernel_fpu_begin() {
+  const unsigned eflags = irq_save();
+  ASSERT(arch::fpu::enabled());
+  ASSERT(!in_kernel_fpu);
+  in_kernel_fpu = true;
+  kernel_fpu_eflags = eflags;
+
+  arch::fpu::set_task_switched(false);
+  if (fpu_owner != nullptr) {
+    arch::fpu::save(*fpu_owner->fpu_state());
+    fpu_owner = nullptr;
+  }
+}
+
+void kernel_fpu_end() {
+  ASSERT(in_kernel_fpu);
+  in_kernel_fpu = false;
+  // The registers no longer belong to any thread, so the next thread
+  // to use them has to restore its state.
+  arch::fpu::set_task_switched(true);
+  irq_restore(kernel_fpu_eflags);
+}
+
 extern "C" {
 void on_thread_start(KernelThread *thread, void (*fcn)(void *), void *data) {
   ASSERT(thread);
@@ -16,14 +16,19 @@
 /// TODO: pre-emptive scheduling (timer interrupt) and synchronization
 /// primitives
 
-#include "nonstd/node_hash_map.h"
+#include "nonstd/flat_hash_map.h"
 #include "util/assert.h"
 #include "util/intrusive_list.h"
+#include <cstddef>
 
 namespace proc {
 class Process;
 }
 
+namespace arch::fpu {
+struct State;
+}
+
 namespace sched {
 
 class Scheduler;
@@ -56,6 +61,12 @@ private:
   KernelThread(Scheduler &, void *stack = nullptr);
 
   void *stack;
+
+  /// Top of the thread's kernel stack. This is the kernel stack
+  /// pointer on entry from userspace. nullptr for the bootstrapped
+  /// thread.
+  void *stack_top = nullptr;
+
   Scheduler &scheduler;
   bool runnable = true;
 
@@ -67,8 +78,17 @@ private:
   /// this is a purely kernel thread.
   proc::Process *proc;
 
+  /// FPU/SSE state, allocated when the thread first uses the FPU
+  /// (see \ref Scheduler::handle_fpu_trap()). This is over-allocated,
+  /// since the kernel heap doesn't guarantee the 16-byte alignment
+  /// that FXSAVE requires; use \ref fpu_state().
+  std::byte *fpu_buf = nullptr;
+
+  arch::fpu::State *fpu_state() const;
+
   friend class Scheduler;
   friend void on_thread_start(KernelThread *, void (*)(void *), void *data);
+  friend void kernel_fpu_begin();
   friend class TestScheduler;
 };
 
@@ -113,6 +133,32 @@ public:
     return destroy_thread(/*thread=*/it->second, /*switch_stack=*/true);
   }
 
+  /// Destroy the running thread. Threads must call this rather than
+  /// return from their entry function.
+  __attribute__((noreturn)) void exit_thread() {
+    destroy_thread(/*thread=*/nullptr, /*switch_stack=*/true);
+    __builtin_unreachable();
+  }
+
+  /// \brief Handle #NM (device not available), i.e., the running
+  /// thread's first FPU/SSE instruction since it was scheduled.
+  ///
+  /// CR0.TS is set whenever we switch to a thread whose state isn't
+  /// in the FPU registers. Here, the registers are saved to the
+  /// thread that owns them, and the running thread's state is
+  /// restored (or initialized, on its first use). Threads that never
+  /// use the FPU never pay for saving or restoring it.
+  void handle_fpu_trap();
+
+  /// Give \a to a copy of the FPU state of \a from (e.g., on fork).
+  /// \a to must not have used the FPU yet.
+  void copy_fpu_state(ThreadID from, ThreadID to);
+
+  /// The running thread, or \ref InvalidTID before \ref bootstrap().
+  ThreadID running_tid() const {
+    return running ? running->tid : InvalidTID;
+  }
+
   proc::Process *curr_proc() const {
     return curr_proc_override ? curr_proc_override
                               : (running ? running->proc : nullptr);
@@ -197,9 +243,12 @@ private:
   uint64_t context_switch_cum_cycles = 0;
   uint64_t context_switch_start;
 
+  /// Number of calls to \ref handle_fpu_trap().
+  unsigned fpu_trap_count = 0;
+
   /// Thread ID management.
   ThreadID tid_counter = 0;
-  nonstd::node_hash_map<ThreadID, sched::KernelThread *> tid_map;
+  nonstd::flat_hash_map<ThreadID, sched::KernelThread *> tid_map;
 
   /// \see \ref override_curr_proc().
   proc::Process *curr_proc_override = nullptr;
@@ -208,4 +257,15 @@ private:
                                        void *data);
 };
 
+/// \brief Allow the kernel to use the FPU/SSE registers until \ref
+/// kernel_fpu_end().
+///
+/// Any thread's state in the registers is saved first. Interrupts
+/// (and thus preemption) are disabled in between, so the section
+/// should be short, and must not sleep or nest.
+void kernel_fpu_begin();
+
+/// \see \ref kernel_fpu_begin().
+void kernel_fpu_end();
+
 } // namespace sched
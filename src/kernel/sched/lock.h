@@ -7,6 +7,8 @@
 /// TODO: we also need mutex (non-blocking) primitives
 /// TODO: we also need condvar/semaphore signaling primitives
 
+#include "util/objutil.h"
+
 namespace sched {
 
 /// Mutually exclusive lock in a uniprocessor system.
@@ -21,4 +23,35 @@ __attribute__((always_inline)) inline void mutex_unlock() {
   __asm__ volatile("sti");
 }
 
+/// Disables interrupts.
+///
+/// \return the previous eflags, to pass to \ref irq_restore().
+__attribute__((always_inline)) inline unsigned irq_save() {
+  unsigned eflags;
+  __asm__ volatile("pushf\n\tpop %0\n\tcli" : "=r"(eflags) : : "memory");
+  return eflags;
+}
+
+/// Re-enables interrupts if they were enabled before the matching
+/// \ref irq_save().
+__attribute__((always_inline)) inline void irq_restore(unsigned eflags) {
+  if (eflags & (1 << 9)) {
+    __asm__ volatile("sti" : : : "memory");
+  }
+}
+
+/// Disables interrupts for the lifetime of the guard, and then
+/// restores the previous interrupt flag. Unlike \ref mutex_lock() and
+/// \ref mutex_unlock(), this may be used where interrupts may already
+/// be disabled.
+class IrqGuard {
+public:
+  IrqGuard() : eflags{irq_save()} {}
+  ~IrqGuard() { irq_restore(eflags); }
+  NON_COPYABLE(IrqGuard);
+
+private:
+  unsigned eflags;
+};
+
 } // namespace sched
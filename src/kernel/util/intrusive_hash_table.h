@@ -0,0 +1,181 @@
+#pragma once
+
+/// \file
+/// \brief Intrusive chained hash table, inspired by Linux's hlist.
+
+#include "nonstd/allocator.h"
+#include "util/assert.h"
+#include "util/objutil.h"
+#include <algorithm>
+#include <cstddef>
+
+namespace util {
+
+template <typename Parent, typename Tag> class IntrusiveHashTable;
+
+/// \brief Hash table hook for \ref IntrusiveHashTable. Like \ref
+/// IntrusiveListHead, `Parent` should inherit from this.
+///
+/// The hook caches the node's hash, so that lookups only compare keys
+/// of nodes with a matching hash, and resizing doesn't need to rehash
+/// the keys.
+template <typename Parent, typename Tag = void> class IntrusiveHashTableNode {
+  friend IntrusiveHashTable<Parent, Tag>;
+
+public:
+  /// Whether this node is in a table.
+  bool linked() const { return pprev != nullptr; }
+  /// Only valid if \ref linked().
+  size_t cached_hash() const { return hash; }
+
+private:
+  /// Next node in the bucket's chain.
+  Parent *next = nullptr;
+  /// The previous node's \ref next, or the bucket, so that a node can
+  /// be unlinked without walking its chain.
+  Parent **pprev = nullptr;
+  size_t hash = 0;
+};
+
+/// \brief An intrusive hash table with separate chaining.
+///
+/// The table doesn't own its nodes, so insertion and removal don't
+/// allocate, other than to grow the bucket array. Nodes never move, so
+/// resizing doesn't invalidate pointers to them. A node may be in at
+/// most one table (per `Tag`) at a time.
+///
+/// Keys are up to `Parent`: the caller provides each node's hash on
+/// insertion and a key comparison on lookup. The bucket is chosen by
+/// the low bits of the hash, so it should be well-mixed.
+///
+template <typename Parent, typename Tag = void> class IntrusiveHashTable {
+  using Node = IntrusiveHashTableNode<Parent, Tag>;
+  using BucketAllocator = nonstd::Mallocator<Parent *>;
+
+public:
+  IntrusiveHashTable() = default;
+  ~IntrusiveHashTable() {
+    // The nodes outlive the table.
+    for (size_t i = 0; i < _bucket_count; ++i) {
+      for (Parent *it = buckets[i]; it != nullptr;) {
+        Parent *const next = node(*it).next;
+        node(*it) = Node{};
+        it = next;
+      }
+    }
+    if (buckets != nullptr) {
+      BucketAllocator{}.deallocate(buckets, _bucket_count);
+    }
+  }
+
+  NON_MOVABLE(IntrusiveHashTable);
+
+  bool empty() const { return count == 0; }
+  size_t size() const { return count; }
+  size_t bucket_count() const { return _bucket_count; }
+
+  /// \a p must not be in a table. Duplicate keys are allowed; \ref
+  /// find() returns the most recently inserted one.
+  void insert(Parent &p, size_t hash) {
+    ASSERT(!node(p).linked());
+    if (count + 1 > _bucket_count) {
+      rehash(std::max(2 * _bucket_count, min_bucket_count));
+    }
+    node(p).hash = hash;
+    link(p);
+    ++count;
+  }
+
+  /// \a p must be in this table.
+  void erase(Parent &p) {
+    Node &n = node(p);
+    ASSERT(n.linked());
+    *n.pprev = n.next;
+    if (n.next != nullptr) {
+      node(*n.next).pprev = n.pprev;
+    }
+    n = Node{};
+    --count;
+  }
+
+  /// \return the node with hash \a hash for which \a eq returns true,
+  /// or nullptr if none.
+  template <typename Eq> Parent *find(size_t hash, Eq &&eq) const {
+    if (_bucket_count == 0) {
+      return nullptr;
+    }
+    for (Parent *it = buckets[hash & (_bucket_count - 1)]; it != nullptr;
+         it = node(*it).next) {
+      if (node(*it).hash == hash && eq(static_cast<const Parent &>(*it))) {
+        return it;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Call \a fcn on every node, in no particular order. \a fcn must
+  /// not modify the table.
+  template <typename F> void for_each(F &&fcn) const {
+    for (size_t i = 0; i < _bucket_count; ++i) {
+      for (Parent *it = buckets[i]; it != nullptr; it = node(*it).next) {
+        fcn(*it);
+      }
+    }
+  }
+
+  /// Resize the bucket array to the smallest power of two that is at
+  /// least \a count and can hold the current nodes, relinking each
+  /// node by its cached hash.
+  void rehash(size_t count) {
+    size_t new_bucket_count = min_bucket_count;
+    while (new_bucket_count < count || new_bucket_count < this->count) {
+      new_bucket_count *= 2;
+    }
+    if (new_bucket_count == _bucket_count) {
+      return;
+    }
+
+    Parent **const old_buckets = buckets;
+    const size_t old_bucket_count = _bucket_count;
+    buckets = BucketAllocator{}.allocate(new_bucket_count);
+    _bucket_count = new_bucket_count;
+    std::fill_n(buckets, _bucket_count, nullptr);
+    for (size_t i = 0; i < old_bucket_count; ++i) {
+      for (Parent *it = old_buckets[i]; it != nullptr;) {
+        Parent *const next = node(*it).next;
+        link(*it);
+        it = next;
+      }
+    }
+    if (old_buckets != nullptr) {
+      BucketAllocator{}.deallocate(old_buckets, old_bucket_count);
+    }
+  }
+
+private:
+  static constexpr size_t min_bucket_count = 16;
+
+  static Node &node(Parent &p) { return static_cast<Node &>(p); }
+  static const Node &node(const Parent &p) {
+    return static_cast<const Node &>(p);
+  }
+
+  /// Push \a p onto the front of its bucket's chain.
+  void link(Parent &p) {
+    Node &n = node(p);
+    Parent *&head = buckets[n.hash & (_bucket_count - 1)];
+    n.next = head;
+    if (head != nullptr) {
+      node(*head).pprev = &n.next;
+    }
+    n.pprev = &head;
+    head = &p;
+  }
+
+  /// A power of two, or 0 if nothing is allocated.
+  size_t _bucket_count = 0;
+  size_t count = 0;
+  Parent **buckets = nullptr;
+};
+
+} // namespace util
@@ -0,0 +1,261 @@
+#pragma once
+
+/// \file
+/// \brief Intrusive interval tree (augmented AVL tree).
+
+#include "util/assert.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace util {
+
+template <typename Parent, typename Tag> class IntrusiveIntervalTree;
+
+/// \brief Tree hook for \ref IntrusiveIntervalTree. Like \ref
+/// IntrusiveListHead, `Parent` should inherit from this.
+///
+/// `Parent` must provide the half-open interval it spans via
+/// `size_t interval_start() const` and `size_t interval_end() const`.
+/// The interval must not change while the node is in a tree.
+template <typename Parent, typename Tag = void>
+class IntrusiveIntervalTreeNode {
+  friend IntrusiveIntervalTree<Parent, Tag>;
+
+  Parent *left = nullptr;
+  Parent *right = nullptr;
+
+  /// Maximum \a interval_end() in this subtree.
+  size_t max_end = 0;
+
+  /// Height of this subtree. Leaves have height 1.
+  uint8_t height = 0;
+};
+
+/// \brief An intrusive, augmented AVL tree of intervals, ordered by
+/// interval start. Each node caches the maximum interval end in its
+/// subtree, so that overlap queries are O(log n).
+///
+/// The tree doesn't own its nodes. A node may be in at most one tree
+/// (per `Tag`) at a time.
+///
+/// Insertion and removal are recursive, but the recursion depth is
+/// bounded by the tree height (< 1.45 * log2(n)).
+///
+template <typename Parent, typename Tag = void> class IntrusiveIntervalTree {
+  using Node = IntrusiveIntervalTreeNode<Parent, Tag>;
+
+public:
+  IntrusiveIntervalTree() = default;
+
+  bool empty() const { return root == nullptr; }
+  size_t size() const { return count; }
+
+  void insert(Parent &p) {
+    node(p) = Node{};
+    root = insert(root, p);
+    ++count;
+  }
+
+  /// \a p must be in this tree.
+  void erase(Parent &p) {
+    root = erase(root, p);
+    --count;
+  }
+
+  /// \return an interval containing \a point, or nullptr if none.
+  Parent *find(size_t point) const { return find_overlap(point, point + 1); }
+
+  /// \return the interval with the smallest start that overlaps [\a
+  /// start, \a end), or nullptr if none.
+  Parent *find_overlap(size_t start, size_t end) const {
+    return find_overlap(root, start, end);
+  }
+
+  /// \return the interval with the smallest start >= \a start, or
+  /// nullptr if none.
+  Parent *lower_bound(size_t start) const {
+    Parent *rval = nullptr;
+    for (Parent *it = root; it != nullptr;) {
+      if (it->interval_start() >= start) {
+        rval = it;
+        it = node(*it).left;
+      } else {
+        it = node(*it).right;
+      }
+    }
+    return rval;
+  }
+
+  /// Call \a fcn on every interval, in order.
+  template <typename F> void for_each(F &&fcn) const { for_each(root, fcn); }
+
+  /// Remove all intervals. This doesn't touch the nodes.
+  void clear() {
+    root = nullptr;
+    count = 0;
+  }
+
+private:
+  static Node &node(Parent &p) { return static_cast<Node &>(p); }
+  static const Node &node(const Parent &p) {
+    return static_cast<const Node &>(p);
+  }
+
+  static uint8_t height(const Parent *p) {
+    return p == nullptr ? 0 : node(*p).height;
+  }
+  static int balance(const Parent &p) {
+    return int(height(node(p).left)) - int(height(node(p).right));
+  }
+
+  /// Recompute the cached height and max end of \a p from its
+  /// children.
+  static void update(Parent &p) {
+    Node &n = node(p);
+    n.height = std::max(height(n.left), height(n.right)) + 1;
+    n.max_end = p.interval_end();
+    if (n.left != nullptr) {
+      n.max_end = std::max(n.max_end, node(*n.left).max_end);
+    }
+    if (n.right != nullptr) {
+      n.max_end = std::max(n.max_end, node(*n.right).max_end);
+    }
+  }
+
+  static Parent *rotate_right(Parent &p) {
+    Parent &l = *node(p).left;
+    node(p).left = node(l).right;
+    node(l).right = &p;
+    update(p);
+    update(l);
+    return &l;
+  }
+
+  static Parent *rotate_left(Parent &p) {
+    Parent &r = *node(p).right;
+    node(p).right = node(r).left;
+    node(r).left = &p;
+    update(p);
+    update(r);
+    return &r;
+  }
+
+  /// Restore the AVL invariant at \a p, whose subtrees' heights
+  /// differ by at most 2.
+  static Parent *rebalance(Parent &p) {
+    update(p);
+    const int bal = balance(p);
+    if (bal > 1) {
+      if (balance(*node(p).left) < 0) {
+        node(p).left = rotate_left(*node(p).left);
+      }
+      return rotate_right(p);
+    }
+    if (bal < -1) {
+      if (balance(*node(p).right) > 0) {
+        node(p).right = rotate_right(*node(p).right);
+      }
+      return rotate_left(p);
+    }
+    return &p;
+  }
+
+  /// Total order on nodes: by interval start, with ties broken by
+  /// address.
+  static bool less(const Parent &a, const Parent &b) {
+    return a.interval_start() != b.interval_start()
+               ? a.interval_start() < b.interval_start()
+               : &a < &b;
+  }
+
+  static Parent *insert(Parent *subtree, Parent &p) {
+    if (subtree == nullptr) {
+      update(p);
+      return &p;
+    }
+    Node &n = node(*subtree);
+    if (less(p, *subtree)) {
+      n.left = insert(n.left, p);
+    } else {
+      n.right = insert(n.right, p);
+    }
+    return rebalance(*subtree);
+  }
+
+  /// Remove the minimum node of \a subtree, and store it in \a min.
+  static Parent *erase_min(Parent &subtree, Parent *&min) {
+    Node &n = node(subtree);
+    if (n.left == nullptr) {
+      min = &subtree;
+      return n.right;
+    }
+    n.left = erase_min(*n.left, min);
+    return rebalance(subtree);
+  }
+
+  static Parent *erase(Parent *subtree, Parent &p) {
+    ASSERT(subtree != nullptr);
+    Node &n = node(*subtree);
+    if (subtree != &p) {
+      if (less(p, *subtree)) {
+        n.left = erase(n.left, p);
+      } else {
+        n.right = erase(n.right, p);
+      }
+      return rebalance(*subtree);
+    }
+
+    if (n.left == nullptr || n.right == nullptr) {
+      return n.left != nullptr ? n.left : n.right;
+    }
+
+    // Replace \a p with its in-order successor.
+    Parent *succ;
+    Parent *right = erase_min(*n.right, succ);
+    node(*succ).left = n.left;
+    node(*succ).right = right;
+    return rebalance(*succ);
+  }
+
+  static Parent *find_overlap(Parent *subtree, size_t start, size_t end) {
+    while (subtree != nullptr) {
+      const Node &n = node(*subtree);
+      if (n.max_end <= start) {
+        return nullptr;
+      }
+
+      // If the left subtree may overlap, the answer must be there,
+      // since any overlapping interval on the left would come before
+      // this one. If nothing there overlaps, then all intervals in the
+      // left subtree that end after \a start begin at or after \a end,
+      // and so do this node and its right subtree.
+      if (n.left != nullptr && node(*n.left).max_end > start) {
+        return find_overlap(n.left, start, end);
+      }
+
+      if (subtree->interval_start() >= end) {
+        return nullptr;
+      }
+      if (subtree->interval_end() > start) {
+        return subtree;
+      }
+      subtree = n.right;
+    }
+    return nullptr;
+  }
+
+  template <typename F> static void for_each(Parent *subtree, F &fcn) {
+    if (subtree == nullptr) {
+      return;
+    }
+    for_each(node(*subtree).left, fcn);
+    fcn(*subtree);
+    for_each(node(*subtree).right, fcn);
+  }
+
+  Parent *root = nullptr;
+  size_t count = 0;
+};
+
+} // namespace util
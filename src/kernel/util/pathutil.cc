@@ -18,4 +18,11 @@ left_partition_path(nonstd::string_view path) {
              : std::pair{path, ""};
 }
 
+std::pair<nonstd::string_view, nonstd::string_view>
+left_partition_path(nonstd::string_view path, size_t &component_hash) {
+  const auto partitioned = left_partition_path(path);
+  component_hash = nonstd::hash<nonstd::string_view>{}(partitioned.first);
+  return partitioned;
+}
+
 } // namespace util::path
@@ -20,4 +20,11 @@ inline nonstd::string_view basename(nonstd::string_view path) {
 std::pair<nonstd::string_view, nonstd::string_view>
 left_partition_path(nonstd::string_view path);
 
+/// Like \ref left_partition_path(), but also returns the hash of the
+/// first component (as \ref nonstd::hash<nonstd::string_view> would
+/// compute it) in \a component_hash, so that a lookup by component
+/// doesn't hash it again.
+std::pair<nonstd::string_view, nonstd::string_view>
+left_partition_path(nonstd::string_view path, size_t &component_hash);
+
 } // namespace util::path
@@ -2,11 +2,13 @@
 #include "boot_protocol.h"
 #include "drivers/acpi.h"
 #include "drivers/serial.h"
+#include "fpu.h"
 #include "gdt.h"
 #include "idt.h"
 #include "mm/kmalloc.h"
 #include "mm/page_frame_allocator.h"
 #include "mm/page_frame_table.h"
+#include "mm/virt.h"
 #include "nonstd/libc.h"
 #include "proc/process.h"
 #include "test.h"
@@ -14,6 +16,10 @@
 static volatile const BP_REQ(MEMORY_MAP, _mem_map_req);
 
 void do_schedule() {}
+void do_fpu_trap() {
+  // There are no threads to switch FPU state between.
+  arch::fpu::set_task_switched(false);
+}
 proc::Process *curr_proc() {
   ASSERT(false);
   __builtin_unreachable();
@@ -47,7 +53,8 @@ __attribute__((section(".text.entry"))) void _entry() {
         _mem_map_req.memory_map,
         static_cast<size_t>(ent - _mem_map_req.memory_map)};
     mem::phys::PageFrameTable pft(mem_map);
-    mem::phys::SimplePFA simple_allocator{pft, 0, pft.mem_limit()};
+    mem::phys::SimplePFA simple_allocator{
+        pft, 0, std::min<uint64_t>(pft.mem_limit(), mem::virt::hhdm_len)};
     mem::set_pfa(&simple_allocator); // for simple kmalloc
   }
 
@@ -0,0 +1,194 @@
+#include "../test.h"
+#include "fs/vfs.h"
+#include "nonstd/string.h"
+#include "nonstd/string_view.h"
+#include "nonstd/vector.h"
+#include <cstdint>
+
+/// \file Test the dcache against an in-memory filesystem, counting
+/// how often the VFS has to fall back to the filesystem's lookup().
+
+namespace {
+
+/// A flat directory of empty files.
+class FakeInode final : public fs::Inode {
+public:
+  FakeInode(bool _is_directory) : fs::Inode{next_id++, _is_directory} {}
+
+  ssize_t read(void *, size_t, size_t, fs::Result &res) final {
+    res = fs::Result::Ok;
+    return 0;
+  }
+  fs::Result write(void *, size_t, size_t) final {
+    return fs::Result::Unsupported;
+  }
+  fs::Result truncate(size_t) final { return fs::Result::Unsupported; }
+  fs::Result mmap(void *, size_t, size_t) final {
+    return fs::Result::Unsupported;
+  }
+  fs::Result flush() final { return fs::Result::Ok; }
+
+  fs::Result creat(nonstd::string_view name) final {
+    names.push_back(nonstd::string{name});
+    return fs::Result::Ok;
+  }
+  fs::Result mkdir(nonstd::string_view) final {
+    return fs::Result::Unsupported;
+  }
+  fs::Result rmdir(nonstd::string_view) final {
+    return fs::Result::Unsupported;
+  }
+  fs::Result link(fs::Inode &, nonstd::string_view) final {
+    return fs::Result::Unsupported;
+  }
+  fs::Result unlink() final { return fs::Result::Unsupported; }
+
+  fs::Inode *lookup(nonstd::string_view name, fs::Result &res) const final {
+    ++lookup_count;
+    for (const auto &it : names) {
+      if (nonstd::string_view{it} == name) {
+        res = fs::Result::Ok;
+        return new FakeInode{/*_is_directory=*/false};
+      }
+    }
+    res = fs::Result::FileNotFound;
+    return nullptr;
+  }
+
+  nonstd::vector<nonstd::string> names;
+
+  static inline unsigned next_id = 0;
+  static inline unsigned lookup_count = 0;
+};
+
+class FakeFilesystem final : public fs::Filesystem {
+public:
+  FakeFilesystem()
+      : root_inode{new FakeInode{/*_is_directory=*/true}},
+        root_dentry{new fs::Dentry{/*parent=*/nullptr, *root_inode, "/"}} {
+    // Never freed, like the FAT32 root.
+    root_dentry->inc_rc();
+    fs::init(*this);
+  }
+
+  fs::Dentry *get_root_dentry() final { return root_dentry; }
+
+  FakeInode *root_inode;
+  fs::Dentry *root_dentry;
+};
+
+} // namespace
+
+TEST(fs, dcache_positive) {
+  FakeFilesystem filesystem;
+  filesystem.root_inode->names.push_back("FOO");
+
+  const unsigned start_lookups = FakeInode::lookup_count;
+  fs::Result res;
+  fs::Dentry *const foo = fs::pathname_lookup("/FOO", res);
+  TEST_ASSERT(res == fs::Result::Ok);
+  TEST_ASSERT(foo != nullptr && foo->parent == filesystem.root_dentry);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+
+  // Served from the dcache.
+  TEST_ASSERT(fs::pathname_lookup("/./FOO", res) == foo);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+}
+
+TEST(fs, dcache_negative) {
+  FakeFilesystem filesystem;
+  const unsigned start_lookups = FakeInode::lookup_count;
+  const uint64_t start_hits = fs::dcache_stats().negative_hits;
+
+  fs::Result res = fs::Result::Ok;
+  TEST_ASSERT(fs::pathname_lookup("/BAR", res) == nullptr);
+  TEST_ASSERT(res == fs::Result::FileNotFound);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+
+  // Repeated failed lookups don't go to the filesystem.
+  for (unsigned i = 0; i < 3; ++i) {
+    res = fs::Result::Ok;
+    TEST_ASSERT(fs::pathname_lookup("/BAR", res) == nullptr);
+    TEST_ASSERT(res == fs::Result::FileNotFound);
+  }
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+  TEST_ASSERT(fs::dcache_stats().negative_hits == start_hits + 3);
+
+  // Creating the file invalidates the negative dentry.
+  TEST_ASSERT(fs::creat(*filesystem.root_dentry, "BAR") == fs::Result::Ok);
+  fs::Dentry *const bar = fs::pathname_lookup("/BAR", res);
+  TEST_ASSERT(res == fs::Result::Ok && bar != nullptr);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 2);
+}
+
+TEST(fs, dcache_negative_lru) {
+  FakeFilesystem filesystem;
+  const uint64_t start_evictions = fs::dcache_stats().negative_evictions;
+  const size_t start_count = fs::dcache_stats().negative_dentries;
+
+  // Fill the negative dcache well past its limit.
+  char name[] = "/N000";
+  for (unsigned i = 0; i < 300; ++i) {
+    name[2] = '0' + i / 100;
+    name[3] = '0' + i / 10 % 10;
+    name[4] = '0' + i % 10;
+    fs::Result res;
+    TEST_ASSERT(fs::pathname_lookup(name, res) == nullptr);
+  }
+  const auto &stats = fs::dcache_stats();
+  TEST_ASSERT(stats.negative_dentries > 0);
+  TEST_ASSERT(stats.negative_dentries < 300);
+  TEST_ASSERT(stats.negative_evictions - start_evictions ==
+              start_count + 300 - stats.negative_dentries);
+
+  // The most recent names are still cached, and the oldest aren't.
+  const unsigned start_lookups = FakeInode::lookup_count;
+  fs::Result res;
+  TEST_ASSERT(fs::pathname_lookup("/N299", res) == nullptr);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups);
+  TEST_ASSERT(fs::pathname_lookup("/N000", res) == nullptr);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+}
+
+TEST(fs, dcache_lru) {
+  FakeFilesystem filesystem;
+  filesystem.root_inode->names.push_back("BAZ");
+  // Reclaim unused dentries left by other tests, so that the counts
+  // below are exact.
+  fs::shrink_dcache(SIZE_MAX);
+  const auto &stats = fs::dcache_stats();
+  const size_t start_in_use = stats.dentries_in_use;
+  const uint64_t start_reclaimed = stats.dentries_reclaimed;
+  const unsigned start_lookups = FakeInode::lookup_count;
+
+  fs::Result res;
+  fs::Dentry *const baz = fs::pathname_lookup("/BAZ", res);
+  TEST_ASSERT(baz != nullptr);
+  // Nothing references it yet.
+  TEST_ASSERT(fs::dcache_stats().dentries_unused == 1);
+  {
+    fs::File file{*baz, 0};
+    TEST_ASSERT(fs::dcache_stats().dentries_unused == 0);
+    TEST_ASSERT(fs::dcache_stats().dentries_in_use == start_in_use + 1);
+  }
+
+  // Closing the file keeps the dentry around, so reopening it doesn't
+  // go to the filesystem.
+  TEST_ASSERT(fs::dcache_stats().dentries_unused == 1);
+  TEST_ASSERT(fs::pathname_lookup("/BAZ", res) == baz);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 1);
+
+  // Only unused dentries are reclaimed.
+  {
+    fs::File file{*baz, 0};
+    TEST_ASSERT(fs::shrink_dcache(SIZE_MAX) == 0);
+  }
+  TEST_ASSERT(fs::shrink_dcache(SIZE_MAX) == 1);
+  TEST_ASSERT(fs::dcache_stats().dentries_reclaimed == start_reclaimed + 1);
+  TEST_ASSERT(fs::dcache_stats().dentries_unused == 0);
+  TEST_ASSERT(fs::dcache_stats().dentries_in_use == start_in_use);
+
+  // So now it's looked up from the filesystem again.
+  TEST_ASSERT(fs::pathname_lookup("/BAZ", res) != nullptr);
+  TEST_ASSERT(FakeInode::lookup_count == start_lookups + 2);
+}
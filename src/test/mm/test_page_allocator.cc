@@ -339,3 +339,38 @@ TEST_CLASS_WITH_FIXTURE(mem::phys, PageFrameTable, multiple_suballocators,
   TEST_ASSERT(pg == pfa4.alloc(1));
   TEST_ASSERT(pfa4.get_total_pages() == 1);
 }
+
+TEST_CLASS(mem::phys, SimplePFA, deferred_init) {
+  // Two chunks of usable memory, with a hole at the start of the
+  // second chunk.
+  constexpr uint64_t chunk = SimplePFA::init_chunk_bytes;
+  constexpr unsigned chunk_pg = chunk / PG_SZ;
+  auto mm = std::to_array<e820_mm_entry>({
+      {.base = 0, .len = chunk, .type = E820_MM_TYPE_USABLE},
+      {.base = chunk + PG_SZ,
+       .len = chunk - PG_SZ,
+       .type = E820_MM_TYPE_USABLE},
+  });
+  static std::array<PageFrameDescriptor, 2 * chunk_pg> pft_arr;
+  TestPageFrameTable pft(mm, pft_arr);
+
+  {
+    // Only the first chunk is initialized. Allocating past it
+    // initializes the next chunk on demand.
+    SimplePFA pfa(pft, 0, pft.mem_limit(), /*deferred=*/true);
+    TEST_ASSERT(pfa.get_total_pages() == 2 * chunk_pg - 1);
+    TEST_ASSERT(pfa.alloc(chunk_pg) == 0);
+    TEST_ASSERT(pfa.alloc(1) == chunk + PG_SZ);
+    TEST_ASSERT(!pfa.init_chunk());
+  }
+
+  {
+    // Initialization in the background.
+    SimplePFA pfa(pft, 0, pft.mem_limit(), /*deferred=*/true);
+    TEST_ASSERT(pfa.init_chunk());
+    TEST_ASSERT(!pfa.init_chunk());
+    TEST_ASSERT(pfa.alloc(chunk_pg) == 0);
+    TEST_ASSERT(pfa.alloc(chunk_pg - 1) == chunk + PG_SZ);
+    TEST_ASSERT(!pfa.alloc(1));
+  }
+}
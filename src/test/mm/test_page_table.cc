@@ -0,0 +1,126 @@
+#include "../test.h"
+#include "memdefs.h"
+#include "mm/virt.h"
+
+namespace {
+
+/// Unused userspace virtual memory. Starts one page before a 4MB
+/// boundary, so that ranges span multiple page tables.
+constexpr size_t test_virt = 0x50000000 - PG_SZ;
+
+void *page(size_t i) { return (void *)(test_virt + i * PG_SZ); }
+
+/// Allocate a frame whose first byte is \a val. Page-sized
+/// allocations are page-aligned.
+std::byte *alloc_frame(uint8_t val) {
+  auto *frame = reinterpret_cast<std::byte *>(::operator new(PG_SZ));
+  *frame = std::byte{val};
+  return frame;
+}
+
+uint8_t read(size_t i) {
+  return *reinterpret_cast<volatile const uint8_t *>(page(i));
+}
+
+} // namespace
+
+TEST_CLASS(mem::virt, map_range, map_unmap) {
+  constexpr size_t num_pg = 3;
+  constexpr uint64_t phys = 0x1000000;
+  TEST_ASSERT(mem::virt::map_range(phys, page(0), num_pg,
+                                   /*userspace=*/false, /*writable=*/true));
+  for (size_t i = 0; i < num_pg; ++i) {
+    TEST_ASSERT(arch::page_table::get_phys(page(i)) == phys + i * PG_SZ);
+  }
+  TEST_ASSERT(!arch::page_table::get_phys(page(num_pg)).has_value());
+
+  mem::virt::FlushBatch batch;
+  TEST_ASSERT(mem::virt::protect_range(page(0), num_pg + 1,
+                                       /*writable=*/false, batch) == num_pg);
+
+  // Unmapped pages in the range are skipped.
+  size_t frames = 0;
+  uint64_t frame_sum = 0;
+  TEST_ASSERT(mem::virt::unmap_range(page(0), num_pg + 1, batch,
+                                     [&](uint64_t frame) {
+                                       ++frames;
+                                       frame_sum += frame - phys;
+                                     }) == num_pg);
+  TEST_ASSERT(frames == num_pg);
+  TEST_ASSERT(frame_sum == 3 * PG_SZ);
+  for (size_t i = 0; i < num_pg; ++i) {
+    TEST_ASSERT(!arch::page_table::get_phys(page(i)).has_value());
+  }
+  TEST_ASSERT(mem::virt::unmap_range(page(0), num_pg, batch) == 0);
+}
+
+TEST_CLASS(mem::virt, map_range, flush_invlpg) {
+  // Check that a flushed batch doesn't leave stale TLB entries, by
+  // remapping a page that was accessed before being unmapped.
+  auto *frame1 = alloc_frame(1);
+  auto *frame2 = alloc_frame(2);
+  TEST_ASSERT(mem::virt::map(mem::virt::hhdm_to_direct(frame1), page(0),
+                             /*userspace=*/false, /*writable=*/true));
+  TEST_ASSERT(read(0) == 1);
+
+  mem::virt::FlushBatch batch;
+  TEST_ASSERT(mem::virt::unmap_range(page(0), 1, batch) == 1);
+  batch.flush();
+  TEST_ASSERT(mem::virt::map(mem::virt::hhdm_to_direct(frame2), page(0),
+                             /*userspace=*/false, /*writable=*/true));
+  TEST_ASSERT(read(0) == 2);
+  TEST_ASSERT(mem::virt::unmap(page(0)));
+}
+
+TEST_CLASS(mem::virt, map_range, flush_cr3) {
+  // Same as above, but with enough pages that the batch reloads CR3.
+  constexpr size_t num_pg = 2 * arch::page_table::FlushBatch::max_invlpg;
+  auto *frame1 = alloc_frame(1);
+  auto *frame2 = alloc_frame(2);
+  for (size_t i = 0; i < num_pg; ++i) {
+    TEST_ASSERT(mem::virt::map(mem::virt::hhdm_to_direct(frame1), page(i),
+                               /*userspace=*/false, /*writable=*/true));
+    TEST_ASSERT(read(i) == 1);
+  }
+
+  {
+    mem::virt::FlushBatch batch;
+    TEST_ASSERT(mem::virt::unmap_range(page(0), num_pg, batch) == num_pg);
+  }
+  for (size_t i = 0; i < num_pg; ++i) {
+    TEST_ASSERT(mem::virt::map(mem::virt::hhdm_to_direct(frame2), page(i),
+                               /*userspace=*/false, /*writable=*/true));
+    TEST_ASSERT(read(i) == 2);
+  }
+
+  mem::virt::FlushBatch batch;
+  TEST_ASSERT(mem::virt::unmap_range(page(0), num_pg, batch) == num_pg);
+}
+
+TEST_CLASS(mem::virt, map_huge, split_kernel) {
+  // Splitting a kernel hugepage applies to every address space, not
+  // just the current one.
+  constexpr uint64_t phys = 0x1000000;
+  void *const virt = mem::virt::io_alloc(PG_PER_PT);
+  TEST_ASSERT(virt != nullptr);
+  TEST_ASSERT(mem::virt::map_huge(phys, virt, /*userspace=*/false,
+                                  /*writable=*/true, /*uncacheable=*/true));
+  auto *const pd = arch::page_table::get_page_directory();
+  auto *const other_pd = arch::page_table::clone_kernel_page_directory();
+
+  // Already uncacheable, so this doesn't need to split.
+  TEST_ASSERT(mem::virt::mark_uncacheable(virt));
+
+  TEST_ASSERT(mem::virt::unmap(virt));
+  arch::page_table::set_page_directory(other_pd);
+  const auto unmapped = arch::page_table::get_phys(virt);
+  const auto mapped = arch::page_table::get_phys((std::byte *)virt + PG_SZ);
+  arch::page_table::set_page_directory(pd);
+  TEST_ASSERT(!unmapped.has_value());
+  TEST_ASSERT(mapped == phys + PG_SZ);
+
+  arch::page_table::destroy_page_directory(other_pd, {});
+  mem::virt::FlushBatch batch;
+  TEST_ASSERT(mem::virt::unmap_range(virt, PG_PER_PT, batch) ==
+              PG_PER_PT - 1);
+}
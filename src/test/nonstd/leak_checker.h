@@ -18,10 +18,18 @@
 ///    destructor explicitly. This is checked by using the LeakChecker
 ///    test fixture and using the RCContainer wrapper.
 ///
+/// The net allocation check is also done per \ref
+/// nonstd::MemoryResource for the kernel heap and for any resource
+/// passed to LeakChecker::track(). A deallocation from a \ref
+/// nonstd::MonotonicArena is a no-op but is still counted, so this
+/// catches containers that don't give memory back to their resource.
+///
 
 #include "../test.h"
 #include "nonstd/allocator.h"
 #include "nonstd/hash_bytes.h"
+#include "nonstd/memory_resource.h"
+#include <array>
 #include <concepts>
 #include <utility>
 
@@ -32,12 +40,33 @@ public:
   static void construct() { ++construct_count; }
   static void destruct() { ++destruct_count; }
 
+protected:
+  LeakChecker() { track(*nonstd::heap_resource()); }
+
+  /// Also check the net (de)allocations of \a resource. This should
+  /// be called from the constructor of a derived fixture that owns
+  /// \a resource, so that it outlives the check.
+  void track(const nonstd::MemoryResource &resource) {
+    ASSERT(tracked_count < tracked.size());
+    tracked[tracked_count++].resource = &resource;
+  }
+
 private:
+  struct Tracked {
+    const nonstd::MemoryResource *resource = nullptr;
+    uint64_t start_alloc_count = 0;
+    uint64_t start_dealloc_count = 0;
+  };
+
   void setup() final {
     construct_count = 0;
     destruct_count = 0;
     start_alloc_count = nonstd::mem::alloc_count;
     start_dealloc_count = nonstd::mem::dealloc_count;
+    for (size_t i = 0; i < tracked_count; ++i) {
+      tracked[i].start_alloc_count = tracked[i].resource->alloc_count;
+      tracked[i].start_dealloc_count = tracked[i].resource->dealloc_count;
+    }
   }
   void destroy(bool &_test_passed) final {
     // Reset so the following tests pass.
@@ -56,12 +85,20 @@ private:
 #endif
     TEST_ASSERT(construct_count == destruct_count);
     TEST_ASSERT(net_allocs == net_deallocs);
+    for (size_t i = 0; i < tracked_count; ++i) {
+      const Tracked &t = tracked[i];
+      TEST_ASSERT(t.resource->alloc_count - t.start_alloc_count ==
+                  t.resource->dealloc_count - t.start_dealloc_count);
+    }
   }
 
   static inline uint64_t construct_count = 0;
   static inline uint64_t destruct_count = 0;
   uint64_t start_alloc_count = 0;
   uint64_t start_dealloc_count = 0;
+  /// The kernel heap and up to 3 other resources.
+  std::array<Tracked, 4> tracked{};
+  size_t tracked_count = 0;
 };
 
 namespace {
@@ -0,0 +1,343 @@
+#include "../test.h"
+#include "./leak_checker.h"
+#include "nonstd/flat_hash_map.h"
+#include "nonstd/string.h"
+#include "nonstd/string_view.h"
+#include "nonstd/vector.h"
+
+template <typename K, typename V>
+using rcflat_hash_map = RCMapContainer<nonstd::flat_hash_map, K, V>;
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, constructor, LeakChecker) {
+  // Nothing is allocated until the first insertion.
+  const rcflat_hash_map<int, int> h1;
+  TEST_ASSERT(h1.empty());
+  TEST_ASSERT(h1.bucket_count() == 0);
+
+  const rcflat_hash_map<int, int> h2(20);
+  TEST_ASSERT(h2.empty());
+  TEST_ASSERT(h2.bucket_count() >= 20);
+
+  const vector<std::pair<int, int>> vec{{1, 1}, {2, 2}, {3, 3}};
+  const rcflat_hash_map<int, int> h3{vec.begin(), vec.end()};
+  TEST_ASSERT(h3.size() == 3);
+
+  rcflat_hash_map<int, int> h4{{1, 2}, {3, 4}, {5, 6}, {7, 8}};
+  TEST_ASSERT(h4.size() == 4);
+  TEST_ASSERT(h4[1] == 2);
+  TEST_ASSERT(h4[3] == 4);
+  TEST_ASSERT(h4.at(5) == 6);
+  TEST_ASSERT(h4.at(7) == 8);
+
+  const rcflat_hash_map<int, int> h5(h3);
+  TEST_ASSERT(h5.size() == 3);
+  TEST_ASSERT(h5 == h3);
+
+  const rcflat_hash_map<int, int> h6(rcflat_hash_map<int, int>{{1, 2}, {3, 4}});
+  TEST_ASSERT(h6.size() == 2);
+  TEST_ASSERT(h6 == rcflat_hash_map<int, int>{{1, 2}, {3, 4}});
+
+  // Construct with duplicates
+  const rcflat_hash_map<int, int> h7{{1, 1}, {1, 2}, {2, 3}};
+  TEST_ASSERT(h7.size() == 2);
+  TEST_ASSERT(h7 == rcflat_hash_map<int, int>{{1, 2}, {2, 3}});
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, assignment, LeakChecker) {
+  rcflat_hash_map<int, int> h1;
+  const rcflat_hash_map<int, int> h2{{0, 1}, {1, 2}, {3, 3}};
+  h1 = h2;
+  TEST_ASSERT(h1 == h2);
+  TEST_ASSERT(h1 == rcflat_hash_map<int, int>{{3, 3}, {1, 2}, {0, 1}});
+
+  h1 = rcflat_hash_map<int, int>{{4, 4}, {5, 5}};
+  TEST_ASSERT(h1 == rcflat_hash_map<int, int>{{4, 4}, {5, 5}});
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, iterators, LeakChecker) {
+  {
+    // non-const
+    rcflat_hash_map<int, int> h{{1, 3}, {2, 0}, {4, 3}};
+    size_t i = 0;
+    for (auto &[k, v] : h) {
+      TEST_ASSERT(h[k] == v);
+      v = 12345;
+      TEST_ASSERT(h[k] == 12345);
+      ++i;
+    }
+    TEST_ASSERT(i == h.size());
+  }
+
+  {
+    // const
+    const rcflat_hash_map<int, int> h{{1, 3}, {2, 0}, {4, 3}};
+    size_t i = 0;
+    for (const auto &[k, v] : h) {
+      TEST_ASSERT(h.contains(k));
+      TEST_ASSERT(h.at(k) == v);
+      ++i;
+    }
+    TEST_ASSERT(i == h.size());
+  }
+
+  {
+    // empty, with and without storage
+    rcflat_hash_map<int, int> h;
+    TEST_ASSERT(h.begin() == h.end());
+    h[1] = 2;
+    h.erase(1);
+    TEST_ASSERT(h.bucket_count() > 0);
+    TEST_ASSERT(h.begin() == h.end());
+  }
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, capacity, LeakChecker) {
+  TEST_ASSERT(rcflat_hash_map<int, int>{}.empty());
+  TEST_ASSERT(rcflat_hash_map<int, int>{}.size() == 0);
+
+  TEST_ASSERT(!rcflat_hash_map<int, int>{{1, 1}}.empty());
+  TEST_ASSERT(rcflat_hash_map<int, int>{{1, 1}}.size() == 1);
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, modifiers, LeakChecker) {
+  {
+    // clear
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(!h.empty());
+    h.clear();
+    TEST_ASSERT(h.empty());
+    TEST_ASSERT(!h.contains(1));
+  }
+
+  {
+    // insert/emplace
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(!h.contains(5));
+    auto [it, inserted] = h.insert({5, 6});
+    TEST_ASSERT(inserted);
+    TEST_ASSERT(it->first == 5);
+    TEST_ASSERT(it->second == 6);
+    TEST_ASSERT(h[5] == 6);
+
+    TEST_ASSERT(h[3] == 4);
+    auto it2 = h.find(3);
+    std::tie(it, inserted) = h.insert({3, 7});
+    TEST_ASSERT(!inserted);
+    TEST_ASSERT(it->first == 3);
+    TEST_ASSERT(it->second == 7);
+    TEST_ASSERT(it2 == it);
+    TEST_ASSERT(h[3] == 7);
+
+    TEST_ASSERT(!h.contains(7));
+    std::tie(it, inserted) = h.emplace(7, 8);
+    TEST_ASSERT(inserted);
+    TEST_ASSERT(it->first == 7);
+    TEST_ASSERT(it->second == 8);
+    TEST_ASSERT(h[7] == 8);
+  }
+
+  {
+    // try_emplace
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(!h.contains(5));
+    auto [it, inserted] = h.try_emplace(5, 6);
+    TEST_ASSERT(inserted);
+    TEST_ASSERT(it->first == 5);
+    TEST_ASSERT(it->second == 6);
+    TEST_ASSERT(h[5] == 6);
+
+    TEST_ASSERT(h[3] == 4);
+    auto it2 = h.find(3);
+    std::tie(it, inserted) = h.try_emplace(3, 7);
+    TEST_ASSERT(!inserted);
+    TEST_ASSERT(it->first == 3);
+    TEST_ASSERT(it->second == 4);
+    TEST_ASSERT(it2 == it);
+    TEST_ASSERT(h[3] == 4);
+  }
+
+  {
+    // erase
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    const auto it = h.find(3);
+    TEST_ASSERT(it != h.end());
+    TEST_ASSERT(h.find(1) != h.end());
+    TEST_ASSERT(h.size() == 2);
+    h.erase(it);
+    TEST_ASSERT(h.size() == 1);
+    TEST_ASSERT(h.find(3) == h.end());
+    TEST_ASSERT(h.find(1) != h.end());
+
+    TEST_ASSERT(h.erase(3) == 0);
+    TEST_ASSERT(h.erase(1) == 1);
+    TEST_ASSERT(h.empty());
+
+    h.emplace(3, 5);
+    TEST_ASSERT(h.size() == 1);
+    TEST_ASSERT(h.find(3) != h.end());
+  }
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, backward_shift, LeakChecker) {
+  // Fill the table up to the maximum load factor, so there are long
+  // runs of full slots that wrap around the end of the table, then
+  // erase in an order that shifts elements back across the
+  // wraparound. Every remaining element must still be found, i.e.,
+  // no element was shifted before its home slot or left behind an
+  // empty slot.
+  rcflat_hash_map<int, int> h(64);
+  const size_t bucket_count = h.bucket_count();
+  const int n = bucket_count * 3 / 4;
+  for (int i = 0; i < n; ++i) {
+    h[i] = -i;
+  }
+  TEST_ASSERT(h.bucket_count() == bucket_count);
+
+  for (int step : {3, 2, 1}) {
+    for (int i = 0; i < n; i += step) {
+      TEST_ASSERT(h.erase(i) == 1);
+      // Erased elements are gone, and the rest are intact.
+      for (int j = 0; j < n; ++j) {
+        const bool erased = j <= i && j % step == 0;
+        TEST_ASSERT(h.contains(j) == !erased);
+        TEST_ASSERT(erased || h.at(j) == -j);
+      }
+    }
+
+    // Reinsert for the next round.
+    for (int i = 0; i < n; ++i) {
+      h[i] = -i;
+    }
+    TEST_ASSERT(h.size() == size_t(n));
+    TEST_ASSERT(h.bucket_count() == bucket_count);
+  }
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, lookup, LeakChecker) {
+  {
+    // const at
+    const rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(h.at(1) == 2);
+    TEST_ASSERT(h.at(3) == 4);
+  }
+
+  {
+    // non-const at/operator[]
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(h.at(1) == 2);
+    TEST_ASSERT(h.at(3) == 4);
+    TEST_ASSERT(h[1] == 2);
+    TEST_ASSERT(h[3] == 4);
+
+    // operator[] on a non-existent key acts like try_emplace(k),
+    // i.e., it'll default-construct the value.
+    TEST_ASSERT(h.size() == 2);
+    TEST_ASSERT(h[5] == int{});
+    TEST_ASSERT(h.size() == 3);
+  }
+
+  {
+    // const find/contains
+    const rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(h.contains(1));
+    TEST_ASSERT(h.find(1) != h.end());
+
+    TEST_ASSERT(!h.contains(5));
+    TEST_ASSERT(h.find(5) == h.end());
+
+    // Lookups in an unallocated map
+    const rcflat_hash_map<int, int> h2;
+    TEST_ASSERT(!h2.contains(1));
+    TEST_ASSERT(h2.find(1) == h2.end());
+  }
+
+  {
+    // non-const find
+    rcflat_hash_map<int, int> h{{1, 2}, {3, 4}};
+    TEST_ASSERT(h.contains(1));
+    auto it = h.find(1);
+    TEST_ASSERT(it != h.end());
+    it->second = 54321;
+
+    TEST_ASSERT(h == rcflat_hash_map<int, int>{{3, 4}, {1, 54321}});
+  }
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, hash_policy, LeakChecker) {
+  {
+    // reserve: the bucket count increases but the hashtable contents
+    // remain unchanged. The bucket count is a power of two.
+    rcflat_hash_map<int, int> h1{{1, 2}, {3, 4}};
+    const auto h2 = h1;
+    TEST_ASSERT(h1.bucket_count() < 100);
+    h1.reserve(200);
+    TEST_ASSERT(h1.bucket_count() >= 200);
+    TEST_ASSERT((h1.bucket_count() & (h1.bucket_count() - 1)) == 0);
+    TEST_ASSERT(h1 == h2);
+    TEST_ASSERT(h1.bucket_count() != h2.bucket_count());
+
+    // Reserved elements fit without rehashing.
+    const size_t bucket_count = h1.bucket_count();
+    for (int i = 0; i < 200; ++i) {
+      h1[i] = i;
+    }
+    TEST_ASSERT(h1.bucket_count() == bucket_count);
+  }
+
+  {
+    // rehash: ensure that contents get resized automatically.
+    rcflat_hash_map<int, int> h;
+    for (size_t i = 0, rehashes = 0, bucket_count = h.bucket_count();
+         rehashes < 4; ++i) {
+      h[i] = /* some arbitrary function */ 1 + 2 * i;
+      // The maximum load factor is 3/4.
+      TEST_ASSERT(4 * h.size() <= 3 * h.bucket_count());
+      if (h.bucket_count() > bucket_count) {
+        bucket_count = h.bucket_count();
+        ++rehashes;
+      }
+    }
+
+    for (auto [k, v] : h) {
+      TEST_ASSERT(v == 1 + 2 * k);
+    }
+    // Make sure this test is reasonable.
+    TEST_ASSERT(h.size() > 100);
+  }
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, non_member_functions, LeakChecker) {
+  TEST_ASSERT(rcflat_hash_map<int, int>{} == rcflat_hash_map<int, int>{});
+  TEST_ASSERT(rcflat_hash_map<int, int>{} != rcflat_hash_map<int, int>{{1, 2}});
+  TEST_ASSERT(rcflat_hash_map<int, int>{{2, 1}} != rcflat_hash_map<int, int>{});
+  TEST_ASSERT(rcflat_hash_map<int, int>{{1, 2}, {3, 4}} ==
+              rcflat_hash_map<int, int>{{1, 2}, {3, 4}});
+  TEST_ASSERT(rcflat_hash_map<int, int>{{1, 2}, {3, 4}} !=
+              rcflat_hash_map<int, int>{{1, 2}, {3, 5}});
+
+  // Comparison (naturally) shouldn't include duplicates.
+  TEST_ASSERT(rcflat_hash_map<int, int>{{1, 2}, {1, 4}} ==
+              rcflat_hash_map<int, int>{{1, 4}});
+
+  // Insertion order doesn't matter.
+  TEST_ASSERT(rcflat_hash_map<int, int>{{1, 2}, {3, 4}} ==
+              rcflat_hash_map<int, int>{{3, 4}, {1, 2}});
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, flat_hash_map, heterogeneous, LeakChecker) {
+  rcflat_hash_map<nonstd::string, int> h{{"hello", 1}, {"world", 2}};
+  TEST_ASSERT(h[string{"hello"}] == 1);
+  TEST_ASSERT(h[string{"world"}] == 2);
+  TEST_ASSERT(h["hello"_sv] == 1);
+  TEST_ASSERT(h["world"_sv] == 2);
+  TEST_ASSERT(h[/*(const char[6])*/ "hello"] == 1);
+  TEST_ASSERT(h[/*(const char[6])*/ "world"] == 2);
+  TEST_ASSERT(h[(const char *)"hello"] == 1);
+  TEST_ASSERT(h[(const char *)"world"] == 2);
+
+  // Erasure rehashes the shifted keys, which must agree with the hash
+  // used for lookups.
+  TEST_ASSERT(h.erase("hello"_sv) == 1);
+  TEST_ASSERT(!h.contains("hello"));
+  TEST_ASSERT(h.at("world"_sv) == 2);
+}
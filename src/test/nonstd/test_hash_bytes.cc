@@ -0,0 +1,43 @@
+#include "../test.h"
+#include "nonstd/hash_bytes.h"
+#include "nonstd/libc.h"
+#include "nonstd/string.h"
+#include "nonstd/string_view.h"
+
+TEST(nonstd, hash_bytes_xxh32) {
+  // Reference values for xxHash32 with seed 0.
+  const auto xxh32 = [](const char *s) {
+    return hash_bytes(s, nonstd::strlen(s), /*seed=*/0);
+  };
+  TEST_ASSERT(xxh32("") == 0x02CC5D05);
+  TEST_ASSERT(xxh32("a") == 0x550D7456);
+  TEST_ASSERT(xxh32("abc") == 0x32D153FF);
+  TEST_ASSERT(xxh32("hello") == 0xFB0077F9);
+  TEST_ASSERT(xxh32("0123456789abcdef") == 0xC2C45B69);
+  TEST_ASSERT(xxh32("The quick brown fox jumps over the lazy dog") ==
+              0xE85EA4DE);
+}
+
+TEST(nonstd, hash_bytes_unaligned) {
+  // Word reads must not depend on alignment.
+  const char buf[] = "xxThe quick brown fox jumps over the lazy dog";
+  const size_t len = sizeof buf - 3;
+  const size_t expected = hash_bytes(buf + 2, len);
+  char copy[sizeof buf];
+  for (size_t off = 0; off < 4; ++off) {
+    nonstd::memcpy(copy + off, buf + 2, len);
+    TEST_ASSERT(hash_bytes(copy + off, len) == expected);
+  }
+}
+
+TEST(nonstd, hash_strings) {
+  // All string-like types hash the same.
+  const size_t h = hash<string_view>{}("component"_sv);
+  TEST_ASSERT(hash<string>{}(string{"component"}) == h);
+  TEST_ASSERT(hash<const char[10]>{}("component") == h);
+  const char *s = "component";
+  TEST_ASSERT(hash<const char *>{}(s) == h);
+
+  TEST_ASSERT(hash<string_view>{}("componenu"_sv) != h);
+  TEST_ASSERT(hash<string_view>{}("componen"_sv) != h);
+}
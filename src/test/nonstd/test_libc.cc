@@ -1,5 +1,6 @@
 #include "../test.h"
 #include "nonstd/libc.h"
+#include "nonstd/memops.h"
 
 namespace {
 
@@ -83,6 +84,89 @@ TEST(nonstd, memset) {
   TEST_ASSERT(!compare_buf(buf1, buf2));
 }
 
+TEST(nonstd, memops_memcpy) {
+  // Every supported implementation, at every alignment of the source
+  // and destination, for lengths around the word and unroll sizes.
+  char src[256];
+  char dst[256];
+  fill_buf(src);
+  for (const auto &impl : nonstd::memops::impls()) {
+    if (!impl.supported()) {
+      continue;
+    }
+    for (size_t dst_off = 0; dst_off < 4; ++dst_off) {
+      for (size_t src_off = 0; src_off < 4; ++src_off) {
+        for (size_t len = 0; len <= 40; ++len) {
+          memset(dst, 0xff, sizeof dst);
+          TEST_ASSERT(impl.memcpy(&dst[dst_off], &src[src_off], len) ==
+                      &dst[dst_off]);
+          for (size_t i = 0; i < sizeof dst; ++i) {
+            const bool copied = i >= dst_off && i < dst_off + len;
+            TEST_ASSERT(dst[i] ==
+                        (copied ? src[i - dst_off + src_off] : char(0xff)));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(nonstd, memops_memset) {
+  char buf[256];
+  for (const auto &impl : nonstd::memops::impls()) {
+    if (!impl.supported()) {
+      continue;
+    }
+    for (size_t off = 0; off < 4; ++off) {
+      for (size_t len = 0; len <= 40; ++len) {
+        memset(buf, 0, sizeof buf);
+        // Only the low byte of the value is used.
+        TEST_ASSERT(impl.memset(&buf[off], 0x1a5, len) == &buf[off]);
+        for (size_t i = 0; i < sizeof buf; ++i) {
+          const bool set = i >= off && i < off + len;
+          TEST_ASSERT(buf[i] == (set ? char(0xa5) : 0));
+        }
+      }
+    }
+  }
+}
+
+TEST(nonstd, memmove_unaligned) {
+  // Overlapping moves by less than a word in both directions, which
+  // exercise the word and byte loops of the backwards copy.
+  char buf1[256];
+  char buf2[256];
+  for (size_t shift = 1; shift < 8; ++shift) {
+    for (size_t len = 0; len <= 40; ++len) {
+      fill_buf(buf1);
+      fill_buf(buf2);
+      memmove(&buf1[64 + shift], &buf1[64], len);
+      TEST_ASSERT(!memcmp(&buf1[64 + shift], &buf2[64], len));
+
+      fill_buf(buf1);
+      memmove(&buf1[64], &buf1[64 + shift], len);
+      TEST_ASSERT(!memcmp(&buf1[64], &buf2[64 + shift], len));
+    }
+  }
+}
+
+TEST(nonstd, memcmp_words) {
+  // The first differing byte decides the result, regardless of its
+  // position within a word.
+  char buf1[64] = {};
+  char buf2[64] = {};
+  for (size_t i = 0; i < 16; ++i) {
+    buf1[i] = 1;
+    buf1[i + 1] = 3;
+    buf2[i] = 2;
+    TEST_ASSERT(memcmp(buf1, buf2, sizeof buf1) < 0);
+    TEST_ASSERT(memcmp(buf2, buf1, sizeof buf1) > 0);
+    TEST_ASSERT(!memcmp(buf1, buf2, i));
+    buf1[i] = buf1[i + 1] = buf2[i] = 0;
+  }
+  TEST_ASSERT(!memcmp(&buf1[1], &buf2[3], 61));
+}
+
 TEST(nonstd, isprint) {
   TEST_ASSERT(!isprint(0));
   TEST_ASSERT(!isprint(31));
@@ -0,0 +1,210 @@
+#include "../test.h"
+#include "./leak_checker.h"
+#include "nonstd/deque.h"
+#include "nonstd/flat_hash_map.h"
+#include "nonstd/list.h"
+#include "nonstd/memory_resource.h"
+#include "nonstd/node_hash_map.h"
+#include "nonstd/string.h"
+#include "nonstd/vector.h"
+#include <cstddef>
+
+using nonstd::FixedPool;
+using nonstd::MonotonicArena;
+using nonstd::PolymorphicAllocator;
+
+namespace {
+
+/// Checks that containers return everything they allocate from the
+/// resources, on top of the usual LeakChecker checks.
+class ResourceLeakChecker : public LeakChecker {
+protected:
+  ResourceLeakChecker() {
+    track(arena);
+    track(pool);
+  }
+
+  std::byte arena_buf[2048];
+  MonotonicArena arena{arena_buf};
+  std::byte pool_buf[256];
+  FixedPool pool{32, pool_buf};
+};
+
+bool is_aligned(const void *ptr, size_t align) {
+  return reinterpret_cast<uintptr_t>(ptr) % align == 0;
+}
+
+} // namespace
+
+TEST_CLASS_WITH_FIXTURE(nonstd, MonotonicArena, allocate, LeakChecker) {
+  std::byte buf[64];
+  MonotonicArena arena{buf};
+  TEST_ASSERT(arena.remaining() == sizeof(buf));
+
+  // Allocations are bumped from the buffer, respecting alignment.
+  auto *const c = static_cast<std::byte *>(arena.allocate(1, 1));
+  TEST_ASSERT(c == buf);
+  void *const i = arena.allocate(sizeof(int), alignof(int));
+  TEST_ASSERT(is_aligned(i, alignof(int)));
+  TEST_ASSERT(i > c && i < buf + sizeof(buf));
+  arena.deallocate(i, sizeof(int), alignof(int));
+  arena.deallocate(c, 1, 1);
+  // Deallocation doesn't free anything.
+  TEST_ASSERT(arena.allocate(1, 1) != c);
+
+  // Going past the buffer allocates a chunk from the heap.
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  const uint64_t start_dealloc_count = nonstd::mem::dealloc_count;
+  void *const big = arena.allocate(sizeof(buf), 8);
+  TEST_ASSERT(is_aligned(big, 8));
+  TEST_ASSERT(big < buf || big >= buf + sizeof(buf));
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 1);
+  TEST_ASSERT(arena.remaining() > 0);
+
+  // Releasing frees the chunk and starts over from the buffer.
+  arena.release();
+  TEST_ASSERT(nonstd::mem::dealloc_count == start_dealloc_count + 1);
+  TEST_ASSERT(arena.remaining() == sizeof(buf));
+  TEST_ASSERT(arena.allocate(1, 1) == buf);
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, MonotonicArena, no_buffer, LeakChecker) {
+  MonotonicArena arena;
+  TEST_ASSERT(arena.remaining() == 0);
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  void *const p = arena.allocate(8);
+  TEST_ASSERT(p != nullptr);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 1);
+  // Small allocations fit in the same chunk.
+  arena.allocate(8);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 1);
+  // The arena frees its chunks on destruction, which LeakChecker
+  // verifies.
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, FixedPool, allocate, LeakChecker) {
+  std::byte buf[4 * 16];
+  FixedPool pool{16, buf};
+  TEST_ASSERT(pool.available() > 0);
+  TEST_ASSERT(pool.available() <= 4);
+  const size_t count = pool.available();
+
+  // Blocks are handed out in address order.
+  void *const a = pool.allocate(16, 8);
+  void *const b = pool.allocate(12, 4);
+  TEST_ASSERT(static_cast<std::byte *>(b) ==
+              static_cast<std::byte *>(a) + 16);
+  TEST_ASSERT(pool.available() == count - 2);
+
+  // Freed blocks are reused first.
+  pool.deallocate(a, 16, 8);
+  TEST_ASSERT(pool.available() == count - 1);
+  TEST_ASSERT(pool.allocate(16, 8) == a);
+  pool.deallocate(a, 16, 8);
+  pool.deallocate(b, 12, 4);
+  TEST_ASSERT(pool.available() == count);
+
+  // Allocations that don't fit in a block go to the heap.
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  void *const big = pool.allocate(17, 1);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 1);
+  TEST_ASSERT(pool.available() == count);
+  pool.deallocate(big, 17, 1);
+
+  // As do allocations once the pool is empty.
+  void *blocks[4];
+  for (size_t i = 0; i < count; ++i) {
+    blocks[i] = pool.allocate(16, 1);
+  }
+  TEST_ASSERT(pool.available() == 0);
+  void *const overflow = pool.allocate(16, 1);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 2);
+  pool.deallocate(overflow, 16, 1);
+  for (size_t i = 0; i < count; ++i) {
+    pool.deallocate(blocks[i], 16, 1);
+  }
+  TEST_ASSERT(pool.available() == count);
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, PolymorphicAllocator, containers,
+                        ResourceLeakChecker) {
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  {
+    // Parentheses, since RCWrapper would otherwise select the
+    // initializer list constructor.
+    nonstd::vector<RCWrapper<int>, PolymorphicAllocator<RCWrapper<int>>> v(
+        &arena);
+    for (int i = 0; i < 10; ++i) {
+      v.push_back(i);
+    }
+    TEST_ASSERT(v.get_allocator().resource() == &arena);
+    // Copies allocate from the same resource.
+    auto v2 = v;
+    TEST_ASSERT(v2.get_allocator().resource() == &arena);
+    TEST_ASSERT(v2 == v);
+
+    nonstd::deque<int, PolymorphicAllocator<int>> d{&arena};
+    for (int i = 0; i < 10; ++i) {
+      d.push_front(i);
+    }
+    TEST_ASSERT(d.size() == 10 && d.front() == 9);
+
+    using PairAllocator = PolymorphicAllocator<std::pair<const int, int>>;
+    nonstd::node_hash_map<int, int, PairAllocator> m{&arena};
+    nonstd::flat_hash_map<int, int, PairAllocator> fm{&arena};
+    for (int i = 0; i < 10; ++i) {
+      m[i] = i;
+      fm[i] = i;
+    }
+    TEST_ASSERT(m.size() == 10 && m.at(3) == 3);
+    TEST_ASSERT(fm.size() == 10 && fm.at(3) == 3);
+
+    nonstd::string s{&arena};
+    s.append("a long string that doesn't fit locally");
+    TEST_ASSERT(s.resource() == &arena);
+    TEST_ASSERT(s == "a long string that doesn't fit locally");
+  }
+  // Nothing came from the heap.
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count);
+  TEST_ASSERT(arena.alloc_count > 0);
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, PolymorphicAllocator, node_pool,
+                        ResourceLeakChecker) {
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  const size_t count = pool.available();
+  {
+    nonstd::list<RCWrapper<int>, PolymorphicAllocator<RCWrapper<int>>> l(
+        &pool);
+    l.push_back(1);
+    l.push_back(2);
+    l.pop_front();
+    l.push_back(3);
+    TEST_ASSERT(pool.available() == count - 2);
+    TEST_ASSERT(l.front() == 2 && l.back() == 3);
+  }
+  TEST_ASSERT(pool.available() == count);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count);
+}
+
+TEST_CLASS_WITH_FIXTURE(nonstd, PolymorphicAllocator, move,
+                        ResourceLeakChecker) {
+  nonstd::vector<int, PolymorphicAllocator<int>> v1{&arena};
+  v1.push_back(1);
+  nonstd::vector<int, PolymorphicAllocator<int>> v2;
+  TEST_ASSERT(v2.get_allocator().resource() == nonstd::heap_resource());
+  v2.push_back(2);
+  // The resource moves with the elements.
+  v2 = std::move(v1);
+  TEST_ASSERT(v2.get_allocator().resource() == &arena);
+  TEST_ASSERT(v2.size() == 1 && v2[0] == 1);
+
+  nonstd::string s1{&arena};
+  s1.resize(32);
+  nonstd::string s2{"heap-allocated string, too long to be local"};
+  s1.swap(s2);
+  TEST_ASSERT(s1.resource() == nonstd::heap_resource());
+  TEST_ASSERT(s2.resource() == &arena);
+  TEST_ASSERT(s1 == "heap-allocated string, too long to be local");
+  TEST_ASSERT(s2.size() == 32);
+}
@@ -169,3 +169,51 @@ TEST_CLASS_WITH_FIXTURE(nonstd, string, non_member_functions, LeakChecker) {
   TEST_ASSERT("foo"_sv == string{"foo"});
   TEST_ASSERT("foo"_sv != string{"bar"});
 }
+
+TEST_CLASS_WITH_FIXTURE(nonstd, string, small_string, LeakChecker) {
+  // Strings up to the local capacity (e.g., FAT 8.3 names) don't
+  // allocate at all, even when copied, moved or appended to.
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  {
+    string s;
+    TEST_ASSERT(s.capacity() == string::local_capacity);
+    TEST_ASSERT(s.c_str() != nullptr && s.c_str()[0] == '\0');
+
+    s = "KERNEL.BIN";
+    string s2{s};
+    string s3{std::move(s2)};
+    TEST_ASSERT(s3 == "KERNEL.BIN");
+    TEST_ASSERT(s2.empty());
+    s2 = s3;
+    s2.append("xxxxx");
+    TEST_ASSERT(s2.length() == string::local_capacity);
+    TEST_ASSERT(s2 == "KERNEL.BINxxxxx");
+    s2.swap(s3);
+    TEST_ASSERT(s2 == "KERNEL.BIN");
+    TEST_ASSERT(s3 == "KERNEL.BINxxxxx");
+    TEST_ASSERT(string(string::local_capacity, 'a').length() ==
+                string::local_capacity);
+  }
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count);
+
+  // Growing past the local capacity allocates, and the contents carry
+  // over in both directions when moving between local and allocated
+  // strings.
+  string s{"0123456789abcde"};
+  s.push_back('f');
+  TEST_ASSERT(s.capacity() > string::local_capacity);
+  TEST_ASSERT(nonstd::mem::alloc_count == start_alloc_count + 1);
+  TEST_ASSERT(s == "0123456789abcdef");
+
+  string local{"foo"};
+  local.swap(s);
+  TEST_ASSERT(local == "0123456789abcdef");
+  TEST_ASSERT(s == "foo");
+  s = std::move(local);
+  TEST_ASSERT(s == "0123456789abcdef");
+  TEST_ASSERT(local.empty());
+  local = "bar";
+  s = std::move(local);
+  TEST_ASSERT(s == "bar");
+  TEST_ASSERT(s.capacity() > string::local_capacity);
+}
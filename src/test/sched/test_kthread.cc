@@ -1,4 +1,5 @@
 #include "../test.h"
+#include "fpu.h"
 #include "sched/kthread.h"
 
 /// \file Test scheduler round-robin selection.
@@ -20,6 +21,8 @@ public:
     return running ? running->tid : InvalidTID;
   }
 
+  unsigned get_fpu_trap_count() const { return fpu_trap_count; }
+
   ThreadID choose_task_tid() const {
     if (auto thread = choose_task()) {
       return thread->tid;
@@ -90,5 +93,78 @@ TEST_CLASS(sched, Scheduler, round_robin) {
   TEST_ASSERT(scheduler.get_running_tid() == tid3);
 }
 
+namespace {
+
+void set_xmm0(uint32_t val) {
+  __asm__ volatile("movd %0, %%xmm0" : : "r"(val));
+}
+
+uint32_t get_xmm0() {
+  uint32_t val;
+  __asm__ volatile("movd %%xmm0, %0" : "=r"(val));
+  return val;
+}
+
+} // namespace
+
+TEST_CLASS(sched, Scheduler, lazy_fpu) {
+  if (!arch::fpu::init()) {
+    return;
+  }
+  // There's no #NM handler in the test kernel, so traps are simulated
+  // by calling handle_fpu_trap() before touching the FPU.
+  TestScheduler scheduler;
+  const ThreadID tid0 = scheduler.bootstrap();
+  const ThreadID tid1 = scheduler.new_thread(nullptr, nullptr, nullptr);
+  const ThreadID tid2 = scheduler.new_thread(nullptr, nullptr, nullptr);
+  TEST_ASSERT(arch::fpu::task_switched());
+
+  // tid0 uses the FPU.
+  scheduler.handle_fpu_trap();
+  TEST_ASSERT(!arch::fpu::task_switched());
+  set_xmm0(1);
+
+  // tid1 gets fresh registers; tid0's are saved.
+  scheduler.schedule();
+  TEST_ASSERT(arch::fpu::task_switched());
+  scheduler.handle_fpu_trap();
+  TEST_ASSERT(get_xmm0() == 0);
+  set_xmm0(2);
+
+  // tid2 doesn't use the FPU, so it doesn't trap. Switching back to
+  // the owner (tid1) doesn't trap either.
+  scheduler.schedule();
+  TEST_ASSERT(scheduler.get_running_tid() == tid2);
+  TEST_ASSERT(arch::fpu::task_switched());
+  scheduler.schedule();
+  TEST_ASSERT(scheduler.get_running_tid() == tid0);
+  scheduler.schedule();
+  TEST_ASSERT(scheduler.get_running_tid() == tid1);
+  TEST_ASSERT(!arch::fpu::task_switched());
+  TEST_ASSERT(get_xmm0() == 2);
+  TEST_ASSERT(scheduler.get_fpu_trap_count() == 2);
+
+  // tid0 gets its state back.
+  scheduler.schedule();
+  scheduler.schedule();
+  TEST_ASSERT(scheduler.get_running_tid() == tid0);
+  TEST_ASSERT(arch::fpu::task_switched());
+  scheduler.handle_fpu_trap();
+  TEST_ASSERT(get_xmm0() == 1);
+
+  // The kernel can use the FPU without clobbering any thread's state.
+  sched::kernel_fpu_begin();
+  set_xmm0(3);
+  sched::kernel_fpu_end();
+  TEST_ASSERT(arch::fpu::task_switched());
+  scheduler.handle_fpu_trap();
+  TEST_ASSERT(get_xmm0() == 1);
+
+  // Leave the registers unowned for other tests.
+  sched::kernel_fpu_begin();
+  sched::kernel_fpu_end();
+  arch::fpu::set_task_switched(false);
+}
+
 // TODO: unit test scheduling with blocked threads. Do this once we
 // actually set threads as blocked.
@@ -0,0 +1,112 @@
+#include "../test.h"
+#include "nonstd/allocator.h"
+#include "util/intrusive_hash_table.h"
+#include <array>
+
+namespace {
+
+struct Entry;
+using EntryTable = util::IntrusiveHashTable<Entry>;
+struct Entry : public util::IntrusiveHashTableNode<Entry> {
+  Entry() = default;
+  explicit Entry(unsigned _key) : key{_key} {}
+
+  unsigned key = 0;
+};
+
+/// A deliberately poor hash, so that keys collide in a bucket.
+size_t bad_hash(unsigned key) { return key % 4; }
+
+Entry *find(const EntryTable &table, unsigned key) {
+  return table.find(bad_hash(key),
+                    [key](const Entry &e) { return e.key == key; });
+}
+
+} // namespace
+
+TEST_CLASS(util, IntrusiveHashTable, empty) {
+  EntryTable table;
+  TEST_ASSERT(table.empty());
+  TEST_ASSERT(table.size() == 0);
+  // Nothing is allocated until the first insertion.
+  TEST_ASSERT(table.bucket_count() == 0);
+  TEST_ASSERT(find(table, 0) == nullptr);
+}
+
+TEST_CLASS(util, IntrusiveHashTable, insert_erase) {
+  EntryTable table;
+  std::array<Entry, 8> arr;
+  for (unsigned i = 0; i < arr.size(); ++i) {
+    arr[i].key = i;
+    TEST_ASSERT(!arr[i].linked());
+    table.insert(arr[i], bad_hash(i));
+    TEST_ASSERT(arr[i].linked());
+    TEST_ASSERT(arr[i].cached_hash() == bad_hash(i));
+  }
+  TEST_ASSERT(table.size() == arr.size());
+  for (unsigned i = 0; i < arr.size(); ++i) {
+    TEST_ASSERT(find(table, i) == &arr[i]);
+  }
+  TEST_ASSERT(find(table, arr.size()) == nullptr);
+
+  // Erase from the front and the back of a chain: keys 0 and 4 share
+  // a bucket, and 4 was pushed in front of 0.
+  table.erase(arr[4]);
+  table.erase(arr[0]);
+  TEST_ASSERT(!arr[0].linked());
+  TEST_ASSERT(table.size() == arr.size() - 2);
+  TEST_ASSERT(find(table, 0) == nullptr);
+  TEST_ASSERT(find(table, 4) == nullptr);
+  for (unsigned i = 1; i < arr.size(); ++i) {
+    TEST_ASSERT(i == 4 || find(table, i) == &arr[i]);
+  }
+
+  // Nodes can be reinserted after being erased.
+  table.insert(arr[0], bad_hash(0));
+  TEST_ASSERT(find(table, 0) == &arr[0]);
+
+  size_t n = 0;
+  table.for_each([&](Entry &) { ++n; });
+  TEST_ASSERT(n == table.size());
+}
+
+TEST_CLASS(util, IntrusiveHashTable, rehash) {
+  // Growing the table doesn't move nodes, and only allocates the
+  // bucket array.
+  constexpr size_t n = 100;
+  std::array<Entry, n> arr;
+  EntryTable table;
+  const uint64_t start_alloc_count = nonstd::mem::alloc_count;
+  for (unsigned i = 0; i < n; ++i) {
+    arr[i].key = i;
+    // Use a good hash here so that the chains are short.
+    table.insert(arr[i], i * 0x9e3779b9u);
+  }
+  TEST_ASSERT(table.bucket_count() >= n);
+  TEST_ASSERT(nonstd::mem::alloc_count - start_alloc_count <= 4);
+  for (unsigned i = 0; i < n; ++i) {
+    TEST_ASSERT(table.find(i * 0x9e3779b9u, [i](const Entry &e) {
+      return e.key == i;
+    }) == &arr[i]);
+  }
+
+  // Shrinking isn't automatic, but can be done explicitly.
+  for (unsigned i = 0; i < n - 1; ++i) {
+    table.erase(arr[i]);
+  }
+  table.rehash(0);
+  TEST_ASSERT(table.bucket_count() == 16);
+  TEST_ASSERT(table.find(99 * 0x9e3779b9u, [](const Entry &e) {
+    return e.key == 99;
+  }) == &arr[99]);
+}
+
+TEST_CLASS(util, IntrusiveHashTable, destroy) {
+  // Nodes outlive the table, and are unlinked when it's destroyed.
+  Entry e{1};
+  {
+    EntryTable table;
+    table.insert(e, bad_hash(1));
+  }
+  TEST_ASSERT(!e.linked());
+}
@@ -0,0 +1,169 @@
+#include "../test.h"
+#include "util/intrusive_interval_tree.h"
+#include <array>
+
+namespace {
+
+struct Interval;
+using IntervalTree = util::IntrusiveIntervalTree<Interval>;
+struct Interval : public util::IntrusiveIntervalTreeNode<Interval> {
+  Interval() = default;
+  Interval(size_t _start, size_t _end) : start{_start}, end{_end} {}
+
+  size_t interval_start() const { return start; }
+  size_t interval_end() const { return end; }
+
+  size_t start = 0;
+  size_t end = 0;
+};
+
+/// Simple LCG, so that the randomized tests are deterministic.
+struct Rand {
+  uint32_t operator()() { return state = state * 1103515245 + 12345; }
+  uint32_t state = 1;
+};
+
+/// Linear scan equivalent of \ref IntervalTree::find_overlap().
+template <size_t N>
+const Interval *brute_find_overlap(const std::array<Interval, N> &arr,
+                                   const std::array<bool, N> &present,
+                                   size_t start, size_t end) {
+  const Interval *rval = nullptr;
+  for (size_t i = 0; i < N; ++i) {
+    if (present[i] && arr[i].start < end && arr[i].end > start &&
+        (rval == nullptr || arr[i].start < rval->start)) {
+      rval = &arr[i];
+    }
+  }
+  return rval;
+}
+
+/// Checks that \a tree is sorted, and returns its size.
+size_t check_sorted(const IntervalTree &tree) {
+  size_t n = 0;
+  size_t prev_start = 0;
+  bool sorted = true;
+  tree.for_each([&](const Interval &i) {
+    sorted &= i.start >= prev_start;
+    prev_start = i.start;
+    ++n;
+  });
+  return sorted ? n : -1;
+}
+
+} // namespace
+
+TEST_CLASS(util, IntrusiveIntervalTree, empty) {
+  IntervalTree tree;
+  TEST_ASSERT(tree.empty());
+  TEST_ASSERT(tree.size() == 0);
+  TEST_ASSERT(tree.find(0) == nullptr);
+  TEST_ASSERT(tree.find_overlap(0, 100) == nullptr);
+  TEST_ASSERT(tree.lower_bound(0) == nullptr);
+}
+
+TEST_CLASS(util, IntrusiveIntervalTree, disjoint) {
+  // Non-overlapping intervals, like VMAs.
+  IntervalTree tree;
+  std::array<Interval, 3> arr{Interval{10, 20}, Interval{30, 35},
+                              Interval{20, 25}};
+  for (auto &i : arr) {
+    tree.insert(i);
+  }
+  TEST_ASSERT(tree.size() == 3);
+  TEST_ASSERT(check_sorted(tree) == 3);
+
+  TEST_ASSERT(tree.find(9) == nullptr);
+  TEST_ASSERT(tree.find(10) == &arr[0]);
+  TEST_ASSERT(tree.find(19) == &arr[0]);
+  TEST_ASSERT(tree.find(20) == &arr[2]);
+  TEST_ASSERT(tree.find(25) == nullptr);
+  TEST_ASSERT(tree.find(34) == &arr[1]);
+  TEST_ASSERT(tree.find(35) == nullptr);
+
+  TEST_ASSERT(tree.find_overlap(0, 10) == nullptr);
+  TEST_ASSERT(tree.find_overlap(0, 11) == &arr[0]);
+  TEST_ASSERT(tree.find_overlap(24, 31) == &arr[2]);
+  TEST_ASSERT(tree.find_overlap(25, 30) == nullptr);
+
+  TEST_ASSERT(tree.lower_bound(0) == &arr[0]);
+  TEST_ASSERT(tree.lower_bound(11) == &arr[2]);
+  TEST_ASSERT(tree.lower_bound(30) == &arr[1]);
+  TEST_ASSERT(tree.lower_bound(31) == nullptr);
+
+  tree.erase(arr[2]);
+  TEST_ASSERT(tree.size() == 2);
+  TEST_ASSERT(tree.find(20) == nullptr);
+  TEST_ASSERT(tree.lower_bound(11) == &arr[1]);
+
+  // Nodes can be reinserted after being erased.
+  tree.insert(arr[2]);
+  TEST_ASSERT(tree.find(20) == &arr[2]);
+  TEST_ASSERT(check_sorted(tree) == 3);
+}
+
+TEST_CLASS(util, IntrusiveIntervalTree, randomized) {
+  // Overlapping intervals, checked against a linear scan.
+  constexpr size_t n = 200;
+  std::array<Interval, n> arr;
+  std::array<bool, n> present{};
+  IntervalTree tree;
+  Rand rand;
+
+  for (auto &i : arr) {
+    i.start = rand() % 1000;
+    i.end = i.start + 1 + rand() % 50;
+  }
+
+  size_t size = 0;
+  for (unsigned iter = 0; iter < 2000; ++iter) {
+    const size_t idx = rand() % n;
+    if (present[idx]) {
+      tree.erase(arr[idx]);
+      --size;
+    } else {
+      tree.insert(arr[idx]);
+      ++size;
+    }
+    present[idx] = !present[idx];
+
+    const size_t start = rand() % 1100;
+    const size_t end = start + 1 + rand() % 20;
+    const Interval *expected = brute_find_overlap(arr, present, start, end);
+    const Interval *actual = tree.find_overlap(start, end);
+    TEST_ASSERT((expected == nullptr) == (actual == nullptr));
+    if (expected != nullptr) {
+      // There may be multiple intervals with the same start.
+      TEST_ASSERT(actual->start == expected->start);
+    }
+  }
+  TEST_ASSERT(tree.size() == size);
+  TEST_ASSERT(check_sorted(tree) == size);
+}
+
+TEST_CLASS(util, IntrusiveIntervalTree, sequential) {
+  // Sequential insertion is the worst case for an unbalanced tree;
+  // this would overflow the stack (or be very slow) if rebalancing
+  // was broken.
+  constexpr size_t n = 4096;
+  static std::array<Interval, n> arr;
+  IntervalTree tree;
+  for (size_t i = 0; i < n; ++i) {
+    arr[i] = {i * 2, i * 2 + 1};
+    tree.insert(arr[i]);
+  }
+  TEST_ASSERT(tree.size() == n);
+  for (size_t i = 0; i < n; ++i) {
+    TEST_ASSERT(tree.find(i * 2) == &arr[i]);
+    TEST_ASSERT(tree.find(i * 2 + 1) == nullptr);
+  }
+
+  for (size_t i = 0; i < n; i += 2) {
+    tree.erase(arr[i]);
+  }
+  TEST_ASSERT(tree.size() == n / 2);
+  TEST_ASSERT(check_sorted(tree) == n / 2);
+  for (size_t i = 0; i < n; ++i) {
+    TEST_ASSERT((tree.find(i * 2) == nullptr) == (i % 2 == 0));
+  }
+}
@@ -0,0 +1,32 @@
+#include "../test.h"
+#include "nonstd/string_view.h"
+#include "util/pathutil.h"
+
+TEST(util::path, left_partition_path) {
+  auto [first, rest] = left_partition_path("BIN/INIT");
+  TEST_ASSERT(first == "BIN");
+  TEST_ASSERT(rest == "INIT");
+
+  std::tie(first, rest) = left_partition_path(rest);
+  TEST_ASSERT(first == "INIT");
+  TEST_ASSERT(rest.empty());
+
+  std::tie(first, rest) = left_partition_path("/BIN");
+  TEST_ASSERT(first.empty());
+  TEST_ASSERT(rest == "BIN");
+}
+
+TEST(util::path, left_partition_path_hash) {
+  // The component hash matches the string hash, so it can be used to
+  // look up string keys.
+  nonstd::string_view path = "/USR/BIN//SOME_LONG_NAME.TXT";
+  size_t components = 0;
+  while (!path.empty()) {
+    nonstd::string_view component;
+    size_t hash = 0;
+    std::tie(component, path) = left_partition_path(path, hash);
+    TEST_ASSERT(hash == nonstd::hash<nonstd::string_view>{}(component));
+    ++components;
+  }
+  TEST_ASSERT(components == 5);
+}
@@ -0,0 +1,69 @@
+/// \file
+/// \brief Page fault microbenchmark. Measures the cost of mmap and of
+/// anonymous page faults as the number of VMAs in the process grows.
+///
+/// Faults that hit a different VMA each time exercise the VMA lookup,
+/// while sequential faults within one VMA should mostly hit the
+/// last-faulted VMA cache.
+
+#include "syscall.h"
+
+namespace {
+
+constexpr uint32_t pg_sz = 4096;
+
+/// Number of faults to measure per configuration.
+constexpr uint32_t faults = 256;
+
+void touch(uint32_t addr) { *reinterpret_cast<volatile char *>(addr) = 1; }
+
+/// Maps \a n one-page VMAs starting at \a base, separated by
+/// one-page holes, plus a \a faults page VMA after them.
+void bench(uint32_t n, uint32_t base) {
+  uint64_t start = sys::rdtsc();
+  for (uint32_t i = 0; i < n; ++i) {
+    sys::mmap(base + 2 * i * pg_sz, pg_sz, sys::prot_read | sys::prot_write,
+              sys::map_anon | sys::map_private);
+  }
+  const uint32_t mmap_cycles = uint32_t(sys::rdtsc() - start) / n;
+
+  const uint32_t seq_base = base + 2 * n * pg_sz;
+  sys::mmap(seq_base, faults * pg_sz, sys::prot_read | sys::prot_write,
+            sys::map_anon | sys::map_private);
+
+  // One fault in each of (up to) \a faults VMAs spread evenly across
+  // the range.
+  const uint32_t scattered = n < faults ? n : faults;
+  const uint32_t stride = n / scattered;
+  start = sys::rdtsc();
+  for (uint32_t i = 0; i < scattered; ++i) {
+    touch(base + 2 * i * stride * pg_sz);
+  }
+  const uint32_t scattered_cycles = uint32_t(sys::rdtsc() - start) / scattered;
+
+  start = sys::rdtsc();
+  for (uint32_t i = 0; i < faults; ++i) {
+    touch(seq_base + i * pg_sz);
+  }
+  const uint32_t seq_cycles = uint32_t(sys::rdtsc() - start) / faults;
+
+  sys::print("\t");
+  sys::print(n);
+  sys::print(" VMAs: mmap=");
+  sys::print(mmap_cycles);
+  sys::print(" scattered fault=");
+  sys::print(scattered_cycles);
+  sys::print(" sequential fault=");
+  sys::print(seq_cycles);
+  sys::print("\r\n");
+}
+
+} // namespace
+
+extern "C" void _start() {
+  sys::print("faultben: cycles/op\r\n");
+  bench(1, 0x10000000);
+  bench(100, 0x20000000);
+  bench(10000, 0x40000000);
+  sys::exit(0);
+}
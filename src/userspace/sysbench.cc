@@ -0,0 +1,33 @@
+/// \file
+/// \brief Null-syscall microbenchmark comparing `int 0x80` and
+/// SYSENTER/SYSEXIT.
+
+#include "syscall.h"
+
+namespace {
+
+constexpr unsigned iters = 10000;
+
+template <typename F> uint32_t bench(F syscall) {
+  // Warm up caches and TLB.
+  for (unsigned i = 0; i < 1000; ++i) {
+    syscall(proc::Syscall::Null, 0, 0, 0, 0, 0);
+  }
+
+  const uint64_t start = sys::rdtsc();
+  for (unsigned i = 0; i < iters; ++i) {
+    syscall(proc::Syscall::Null, 0, 0, 0, 0, 0);
+  }
+  return uint32_t(sys::rdtsc() - start) / iters;
+}
+
+} // namespace
+
+extern "C" void _start() {
+  sys::print("sysbench: null syscall cycles/call\r\n\tint 0x80: ");
+  sys::print(bench(sys::syscall_int80));
+  sys::print("\r\n\tsysenter: ");
+  sys::print(bench(sys::syscall_sysenter));
+  sys::print("\r\n");
+  sys::exit(0);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+/// \file
+/// \brief Userspace syscall wrappers and helpers.
+///
+/// \see kernel/proc/syscalls.h for the syscall ABI.
+
+#include "proc/syscalls.h"
+#include <cstdint>
+
+namespace sys {
+
+/// Issue a syscall via `int 0x80`.
+inline int32_t syscall_int80(proc::Syscall nr, uint32_t a1 = 0,
+                             uint32_t a2 = 0, uint32_t a3 = 0,
+                             uint32_t a4 = 0, uint32_t a5 = 0) {
+  uint32_t eax = static_cast<uint32_t>(nr);
+  __asm__ volatile("int $0x80"
+                   : "+a"(eax)
+                   : "b"(a1), "c"(a2), "d"(a3), "S"(a4), "D"(a5)
+                   : "memory", "cc");
+  return eax;
+}
+
+/// Issue a syscall via SYSENTER. The CPU must support SYSENTER.
+inline int32_t syscall_sysenter(proc::Syscall nr, uint32_t a1 = 0,
+                                uint32_t a2 = 0, uint32_t a3 = 0,
+                                uint32_t a4 = 0, uint32_t a5 = 0) {
+  uint32_t eax = static_cast<uint32_t>(nr);
+  __asm__ volatile("push %%ebp\n\t"
+                   "push $1f\n\t"
+                   "mov %%esp, %%ebp\n\t"
+                   "sysenter\n"
+                   "1:\n\t"
+                   "pop %%ebp"
+                   : "+a"(eax), "+c"(a2), "+d"(a3)
+                   : "b"(a1), "S"(a4), "D"(a5)
+                   : "memory", "cc");
+  return eax;
+}
+
+inline uint64_t rdtsc() {
+  uint32_t lo, hi;
+  __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+  return (uint64_t)hi << 32 | lo;
+}
+
+/// Print a string to the kernel console.
+inline void print(const char *str) {
+  uint32_t len = 0;
+  while (str[len]) {
+    ++len;
+  }
+  syscall_int80(proc::Syscall::DebugPrint, (uint32_t)str, len);
+}
+
+/// Print an unsigned integer to the kernel console. (32-bit only, since
+/// userspace isn't linked against libgcc for 64-bit division.)
+inline void print(uint32_t n) {
+  char buf[11];
+  char *p = buf + sizeof buf - 1;
+  *p = '\0';
+  do {
+    *--p = '0' + n % 10;
+    n /= 10;
+  } while (n);
+  print(p);
+}
+
+/// mmap() protection and flags. These mirror the bitfields of the
+/// kernel's `VirtualMemoryArea::Access` and `VirtualMemoryArea::Flags`.
+constexpr uint8_t prot_exec = 1 << 0;
+constexpr uint8_t prot_write = 1 << 1;
+constexpr uint8_t prot_read = 1 << 2;
+constexpr uint8_t map_anon = 1 << 0;
+constexpr uint8_t map_private = 1 << 1;
+constexpr uint8_t map_shared = 1 << 2;
+constexpr uint8_t map_populate = 1 << 3;
+
+/// \return the mapped address, or a negated error (which may be hard
+/// to distinguish from a high address).
+inline int32_t mmap(uint32_t addr, uint32_t len, uint8_t prot, uint8_t flags,
+                    int32_t fd = -1, uint32_t offset = 0) {
+  return syscall_int80(proc::Syscall::Mmap, addr, len, prot | flags << 8, fd,
+                       offset);
+}
+
+inline int32_t madvise(uint32_t addr, uint32_t len, proc::Advice advice) {
+  return syscall_int80(proc::Syscall::Madvise, addr, len,
+                       static_cast<uint32_t>(advice));
+}
+
+/// \return the child's pid in the parent, and 0 in the child.
+inline int32_t fork() { return syscall_int80(proc::Syscall::Fork); }
+
+[[noreturn]] inline void exit(int status) {
+  syscall_int80(proc::Syscall::Exit, status);
+  __builtin_unreachable();
+}
+
+} // namespace sys